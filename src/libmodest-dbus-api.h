@@ -91,6 +91,15 @@ enum ModestDbusDeleteMessageArguments
 	MODEST_DBUS_DELETE_MESSAGE_ARGS_COUNT
 };
 
+/* Handled via normal D-Bus, as osso-rpc does not support arrays. Returns
+ * an array of booleans telling, for each URI, whether it was deleted. */
+#define MODEST_DBUS_METHOD_DELETE_MESSAGES "DeleteMessages"
+enum ModestDbusDeleteMessagesArguments
+{
+	MODEST_DBUS_DELETE_MESSAGES_ARG_URIS,
+	MODEST_DBUS_DELETE_MESSAGES_ARGS_COUNT
+};
+
 #define MODEST_DBUS_METHOD_OPEN_DEFAULT_INBOX "OpenDefaultInbox"
 
 #define MODEST_DBUS_METHOD_OPEN_EDIT_ACCOUNTS_DIALOG "OpenEditAccountsDialog"
@@ -116,6 +125,118 @@ enum ModestDbusGetUnreadMessagesArguments
 #define MODEST_DBUS_METHOD_SEARCH "Search"
 #define MODEST_DBUS_METHOD_GET_FOLDERS "GetFolders"
 
+/* Same arguments as Search, plus a caller chosen search id and the
+ * maximum number of hits per chunk (0 lets modest choose). Returns as
+ * soon as the search has started; the hits are then sent to the caller
+ * with the search_hits signal, until the last chunk or until the caller
+ * calls CancelSearchStream. */
+#define MODEST_DBUS_METHOD_SEARCH_STREAM "SearchStream"
+enum ModestDbusSearchStreamArguments
+{
+	MODEST_DBUS_SEARCH_STREAM_ARG_QUERY,
+	MODEST_DBUS_SEARCH_STREAM_ARG_FOLDER,
+	MODEST_DBUS_SEARCH_STREAM_ARG_START_DATE,
+	MODEST_DBUS_SEARCH_STREAM_ARG_END_DATE,
+	MODEST_DBUS_SEARCH_STREAM_ARG_FLAGS,
+	MODEST_DBUS_SEARCH_STREAM_ARG_MIN_SIZE,
+	MODEST_DBUS_SEARCH_STREAM_ARG_SEARCH_ID,
+	MODEST_DBUS_SEARCH_STREAM_ARG_CHUNK_SIZE,
+	MODEST_DBUS_SEARCH_STREAM_ARGS_COUNT
+};
+
+/* Asks modest to stop a search started with SearchStream, identified by
+ * its search id, from the same sender. No search_hits are sent for it
+ * afterwards. Sent without expecting a reply. */
+#define MODEST_DBUS_METHOD_CANCEL_SEARCH_STREAM "CancelSearchStream"
+enum ModestDbusCancelSearchStreamArguments
+{
+	MODEST_DBUS_CANCEL_SEARCH_STREAM_ARG_SEARCH_ID,
+	MODEST_DBUS_CANCEL_SEARCH_STREAM_ARGS_COUNT
+};
+
+/* Same arguments as Search, plus the maximum number of hits per page.
+ * Returns the first page of hits, as an array like Search, and a cursor
+ * to get the next page with SearchNextPage, or an empty string if there
+ * are no more hits. */
+#define MODEST_DBUS_METHOD_SEARCH_PAGED "SearchPaged"
+enum ModestDbusSearchPagedArguments
+{
+	MODEST_DBUS_SEARCH_PAGED_ARG_QUERY,
+	MODEST_DBUS_SEARCH_PAGED_ARG_FOLDER,
+	MODEST_DBUS_SEARCH_PAGED_ARG_START_DATE,
+	MODEST_DBUS_SEARCH_PAGED_ARG_END_DATE,
+	MODEST_DBUS_SEARCH_PAGED_ARG_FLAGS,
+	MODEST_DBUS_SEARCH_PAGED_ARG_MIN_SIZE,
+	MODEST_DBUS_SEARCH_PAGED_ARG_PAGE_SIZE,
+	MODEST_DBUS_SEARCH_PAGED_ARGS_COUNT
+};
+
+/* Returns the next page of a search started with SearchPaged, like it.
+ * Modest forgets the cursor once it has sent the last page. */
+#define MODEST_DBUS_METHOD_SEARCH_NEXT_PAGE "SearchNextPage"
+enum ModestDbusSearchNextPageArguments
+{
+	MODEST_DBUS_SEARCH_NEXT_PAGE_ARG_CURSOR,
+	MODEST_DBUS_SEARCH_NEXT_PAGE_ARG_PAGE_SIZE,
+	MODEST_DBUS_SEARCH_NEXT_PAGE_ARGS_COUNT
+};
+
+/* Makes modest forget a cursor before its last page. Sent without
+ * expecting a reply. */
+#define MODEST_DBUS_METHOD_CLOSE_SEARCH_CURSOR "CloseSearchCursor"
+enum ModestDbusCloseSearchCursorArguments
+{
+	MODEST_DBUS_CLOSE_SEARCH_CURSOR_ARG_CURSOR,
+	MODEST_DBUS_CLOSE_SEARCH_CURSOR_ARGS_COUNT
+};
+
+/* Same arguments as Search, plus the key to sort the hits on (a
+ * ModestDBusSearchSortKey), whether to sort them in descending order and
+ * the maximum number of hits. Returns only the first hits in that order,
+ * sorted, as an array like Search. */
+#define MODEST_DBUS_METHOD_SEARCH_TOP "SearchTop"
+enum ModestDbusSearchTopArguments
+{
+	MODEST_DBUS_SEARCH_TOP_ARG_QUERY,
+	MODEST_DBUS_SEARCH_TOP_ARG_FOLDER,
+	MODEST_DBUS_SEARCH_TOP_ARG_START_DATE,
+	MODEST_DBUS_SEARCH_TOP_ARG_END_DATE,
+	MODEST_DBUS_SEARCH_TOP_ARG_FLAGS,
+	MODEST_DBUS_SEARCH_TOP_ARG_MIN_SIZE,
+	MODEST_DBUS_SEARCH_TOP_ARG_SORT_KEY,
+	MODEST_DBUS_SEARCH_TOP_ARG_DESCENDING,
+	MODEST_DBUS_SEARCH_TOP_ARG_MAX_HITS,
+	MODEST_DBUS_SEARCH_TOP_ARGS_COUNT
+};
+
+/* Same arguments as Search, plus a mask of ModestDBusSearchFields. Returns
+ * the hits as columns, one array per field in the mask in the order of
+ * the search hit struct, all of the same length: for instance "asax" for
+ * the msgid and the timestamp. */
+#define MODEST_DBUS_METHOD_SEARCH_FIELDS "SearchFields"
+enum ModestDbusSearchFieldsArguments
+{
+	MODEST_DBUS_SEARCH_FIELDS_ARG_QUERY,
+	MODEST_DBUS_SEARCH_FIELDS_ARG_FOLDER,
+	MODEST_DBUS_SEARCH_FIELDS_ARG_START_DATE,
+	MODEST_DBUS_SEARCH_FIELDS_ARG_END_DATE,
+	MODEST_DBUS_SEARCH_FIELDS_ARG_FLAGS,
+	MODEST_DBUS_SEARCH_FIELDS_ARG_MIN_SIZE,
+	MODEST_DBUS_SEARCH_FIELDS_ARG_FIELDS,
+	MODEST_DBUS_SEARCH_FIELDS_ARGS_COUNT
+};
+
+/* Asks modest to stop working on a call it has not answered yet. The
+ * call is identified by the serial of the method call message, from the
+ * same sender. Sent without expecting a reply. SearchStream is answered
+ * once the search starts: use CancelSearchStream to stop the search. */
+#define MODEST_DBUS_METHOD_CANCEL_REQUEST "CancelRequest"
+enum ModestDbusCancelRequestArguments
+{
+	MODEST_DBUS_CANCEL_REQUEST_ARG_SERIAL,
+	MODEST_DBUS_CANCEL_REQUEST_ARGS_COUNT
+};
+
 /** This is an undocumented hildon-desktop method that is 
  * sent to applications when they are started from the menu,
  * but not when started from D-Bus activation, so that 
@@ -165,4 +286,15 @@ enum ModestDbusSignalMsgReadChangedArguments
 	MODEST_DBUS_SIGNAL_MSG_READ_CHANGED_ARGS_COUNT
 };
 
+/* signal sent to the caller of SearchStream (it is not broadcast) with
+ * a chunk of hits; the last chunk of a search has finished set to TRUE */
+#define MODEST_DBUS_SIGNAL_SEARCH_HITS "search_hits"
+enum ModestDbusSignalSearchHitsArguments
+{
+	MODEST_DBUS_SIGNAL_SEARCH_HITS_ARG_SEARCH_ID,
+	MODEST_DBUS_SIGNAL_SEARCH_HITS_ARG_HITS,
+	MODEST_DBUS_SIGNAL_SEARCH_HITS_ARG_FINISHED,
+	MODEST_DBUS_SIGNAL_SEARCH_HITS_ARGS_COUNT
+};
+
 #endif /* __MODEST_DBUS_API__ */
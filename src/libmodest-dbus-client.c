@@ -27,14 +27,27 @@
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
 #include "libmodest-dbus-client.h"
 #include "libmodest-dbus-api.h" /* For the API strings. */
+#include "libmodest-dbus-probes.h"
+#include "libmodest-dbus-private.h"
+#include "libmodest-dbus-marshal.h"
 
 //#define DBUS_API_SUBJECT_TO_CHANGE 1
 #include <dbus/dbus.h>
 #include <dbus/dbus-glib-lowlevel.h>
+#include <errno.h>
 #include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
 
+/* Use a long timeout (2 minutes) because the search currently
+ * gets folders and messages from the servers. */
+#define MODEST_DBUS_LONG_TIMEOUT 120000 /* milliseconds */
 
 
 /** Get a comma-separated list of attachement URI strings, 
@@ -64,1317 +77,5594 @@ static gchar* get_attachments_string (GSList *attachments)
 	return attachments_str;
 }
 
-/**
- * libmodest_dbus_client_mail_to:
- * @osso_context: a valid #osso_context_t object.
- * @mailto_uri: A mailto URI.
- * 
- * This function will try to do a remote procedure call (rpc)
- * into modest (or start it if necessary) and open a composer
- * window with the supplied parameters prefilled.
- *
- * Return value: Whether or not the rpc call to modest
- * was successfull
- **/
-gboolean 
-libmodest_dbus_client_mail_to (osso_context_t *osso_context, const gchar *mailto_uri)
+/* The methods called through a #ModestDbusClient, used to index
+ * its per-method state. */
+typedef enum {
+	MODEST_DBUS_CLIENT_METHOD_NONE = -1,	/* a call that is not tracked */
+	MODEST_DBUS_CLIENT_METHOD_MAIL_TO,
+	MODEST_DBUS_CLIENT_METHOD_COMPOSE_MAIL,
+	MODEST_DBUS_CLIENT_METHOD_OPEN_MESSAGE,
+	MODEST_DBUS_CLIENT_METHOD_SEND_RECEIVE,
+	MODEST_DBUS_CLIENT_METHOD_SEND_RECEIVE_FULL,
+	MODEST_DBUS_CLIENT_METHOD_UPDATE_FOLDER_COUNTS,
+	MODEST_DBUS_CLIENT_METHOD_OPEN_DEFAULT_INBOX,
+	MODEST_DBUS_CLIENT_METHOD_OPEN_ACCOUNT,
+	MODEST_DBUS_CLIENT_METHOD_OPEN_EDIT_ACCOUNTS_DIALOG,
+	MODEST_DBUS_CLIENT_METHOD_DELETE_MESSAGE,
+	MODEST_DBUS_CLIENT_METHOD_DELETE_MESSAGES,
+	MODEST_DBUS_CLIENT_METHOD_SEARCH,
+	MODEST_DBUS_CLIENT_METHOD_SEARCH_STREAM,
+	MODEST_DBUS_CLIENT_METHOD_GET_UNREAD_MESSAGES,
+	MODEST_DBUS_CLIENT_METHOD_GET_FOLDERS,
+	MODEST_DBUS_CLIENT_METHOD_CANCEL_REQUEST,
+	MODEST_DBUS_CLIENT_METHOD_SEARCH_PAGED,
+	MODEST_DBUS_CLIENT_METHOD_SEARCH_NEXT_PAGE,
+	MODEST_DBUS_CLIENT_METHOD_CLOSE_SEARCH_CURSOR,
+	MODEST_DBUS_CLIENT_METHOD_SEARCH_TOP,
+	MODEST_DBUS_CLIENT_METHOD_SEARCH_FIELDS,
+	MODEST_DBUS_CLIENT_METHOD_CANCEL_SEARCH_STREAM,
+	MODEST_DBUS_CLIENT_N_METHODS
+} ModestDbusClientMethod;
+
+static const gchar *const method_names[MODEST_DBUS_CLIENT_N_METHODS] = {
+	MODEST_DBUS_METHOD_MAIL_TO,
+	MODEST_DBUS_METHOD_COMPOSE_MAIL,
+	MODEST_DBUS_METHOD_OPEN_MESSAGE,
+	MODEST_DBUS_METHOD_SEND_RECEIVE,
+	MODEST_DBUS_METHOD_SEND_RECEIVE_FULL,
+	MODEST_DBUS_METHOD_UPDATE_FOLDER_COUNTS,
+	MODEST_DBUS_METHOD_OPEN_DEFAULT_INBOX,
+	MODEST_DBUS_METHOD_OPEN_ACCOUNT,
+	MODEST_DBUS_METHOD_OPEN_EDIT_ACCOUNTS_DIALOG,
+	MODEST_DBUS_METHOD_DELETE_MESSAGE,
+	MODEST_DBUS_METHOD_DELETE_MESSAGES,
+	MODEST_DBUS_METHOD_SEARCH,
+	MODEST_DBUS_METHOD_SEARCH_STREAM,
+	MODEST_DBUS_METHOD_GET_UNREAD_MESSAGES,
+	MODEST_DBUS_METHOD_GET_FOLDERS,
+	MODEST_DBUS_METHOD_CANCEL_REQUEST,
+	MODEST_DBUS_METHOD_SEARCH_PAGED,
+	MODEST_DBUS_METHOD_SEARCH_NEXT_PAGE,
+	MODEST_DBUS_METHOD_CLOSE_SEARCH_CURSOR,
+	MODEST_DBUS_METHOD_SEARCH_TOP,
+	MODEST_DBUS_METHOD_SEARCH_FIELDS,
+	MODEST_DBUS_METHOD_CANCEL_SEARCH_STREAM
+};
+
+/* What we know about the owner of MODEST_DBUS_SERVICE */
+typedef enum {
+	MODEST_DBUS_OWNER_UNKNOWN,
+	MODEST_DBUS_OWNER_RUNNING,
+	MODEST_DBUS_OWNER_NOT_RUNNING
+} ModestDbusOwnerState;
+
+#define MODEST_DBUS_OWNER_CHANGED_RULE					\
+	"type='signal',sender='" DBUS_SERVICE_DBUS "',"			\
+	"interface='" DBUS_INTERFACE_DBUS "',member='NameOwnerChanged',"	\
+	"arg0='" MODEST_DBUS_SERVICE "'"
+
+/* Match rule for the modest signal @member */
+#define MODEST_DBUS_SIGNAL_RULE(member)					\
+	"type='signal',sender='" MODEST_DBUS_SERVICE "',"		\
+	"interface='" MODEST_DBUS_IFACE "',member='" member "'"
+
+#define MODEST_DBUS_LATENCY_WINDOW 32
+#define MODEST_DBUS_ADAPTIVE_MIN_SAMPLES 8
+#define MODEST_DBUS_ADAPTIVE_FACTOR 4
+#define MODEST_DBUS_ADAPTIVE_MIN_TIMEOUT 2000 /* milliseconds */
+#define MODEST_DBUS_DEFAULT_TIMEOUT 25000 /* the one of libdbus, in milliseconds */
+
+typedef struct {
+	gint            timeout;	/* -1 for the default one */
+
+	/* The latencies of the last calls, in milliseconds */
+	guint           latencies[MODEST_DBUS_LATENCY_WINDOW];
+	guint           n_latencies;
+	guint           next_latency;
+
+	/* Statistics, under the stats_lock of the client so that they can
+	 * be read from any thread. 64 bits, as a gsize would wrap on 32-bit
+	 * devices after 4 GiB of results; GLib has no 64-bit atomics. */
+	guint64         calls;
+	guint64         failures;
+	guint64         timeouts;
+	guint64         result_bytes;
+	guint64         items_decoded;
+	guint64         latency_buckets[MODEST_DBUS_CLIENT_LATENCY_BUCKETS];
+} ModestDbusMethodState;
+
+/* An entry of the event log. Writers claim an entry by incrementing
+ * next_event, and publish it by setting seq to their ticket plus one:
+ * a reader only trusts the entry if seq is the same before and after
+ * copying it. */
+typedef struct {
+	volatile guint  seq;		/* 0 while being written */
+	gint            method;
+	gint            result;
+	guint32         serial;
+	gint64          time;
+	gint64          duration;
+} ModestDbusEventEntry;
+
+struct _ModestDbusClient {
+	gint            ref_count;
+
+	/* Not referenced, as the connection owns the client. Set to
+	 * %NULL when the connection goes away. */
+	DBusConnection *connection;
+	gint            rpc_timeout;
+
+	/* The unique name of modest, learned from its replies and from
+	 * NameOwnerChanged, or %NULL */
+	gchar          *owner;
+	ModestDbusOwnerState owner_state;
+
+	/* Fail calls instead of starting modest */
+	gboolean        only_if_running;
+
+	/* How the sets store their repeated strings */
+	ModestDbusInternMode intern_mode;
+
+	/* Method calls with their header filled in, copied for every call */
+	DBusMessage    *templates[MODEST_DBUS_CLIENT_N_METHODS];
+
+	ModestDbusMethodState methods[MODEST_DBUS_CLIENT_N_METHODS];
+	GMutex          stats_lock;
+	gboolean        adaptive_timeouts;
+
+	/* Match rules added to the bus -> number of users */
+	GHashTable     *matches;
+
+	/* The last result of GetFolders, if cache_folders is set. The
+	 * generation changes whenever the list becomes stale, so that a
+	 * reply to a call started before is not cached. */
+	gboolean        cache_folders;
+	gboolean        have_folders;
+	GList          *folders;
+	guint           folders_generation;
+
+	/* The ModestUnreadModels following this client, not referenced */
+	GList          *unread_models;
+
+	/* ModestDbusSubscriptions to the signals of modest */
+	GHookList       subscriptions;
+
+	/* Requests waiting for their coalescing window to end, by key */
+	guint           coalesce_window;
+	GHashTable     *coalesced;
+
+	/* The last calls, as a ring buffer; see ModestDbusEventEntry */
+	volatile guint  next_event;
+	ModestDbusEventEntry events[MODEST_DBUS_CLIENT_EVENT_LOG_SIZE];
+};
+
+typedef struct {
+	GHook             hook;	/* func is the callback of the subscriber */
+	ModestDbusClient *client;
+	const gchar      *member;
+	gchar            *account_id;	/* or %NULL for all the accounts */
+	gchar            *rule;
+} ModestDbusSubscription;
+
+static dbus_int32_t client_slot = -1;
+
+static DBusHandlerResult modest_dbus_client_filter (DBusConnection *con,
+						    DBusMessage    *message,
+						    void           *user_data);
+
+static void modest_dbus_client_end_search_streams (ModestDbusClient *client);
+
+GQuark
+libmodest_dbus_client_error_quark (void)
 {
-	osso_rpc_t retval = { 0 };
-	const osso_return_t ret = osso_rpc_run_with_defaults(osso_context, 
-		   MODEST_DBUS_NAME, 
-		   MODEST_DBUS_METHOD_MAIL_TO, &retval, 
-		   DBUS_TYPE_STRING, mailto_uri, 
-		   DBUS_TYPE_INVALID);
-		
-	if (ret != OSSO_OK) {
-		printf("debug: %s: osso_rpc_run() failed.\n", __FUNCTION__);
-		return FALSE;
-	} else {
-		printf("debug: %s: osso_rpc_run() succeeded.\n", __FUNCTION__);
-	}
-	
-	osso_rpc_free_val(&retval);
-	
-	return TRUE;
+	return g_quark_from_static_string ("libmodest-dbus-client-error-quark");
 }
 
-/**
- * libmodest_dbus_client_compose_mail:
- * @osso_context: a valid #osso_context_t object.
- * @to: The Recipients (From: line)
- * @cc: Recipients for carbon copies
- * @bcc: Recipients for blind carbon copies
- * @subject: Subject line
- * @body: The actual body of the mail to compose.
- * @attachments: Additional list of attachments. A list of URI strings.
- * 
- * This function will try to do a remote procedure call (rpc)
- * into modest (or start it if necessary) and open a composer
- * window with the supplied parameters prefilled.
- *
- * Return value: Whether or not the rpc call to modest
- * was successfull
- **/
-gboolean
-libmodest_dbus_client_compose_mail (osso_context_t *osso_context, const gchar *to, const gchar *cc, 
-	const gchar *bcc, const gchar* subject, const gchar* body, GSList *attachments)
+static void
+modest_dbus_client_drop_templates (ModestDbusClient *client)
 {
-	osso_rpc_t retval = { 0 };
-
-	gchar *attachments_str = get_attachments_string(attachments);
-
-	const osso_return_t ret = osso_rpc_run_with_defaults(osso_context,
-		   MODEST_DBUS_NAME, 
-		   MODEST_DBUS_METHOD_COMPOSE_MAIL, &retval, 
-		   DBUS_TYPE_STRING, to, 
-		   DBUS_TYPE_STRING, cc, 
-		   DBUS_TYPE_STRING, bcc, 
-		   DBUS_TYPE_STRING, subject, 
-		   DBUS_TYPE_STRING, body,
-		   DBUS_TYPE_STRING, attachments_str,
-		   DBUS_TYPE_INVALID);
+	guint i;
 
-	g_free (attachments_str);
-
-	if (ret != OSSO_OK) {
-		printf("debug: %s: osso_rpc_run() failed.\n", __FUNCTION__);
-		return FALSE;
-	} else {
-		printf("debug: %s: osso_rpc_run() succeeded.\n", __FUNCTION__);
+	for (i = 0; i < MODEST_DBUS_CLIENT_N_METHODS; i++) {
+		if (client->templates[i]) {
+			dbus_message_unref (client->templates[i]);
+			client->templates[i] = NULL;
+		}
 	}
-
-	osso_rpc_free_val(&retval);
-
-
-	return TRUE;
 }
 
-/**
- * libmodest_dbus_client_open_message:
- * @osso_context: a valid #osso_context_t object.
- * @msg_uri: A valid url to a mail
- *
- * This method will try to find the message supplied
- * by @msg_uri and open it for display if found. 
- * It will use remote procedure calls (rpc) over 
- * dbus to do so.
- *  
- * Return value: TRUE on successs, FALSE on error
- **/
-gboolean 
-libmodest_dbus_client_open_message (osso_context_t *osso_context, const gchar *mail_uri)
+static void
+modest_dbus_client_drop_folders (ModestDbusClient *client)
 {
-	osso_rpc_t retval = { 0 };
-	const osso_return_t ret = osso_rpc_run_with_defaults(osso_context, 
-		   MODEST_DBUS_NAME, 
-		   MODEST_DBUS_METHOD_OPEN_MESSAGE, &retval, 
-		   DBUS_TYPE_STRING, mail_uri, 
-		   DBUS_TYPE_INVALID);
-		
-	if (ret != OSSO_OK) {
-		printf("debug: %s: osso_rpc_run() failed.\n", __FUNCTION__);
-		return FALSE;
-	} else {
-		printf("debug: %s: osso_rpc_run() succeeded.\n", __FUNCTION__);
-	}
-	
-	osso_rpc_free_val(&retval);
-	
-	return TRUE;
+	modest_folder_result_list_free (client->folders);
+	client->folders = NULL;
+	client->have_folders = FALSE;
 }
 
-gboolean 
-libmodest_dbus_client_send_and_receive (osso_context_t *osso_context)
+static void
+modest_dbus_client_invalidate_folders (ModestDbusClient *client)
 {
-	osso_rpc_t retval = { 0 };
-	const osso_return_t ret = osso_rpc_run_with_defaults(osso_context, 
-		   MODEST_DBUS_NAME, 
-		   MODEST_DBUS_METHOD_SEND_RECEIVE, &retval, 
-		   DBUS_TYPE_INVALID);
-		
-	if (ret != OSSO_OK) {
-		printf("debug: %s: osso_rpc_run() failed.\n", __FUNCTION__);
-		return FALSE;
-	} else {
-		printf("debug: %s: osso_rpc_run() succeeded.\n", __FUNCTION__);
-	}
-	
-	osso_rpc_free_val(&retval);
-	
-	return TRUE;
+	modest_dbus_client_drop_folders (client);
+	client->folders_generation++;
 }
 
-gboolean 
-libmodest_dbus_client_send_and_receive_full (osso_context_t *osso_context, 
-					     const gchar *account, 
-					     gboolean manual)
+/* Adds @rule to the bus unless another user of @client did already */
+static void
+modest_dbus_client_add_match (ModestDbusClient *client, const gchar *rule)
 {
-	osso_rpc_t retval = { 0 };
-	const osso_return_t ret = osso_rpc_run_with_defaults(osso_context, 
-							     MODEST_DBUS_NAME,
-							     MODEST_DBUS_METHOD_SEND_RECEIVE_FULL, &retval,
-							     DBUS_TYPE_STRING, account,
-							     DBUS_TYPE_BOOLEAN, manual,
-							     DBUS_TYPE_INVALID);
-		
-	if (ret != OSSO_OK) {
-		printf("debug: %s: osso_rpc_run() failed.\n", __FUNCTION__);
-		return FALSE;
-	} else {
-		printf("debug: %s: osso_rpc_run() succeeded.\n", __FUNCTION__);
+	guint users;
+
+	if (client->matches == NULL) {
+		client->matches = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
 	}
-	
-	osso_rpc_free_val(&retval);
-	
-	return TRUE;
-}
 
-gboolean 
-libmodest_dbus_client_update_folder_counts (osso_context_t *osso_context, 
-					    const gchar *account)
-{
-	osso_rpc_t retval = { 0 };
-	const osso_return_t ret = osso_rpc_run_with_defaults(osso_context, 
-							     MODEST_DBUS_NAME,
-							     MODEST_DBUS_METHOD_UPDATE_FOLDER_COUNTS, &retval,
-							     DBUS_TYPE_STRING, account,
-							     DBUS_TYPE_INVALID);
-		
-	if (ret != OSSO_OK) {
-		printf("debug: %s: osso_rpc_run() failed.\n", __FUNCTION__);
-		return FALSE;
-	} else {
-		printf("debug: %s: osso_rpc_run() succeeded.\n", __FUNCTION__);
+	users = GPOINTER_TO_UINT (g_hash_table_lookup (client->matches, rule));
+
+	/* Without a DBusError, this does not wait for the bus to reply */
+	if (users == 0 && client->connection) {
+		dbus_bus_add_match (client->connection, rule, NULL);
 	}
-	
-	osso_rpc_free_val(&retval);
-	
-	return TRUE;
+
+	g_hash_table_insert (client->matches, g_strdup (rule), GUINT_TO_POINTER (users + 1));
 }
 
-gboolean 
-libmodest_dbus_client_open_default_inbox (osso_context_t *osso_context)
+static void
+modest_dbus_client_remove_match (ModestDbusClient *client, const gchar *rule)
 {
-	osso_rpc_t retval = { 0 };
-	const osso_return_t ret = osso_rpc_run_with_defaults(osso_context, 
-		   MODEST_DBUS_NAME, 
-		   MODEST_DBUS_METHOD_OPEN_DEFAULT_INBOX, &retval, 
-		   DBUS_TYPE_INVALID);
-		
-	if (ret != OSSO_OK) {
-		printf("debug: %s: osso_rpc_run() failed.\n", __FUNCTION__);
-		return FALSE;
-	} else {
-		printf("debug: %s: osso_rpc_run() succeeded.\n", __FUNCTION__);
+	guint users;
+
+	users = client->matches ?
+		GPOINTER_TO_UINT (g_hash_table_lookup (client->matches, rule)) : 0;
+
+	if (users == 0) {
+		return;
 	}
-	
-	osso_rpc_free_val(&retval);
-	
-	return TRUE;
-}
 
-gboolean
-libmodest_dbus_client_open_account (osso_context_t *osso_context,
-				    const gchar *account_id)
-{
-	osso_rpc_t retval = { 0 };
-	const osso_return_t ret =
-		osso_rpc_run_with_defaults(osso_context,
-					   MODEST_DBUS_NAME,
-					   MODEST_DBUS_METHOD_OPEN_ACCOUNT, &retval,
-					   DBUS_TYPE_STRING, account_id,
-					   DBUS_TYPE_INVALID);
+	if (users > 1) {
+		g_hash_table_insert (client->matches, g_strdup (rule),
+				     GUINT_TO_POINTER (users - 1));
+		return;
+	}
 
-	if (ret != OSSO_OK) {
-		printf("debug: %s: osso_rpc_run() failed.\n", __FUNCTION__);
-		return FALSE;
-	} else {
-		printf("debug: %s: osso_rpc_run() succeeded.\n", __FUNCTION__);
+	g_hash_table_remove (client->matches, rule);
+
+	if (client->connection) {
+		dbus_bus_remove_match (client->connection, rule, NULL);
 	}
+}
+
+static void
+modest_dbus_subscription_finalize (GHookList *hook_list, GHook *hook)
+{
+	ModestDbusSubscription *sub = (ModestDbusSubscription *) hook;
 
-	osso_rpc_free_val(&retval);
+	modest_dbus_client_remove_match (sub->client, sub->rule);
+	g_free (sub->account_id);
+	g_free (sub->rule);
 
-	return TRUE;
+	if (hook->destroy) {
+		hook->destroy (hook->data);
+	}
 }
 
-gboolean
-libmodest_dbus_client_open_edit_accounts_dialog (osso_context_t *osso_context)
+/* @owner is the unique name of modest, or %NULL if it is not known */
+static void
+modest_dbus_client_set_owner (ModestDbusClient *client, const gchar *owner,
+			      ModestDbusOwnerState state)
 {
-	osso_rpc_t retval = { 0 };
-	const osso_return_t ret =
-		osso_rpc_run_with_defaults(osso_context,
-					   MODEST_DBUS_NAME,
-					   MODEST_DBUS_METHOD_OPEN_EDIT_ACCOUNTS_DIALOG, &retval,
-					   DBUS_TYPE_INVALID);
+	client->owner_state = state;
 
-	if (ret != OSSO_OK) {
-		printf("debug: %s: osso_rpc_run() failed.\n", __FUNCTION__);
-		return FALSE;
-	} else {
-		printf("debug: %s: osso_rpc_run() succeeded.\n", __FUNCTION__);
+	if (g_strcmp0 (client->owner, owner) == 0) {
+		return;
+	}
+
+	/* What a previous modest told us may no longer hold */
+	if (client->owner) {
+		modest_dbus_client_invalidate_folders (client);
 	}
 
-	osso_rpc_free_val(&retval);
+	g_free (client->owner);
+	client->owner = g_strdup (owner);
 
-	return TRUE;
+	/* The templates are addressed to the previous owner */
+	modest_dbus_client_drop_templates (client);
 }
 
 /**
- * libmodest_dbus_client_delete_message:
- * @osso_context: a valid #osso_context_t object.
- * @msg_uri: A valid url to a mail 
+ * libmodest_dbus_client_ref:
+ * @client: a #ModestDbusClient
  *
- * This method will try to find the message supplied
- * by @msg_uri and if found delete it. It will use
- * remote procedure calls (rpc) over dbus to do so.
- * 
- * Return value: TRUE on successs, FALSE on error
+ * Return value: @client
  **/
-gboolean
-libmodest_dbus_client_delete_message (osso_context_t   *osso_ctx,
-				      const char       *msg_uri)
+ModestDbusClient *
+libmodest_dbus_client_ref (ModestDbusClient *client)
 {
-	osso_rpc_t    retval = { 0 };
-	osso_return_t ret;
-       
-	ret = osso_rpc_run_with_defaults (osso_ctx, 
-					  MODEST_DBUS_NAME, 
-					  MODEST_DBUS_METHOD_DELETE_MESSAGE, &retval, 
-					  DBUS_TYPE_STRING, msg_uri, 
-					  DBUS_TYPE_INVALID);
-		
-	if (ret != OSSO_OK) {
-		g_debug ("debug: osso_rpc_run() failed.\n");
-	} else {
-		g_debug ("debug: osso_rpc_run() succeeded.\n");
-	}
-	
-	osso_rpc_free_val (&retval);
+	g_return_val_if_fail (client != NULL, NULL);
 
-	return ret == OSSO_OK;
-}
+	g_atomic_int_inc (&client->ref_count);
 
-static void
-modest_search_hit_free (ModestSearchHit *hit)
-{
-	g_free (hit->msgid);
-	g_slice_free (ModestSearchHit, hit);
+	return client;
 }
 
+/**
+ * libmodest_dbus_client_unref:
+ * @client: a #ModestDbusClient
+ *
+ * Drops a reference to @client.
+ **/
 void
-modest_search_hit_list_free (GList *hits)
+libmodest_dbus_client_unref (ModestDbusClient *client)
 {
-	GList *iter;
+	g_return_if_fail (client != NULL);
 
-	if (hits == NULL) {
+	if (!g_atomic_int_dec_and_test (&client->ref_count)) {
 		return;
 	}
 
-	for (iter = hits; iter; iter = iter->next) {
-		modest_search_hit_free ((ModestSearchHit *) iter->data);
+	modest_dbus_client_drop_templates (client);
+	modest_dbus_client_drop_folders (client);
+	g_hook_list_clear (&client->subscriptions);
+	/* Empty, as the requests held back keep the client alive */
+	if (client->coalesced) {
+		g_hash_table_destroy (client->coalesced);
+	}
+	if (client->matches) {
+		g_hash_table_destroy (client->matches);
 	}
+	g_free (client->owner);
+	g_mutex_clear (&client->stats_lock);
+	g_slice_free (ModestDbusClient, client);
+}
+
+/* Called when the connection owning @client is finalized */
+static void
+modest_dbus_client_detach (void *data)
+{
+	ModestDbusClient *client = data;
 
-	g_list_free (hits);
+	client->connection = NULL;
+	libmodest_dbus_client_unref (client);
 }
 
 static void
-modest_account_hits_hits_list_free (GList *account_hits_hits_list)
+on_get_name_owner_reply (DBusPendingCall *pending, void *user_data)
 {
-	GList *iter;
+	ModestDbusClient *client = user_data;
+	DBusMessage *reply;
+	const gchar *owner = NULL;
+
+	reply = dbus_pending_call_steal_reply (pending);
 
-	if (account_hits_hits_list == NULL) {
+	if (reply == NULL) {
 		return;
 	}
 
-	for (iter = account_hits_hits_list; iter; iter = iter->next) {
-		ModestGetUnreadMessagesHit *hit = (ModestGetUnreadMessagesHit *) iter->data;
-		g_free (hit->subject);
-		g_slice_free (ModestGetUnreadMessagesHit, hit);
+	/* NameOwnerChanged or a reply from modest may have told us already */
+	if (client->owner_state == MODEST_DBUS_OWNER_UNKNOWN) {
+		if (dbus_message_get_type (reply) == DBUS_MESSAGE_TYPE_METHOD_RETURN &&
+		    dbus_message_get_args (reply, NULL,
+					   DBUS_TYPE_STRING, &owner,
+					   DBUS_TYPE_INVALID)) {
+			modest_dbus_client_set_owner (client, owner, MODEST_DBUS_OWNER_RUNNING);
+		} else if (dbus_message_is_error (reply, DBUS_ERROR_NAME_HAS_NO_OWNER)) {
+			modest_dbus_client_set_owner (client, NULL, MODEST_DBUS_OWNER_NOT_RUNNING);
+		}
 	}
 
-	g_list_free (account_hits_hits_list);
+	dbus_message_unref (reply);
 }
 
+/* Starts following the owner of MODEST_DBUS_SERVICE, without blocking */
 static void
-modest_account_hits_free (ModestAccountHits *account_hits)
+modest_dbus_client_watch_owner (ModestDbusClient *client)
 {
-	g_free (account_hits->account_id);
-	g_free (account_hits->account_name);
-	g_free (account_hits->store_protocol);
-	modest_account_hits_hits_list_free (account_hits->hits);
-	g_slice_free (ModestAccountHits, account_hits);
-}
+	DBusMessage *msg;
+	DBusPendingCall *pending = NULL;
+	const gchar *name = MODEST_DBUS_SERVICE;
 
-void
-modest_account_hits_list_free (GList *account_hits_list)
-{
-	GList *iter;
+	/* Without a DBusError, this does not wait for the bus to reply */
+	dbus_bus_add_match (client->connection, MODEST_DBUS_OWNER_CHANGED_RULE, NULL);
+
+	msg = dbus_message_new_method_call (DBUS_SERVICE_DBUS, DBUS_PATH_DBUS,
+					    DBUS_INTERFACE_DBUS, "GetNameOwner");
 
-	if (account_hits_list == NULL) {
+	if (msg == NULL) {
 		return;
 	}
 
-	for (iter = account_hits_list; iter; iter = iter->next) {
-		modest_account_hits_free ((ModestAccountHits *) iter->data);
+	if (dbus_message_append_args (msg, DBUS_TYPE_STRING, &name, DBUS_TYPE_INVALID) &&
+	    dbus_connection_send_with_reply (client->connection, msg, &pending, -1) &&
+	    pending != NULL) {
+		dbus_pending_call_set_notify (pending, on_get_name_owner_reply,
+					      libmodest_dbus_client_ref (client),
+					      (DBusFreeFunction) libmodest_dbus_client_unref);
+		dbus_pending_call_unref (pending);
 	}
 
-	g_list_free (account_hits_list);
+	dbus_message_unref (msg);
 }
 
-static char *
-_dbus_iter_get_string_or_null (DBusMessageIter *iter)
+/* Called by the connection filter for every signal. Returns %TRUE if
+ * modest was started. */
+static gboolean
+modest_dbus_client_owner_changed (ModestDbusClient *client, DBusMessage *message)
 {
-	const char *string = NULL;
-	char       *ret = NULL;
+	const gchar *name;
+	const gchar *old_owner;
+	const gchar *new_owner;
+
+	if (!dbus_message_is_signal (message, DBUS_INTERFACE_DBUS, "NameOwnerChanged") ||
+	    !dbus_message_has_sender (message, DBUS_SERVICE_DBUS) ||
+	    !dbus_message_get_args (message, NULL,
+				    DBUS_TYPE_STRING, &name,
+				    DBUS_TYPE_STRING, &old_owner,
+				    DBUS_TYPE_STRING, &new_owner,
+				    DBUS_TYPE_INVALID) ||
+	    strcmp (name, MODEST_DBUS_SERVICE) != 0) {
+		return FALSE;
+	}
+
+	/* The modest that was streaming search hits to us is gone */
+	if (old_owner[0] != '\0') {
+		modest_dbus_client_end_search_streams (client);
+	}
 
-	dbus_message_iter_get_basic (iter, &string);
-	
-	if (string && strlen (string)) {
-		ret = g_strdup (string);
+	if (new_owner[0] == '\0') {
+		modest_dbus_client_set_owner (client, NULL, MODEST_DBUS_OWNER_NOT_RUNNING);
+		return FALSE;
 	}
 
-	return ret;
+	modest_dbus_client_set_owner (client, new_owner, MODEST_DBUS_OWNER_RUNNING);
+
+	return TRUE;
 }
 
-static guint64
-_dbus_iter_get_uint64 (DBusMessageIter *iter)
+/**
+ * libmodest_dbus_client_is_running:
+ * @client: a #ModestDbusClient
+ *
+ * Tells whether modest is running, from the state the client keeps by
+ * watching the bus. This does not talk to modest, and only asks the bus
+ * the first time, if the client has not learned the state yet.
+ *
+ * Return value: TRUE if modest is running, FALSE otherwise
+ **/
+gboolean
+libmodest_dbus_client_is_running (ModestDbusClient *client)
 {
-	dbus_uint64_t ui64v;
-	guint64       ret;
+	DBusError err;
+	dbus_bool_t has_owner;
 
-	ui64v = 0;
-	dbus_message_iter_get_basic (iter, &ui64v);
+	g_return_val_if_fail (client != NULL, FALSE);
 
-	ret = (guint64) ui64v;
+	if (client->owner_state == MODEST_DBUS_OWNER_UNKNOWN && client->connection) {
+		dbus_error_init (&err);
+		has_owner = dbus_bus_name_has_owner (client->connection, MODEST_DBUS_SERVICE, &err);
 
-	return ret;
-}
+		if (dbus_error_is_set (&err)) {
+			g_debug ("%s: %s", __FUNCTION__, err.message);
+			dbus_error_free (&err);
+			return FALSE;
+		}
+
+		/* The unique name is learned later */
+		client->owner_state = has_owner ?
+			MODEST_DBUS_OWNER_RUNNING : MODEST_DBUS_OWNER_NOT_RUNNING;
+	}
 
+	return client->owner_state == MODEST_DBUS_OWNER_RUNNING;
+}
 
-static gint64
-_dbus_iter_get_int64 (DBusMessageIter *iter)
+/**
+ * libmodest_dbus_client_set_only_if_running:
+ * @client: a #ModestDbusClient
+ * @only_if_running: whether calls may start modest
+ *
+ * By default, calling modest starts it if it is not running. If
+ * @only_if_running is %TRUE, calls made through @client do not start
+ * modest: while it is not running they fail at once, the asynchronous
+ * ones with %MODEST_DBUS_CLIENT_ERROR_NOT_RUNNING. This is meant for
+ * background queries, such as the ones of home screen widgets.
+ *
+ * This applies to all the users of the D-Bus connection of @client.
+ **/
+void
+libmodest_dbus_client_set_only_if_running (ModestDbusClient *client,
+					   gboolean          only_if_running)
 {
-	dbus_int64_t i64v;
-	gint64       ret;
+	g_return_if_fail (client != NULL);
 
-	i64v = 0;
-	dbus_message_iter_get_basic (iter, &i64v);
+	only_if_running = only_if_running ? TRUE : FALSE;
+
+	if (client->only_if_running == only_if_running) {
+		return;
+	}
 
-	ret = (gint64) i64v;
+	client->only_if_running = only_if_running;
 
-	return ret;
+	/* Their auto start flag is out of date */
+	modest_dbus_client_drop_templates (client);
 }
 
+/* Fails with MODEST_DBUS_CLIENT_ERROR_NOT_RUNNING if modest must not be
+ * started and is not running. */
 static gboolean
-_dbus_iter_get_boolean (DBusMessageIter *iter)
-
+modest_dbus_client_check_running (ModestDbusClient *client, GError **error)
 {
-	dbus_bool_t  val;
-	gboolean     ret;
-
-	val = FALSE;
-	dbus_message_iter_get_basic (iter, &val);
+	if (!client->only_if_running || libmodest_dbus_client_is_running (client)) {
+		return TRUE;
+	}
 
-	ret = (gboolean) val;
+	g_set_error_literal (error, MODEST_DBUS_CLIENT_ERROR,
+			     MODEST_DBUS_CLIENT_ERROR_NOT_RUNNING,
+			     "modest is not running");
 
-	return ret;
+	return FALSE;
 }
 
-/** Get the values from the complex type (SEARCH_HIT_DBUS_TYPE)
- * in the D-Bus return message. */
-static ModestSearchHit *
-modest_dbus_message_iter_get_search_hit (DBusMessageIter *parent)
+/* Gets the client of the D-Bus connection of @osso_ctx, creating it
+ * the first time. The returned client is owned by the connection. */
+static ModestDbusClient *
+modest_dbus_client_get (osso_context_t *osso_ctx)
 {
-	ModestSearchHit *hit;
-	DBusMessageIter  child;
-	dbus_bool_t      res;
-	int              arg_type;
-	gboolean         error;
-
-	error = FALSE;
-	hit = g_slice_new0 (ModestSearchHit);
+	ModestDbusClient *client;
+	DBusConnection *con;
+	guint i;
 
-	arg_type = dbus_message_iter_get_arg_type (parent);
+	con = osso_get_dbus_connection (osso_ctx);
 
-	if (arg_type != 'r') {
+	if (con == NULL) {
+		g_warning ("Could not get dbus connection\n");
 		return NULL;
 	}
 
-	dbus_message_iter_recurse (parent, &child);
-	
-	/* msgid  */
-	arg_type = dbus_message_iter_get_arg_type (&child);
-
-	if (arg_type != DBUS_TYPE_STRING) {
-		error = TRUE;
-		goto out;
+	if (client_slot == -1 && !dbus_connection_allocate_data_slot (&client_slot)) {
+		return NULL;
 	}
 
-	hit->msgid = _dbus_iter_get_string_or_null (&child);
+	client = dbus_connection_get_data (con, client_slot);
 
-	res = dbus_message_iter_next (&child);
-	if (res == FALSE) {
-		error = TRUE;
-		goto out;
+	if (client != NULL) {
+		return client;
 	}
 
-	/* subject  */
-	arg_type = dbus_message_iter_get_arg_type (&child);
-
-	if (arg_type != DBUS_TYPE_STRING) {
-		error = TRUE;
-		goto out;
+	client = g_slice_new0 (ModestDbusClient);
+	client->ref_count = 1;
+	g_hook_list_init (&client->subscriptions, sizeof (ModestDbusSubscription));
+	client->subscriptions.finalize_hook = modest_dbus_subscription_finalize;
+	client->connection = con;
+	client->rpc_timeout = -1;
+	osso_rpc_get_timeout (osso_ctx, &client->rpc_timeout);
+	g_mutex_init (&client->stats_lock);
+
+	for (i = 0; i < MODEST_DBUS_CLIENT_N_METHODS; i++) {
+		client->methods[i].timeout = -1;
 	}
 
-	hit->subject = _dbus_iter_get_string_or_null (&child);
-
-	res = dbus_message_iter_next (&child);
-	if (res == FALSE) {
-		error = TRUE;
-		goto out;
+	if (!dbus_connection_add_filter (con, modest_dbus_client_filter, client, NULL)) {
+		libmodest_dbus_client_unref (client);
+		return NULL;
 	}
 
-	/* folder  */
-	arg_type = dbus_message_iter_get_arg_type (&child);
-
-	if (arg_type != DBUS_TYPE_STRING) {
-		error = TRUE;
-		goto out;
+	if (!dbus_connection_set_data (con, client_slot, client, modest_dbus_client_detach)) {
+		dbus_connection_remove_filter (con, modest_dbus_client_filter, client);
+		libmodest_dbus_client_unref (client);
+		return NULL;
 	}
 
-	hit->folder = _dbus_iter_get_string_or_null (&child);
+	modest_dbus_client_watch_owner (client);
 
-	res = dbus_message_iter_next (&child);
-	if (res == FALSE) {
-		error = TRUE;
-		goto out;
-	}
-
-	/* sender  */
-	arg_type = dbus_message_iter_get_arg_type (&child);
+	return client;
+}
 
-	if (arg_type != DBUS_TYPE_STRING) {
-		error = TRUE;
-		goto out;
-	}
+/**
+ * libmodest_dbus_client_new:
+ * @osso_context: a valid #osso_context_t object.
+ *
+ * Gets the client handle for the D-Bus connection of @osso_context. The
+ * handle caches the connection, the unique name of modest and prebuilt
+ * method calls; it is created once per connection and shared by all the
+ * libmodest_dbus_client functions using it. Keep a reference for as long
+ * as the handle is used.
+ *
+ * Return value: a new reference to the #ModestDbusClient, or %NULL on
+ * error. Release it with libmodest_dbus_client_unref().
+ **/
+ModestDbusClient *
+libmodest_dbus_client_new (osso_context_t *osso_context)
+{
+	ModestDbusClient *client;
 
-	hit->sender = _dbus_iter_get_string_or_null (&child);
+	client = modest_dbus_client_get (osso_context);
 
-	res = dbus_message_iter_next (&child);
-	if (res == FALSE) {
-		error = TRUE;
-		goto out;
-	}
+	return client ? libmodest_dbus_client_ref (client) : NULL;
+}
 
-	/* msize  */
-	arg_type = dbus_message_iter_get_arg_type (&child);
+/* Creates a call to @method, copying its prebuilt template. */
+static DBusMessage *
+modest_dbus_client_new_call (ModestDbusClient *client, ModestDbusClientMethod method)
+{
+	DBusMessage *template;
 
-	if (arg_type != DBUS_TYPE_UINT64) {
-		error = TRUE;
-		goto out;
+	if (client == NULL || client->connection == NULL) {
+		return NULL;
 	}
 
-	hit->msize = _dbus_iter_get_uint64 (&child);
-
-	res = dbus_message_iter_next (&child);
-	if (res == FALSE) {
-		error = TRUE;
-		goto out;
-	}
+	template = client->templates[method];
 
-	/* has_attachment  */
-	arg_type = dbus_message_iter_get_arg_type (&child);
+	if (template == NULL) {
+		template = dbus_message_new_method_call (client->owner ? client->owner : MODEST_DBUS_SERVICE,
+							 MODEST_DBUS_OBJECT,
+							 MODEST_DBUS_IFACE,
+							 method_names[method]);
+		if (template == NULL) {
+			g_warning ("%s: dbus_message_new_method_call failed", __FUNCTION__);
+			return NULL;
+		}
 
-	if (arg_type != DBUS_TYPE_BOOLEAN) {
-		error = TRUE;
-		goto out;
+		dbus_message_set_auto_start (template, !client->only_if_running);
+		client->templates[method] = template;
 	}
 
-	hit->has_attachment = _dbus_iter_get_boolean (&child); 
-
-	res = dbus_message_iter_next (&child);
-	if (res == FALSE) {
-		error = TRUE;
-		goto out;
-	}
+	MODEST_DBUS_PROBE_CALL_BUILD (method_names[method]);
 
-	/* is_unread  */
-	arg_type = dbus_message_iter_get_arg_type (&child);
+	return dbus_message_copy (template);
+}
 
-	if (arg_type != DBUS_TYPE_BOOLEAN) {
-		error = TRUE;
-		goto out;
-	}
+/* Checks that @reply is a method return, setting @error from the
+ * D-Bus error otherwise. */
+static gboolean
+modest_dbus_check_reply (DBusMessage *reply, GError **error)
+{
+	DBusError err;
 
-	hit->is_unread = _dbus_iter_get_boolean (&child);  
+	switch (dbus_message_get_type (reply)) {
 
-	res = dbus_message_iter_next (&child);
-	if (res == FALSE) {
-		error = TRUE;
-		goto out;
-	}
+		case DBUS_MESSAGE_TYPE_METHOD_RETURN:
+			/* ok we are good to go */
+			return TRUE;
 
-	/* timestamp  */
-	arg_type = dbus_message_iter_get_arg_type (&child);
+		case DBUS_MESSAGE_TYPE_ERROR:
+			dbus_error_init (&err);
+			dbus_set_error_from_message (&err, reply);
+			g_set_error (error, MODEST_DBUS_CLIENT_ERROR,
+				     dbus_error_has_name (&err, DBUS_ERROR_UNKNOWN_METHOD) ?
+				     MODEST_DBUS_CLIENT_ERROR_UNKNOWN_METHOD :
+				     MODEST_DBUS_CLIENT_ERROR_FAILED,
+				     "%s: %s", err.name,
+				     err.message ? err.message : "");
+			dbus_error_free (&err);
+			return FALSE;
 
-	if (arg_type != DBUS_TYPE_INT64) {
-		error = TRUE;
-		goto out;
+		default:
+			g_set_error_literal (error, MODEST_DBUS_CLIENT_ERROR,
+					     MODEST_DBUS_CLIENT_ERROR_INVALID_REPLY,
+					     "got unknown message type as reply");
+			return FALSE;
 	}
+}
 
-	hit->timestamp = _dbus_iter_get_int64 (&child); 
-
-	res = dbus_message_iter_next (&child);
-	if (res == TRUE) {
-		error = TRUE;
-		goto out;
-	}	
+/* Appends the arguments left in @from to @to */
+static gboolean
+modest_dbus_copy_args (DBusMessageIter *from, DBusMessageIter *to)
+{
+	int type;
+
+	while ((type = dbus_message_iter_get_arg_type (from)) != DBUS_TYPE_INVALID) {
+		if (dbus_type_is_basic (type)) {
+			union {
+				dbus_uint64_t  u64;
+				double         dbl;
+				const char    *str;
+			} value;
+
+			dbus_message_iter_get_basic (from, &value);
+			if (!dbus_message_iter_append_basic (to, type, &value)) {
+				return FALSE;
+			}
+		} else {
+			DBusMessageIter from_sub, to_sub;
+			char *signature = NULL;
+			gboolean res;
+
+			dbus_message_iter_recurse (from, &from_sub);
+
+			if (type == DBUS_TYPE_ARRAY) {
+				signature = dbus_message_iter_get_signature (from);
+			} else if (type == DBUS_TYPE_VARIANT) {
+				signature = dbus_message_iter_get_signature (&from_sub);
+			}
+
+			/* The signature of an array starts with its 'a' */
+			if (!dbus_message_iter_open_container (to, type,
+							       type == DBUS_TYPE_ARRAY ?
+							       signature + 1 : signature,
+							       &to_sub)) {
+				dbus_free (signature);
+				return FALSE;
+			}
+
+			res = modest_dbus_copy_args (&from_sub, &to_sub);
+			res = dbus_message_iter_close_container (to, &to_sub) && res;
+			dbus_free (signature);
+
+			if (!res) {
+				return FALSE;
+			}
+		}
 
-out:
-	if (error) {
-		g_warning ("%s: Error during unmarshalling", __FUNCTION__);
-		modest_search_hit_free (hit);
-		hit = NULL;
+		dbus_message_iter_next (from);
 	}
 
-	return hit;
+	return TRUE;
 }
 
-static ModestGetUnreadMessagesHit *
-modest_dbus_message_iter_get_unread_messages_hit (DBusMessageIter *parent)
+/* Builds the call @msg again for the well-known name. This is a new
+ * message rather than a dbus_message_copy() of the sent one, which keeps
+ * its serial with some libdbus versions, so that it gets a serial of its
+ * own and can be told apart from the first call. */
+static DBusMessage *
+modest_dbus_message_new_retry (DBusMessage *msg)
 {
-	ModestGetUnreadMessagesHit *hit;
-	DBusMessageIter  child;
-	dbus_bool_t      res;
-	int              arg_type;
-	gboolean         error;
+	DBusMessage *retry;
+	DBusMessageIter from, to;
 
-	error = FALSE;
+	retry = dbus_message_new_method_call (MODEST_DBUS_SERVICE,
+					      dbus_message_get_path (msg),
+					      dbus_message_get_interface (msg),
+					      dbus_message_get_member (msg));
 
-	arg_type = dbus_message_iter_get_arg_type (parent);
-
-	if (arg_type != 'r') {
+	if (retry == NULL) {
 		return NULL;
 	}
 
-	hit = g_slice_new0 (ModestGetUnreadMessagesHit);
-	dbus_message_iter_recurse (parent, &child);
-	
-	/* timestamp  */
-	arg_type = dbus_message_iter_get_arg_type (&child);
+	dbus_message_set_auto_start (retry, dbus_message_get_auto_start (msg));
+
+	if (dbus_message_iter_init (msg, &from)) {
+		dbus_message_iter_init_append (retry, &to);
 
-	if (arg_type != DBUS_TYPE_INT64) {
-		error = TRUE;
-		goto out;
+		if (!modest_dbus_copy_args (&from, &to)) {
+			dbus_message_unref (retry);
+			return NULL;
+		}
 	}
 
-	hit->timestamp = _dbus_iter_get_int64 (&child); 
+	return retry;
+}
+
+/* Looks at the @reply to @msg: remembers who answered, and if @msg was
+ * sent to a modest that is gone, returns a new call like @msg addressed
+ * to the well-known name, to be sent again. */
+static DBusMessage *
+modest_dbus_client_handle_reply (ModestDbusClient *client, DBusMessage *msg, DBusMessage *reply)
+{
+	const gchar *destination;
 
-	res = dbus_message_iter_next (&child);
-	if (res == FALSE) {
-		error = TRUE;
-		goto out;
-	}	
+	if (dbus_message_get_type (reply) == DBUS_MESSAGE_TYPE_METHOD_RETURN) {
+		const gchar *sender = dbus_message_get_sender (reply);
 
-	/* subject  */
-	arg_type = dbus_message_iter_get_arg_type (&child);
+		if (sender && sender[0] == ':') {
+			modest_dbus_client_set_owner (client, sender,
+						      MODEST_DBUS_OWNER_RUNNING);
+		}
+		return NULL;
+	}
 
-	if (arg_type != DBUS_TYPE_STRING) {
-		error = TRUE;
-		goto out;
+	if (!dbus_message_is_error (reply, DBUS_ERROR_SERVICE_UNKNOWN) &&
+	    !dbus_message_is_error (reply, DBUS_ERROR_NAME_HAS_NO_OWNER)) {
+		return NULL;
 	}
 
-	hit->subject = _dbus_iter_get_string_or_null (&child);
+	destination = dbus_message_get_destination (msg);
 
-	res = dbus_message_iter_next (&child);
-	if (res == TRUE) {
-		error = TRUE;
-		goto out;
+	if (destination == NULL || destination[0] != ':') {
+		/* The well-known name has no owner and could not be started */
+		modest_dbus_client_set_owner (client, NULL, MODEST_DBUS_OWNER_NOT_RUNNING);
+		return NULL;
 	}
 
-out:
-	if (error) {
-		g_warning ("%s: Error during unmarshalling", __FUNCTION__);
-		g_slice_free (ModestGetUnreadMessagesHit, hit);
-		hit = NULL;
+	if (g_strcmp0 (client->owner, destination) == 0) {
+		modest_dbus_client_set_owner (client, NULL, MODEST_DBUS_OWNER_UNKNOWN);
 	}
 
-	return hit;
+	return modest_dbus_message_new_retry (msg);
 }
 
-/**
- * libmodest_dbus_client_search:
- * @osso_ctx: A valid #osso_context_t object.
- * @query: The term to search for.
- * @folder: An url to specific folder or %NULL to search everywhere.
- * @start_date: Search hits before this date will be ignored.
- * @end_date: Search hits after this date will be ignored.
- * @min_size: Messagers smaller then this size will be ingored.
- * @flags: A list of flags where to search so the documentation 
- * of %ModestDBusSearchFlags for details.
- * @hits: A pointer to a valid GList pointer that will contain the search
- * hits (ModestSearchHit). The list and the items must be freed by the caller 
- * with modest_search_hit_list_free().
- *
- * This method will search the folder specified by a valid url in @folder or all
- * known accounts (local and remote) if %NULL for matches of the search term(s)
- * specified in @query. It is legal to specify 0 in @start_date, @end_date and
- * @min_size to ignore these parameters during the search otherwise those message
- * that do not meet the specifed dates or size will be ignored.
- * Where to search, be it subject, sender or the whole body can be specified by
- * the @flags parameter.
- *
- * Upon success TRUE is returned and @hits will include the search hits or the list
- * migh be empty if none of the messages matched the search criteria. The returned
- * list must be freed with modest_search_hit_list_free (). It is save to pass
- * %NULL to this function so you can call this function on the result list no matter
- * if a hit was found or not (means the list is empty - i.e. %NULL)
- * FALSE will only be return if an error during the remote procedure call (rpc) 
- * occured or if the specified folder could not be found.
- *
- * NOTE: The body of a message can only be searched if it was previously downloaded by
- * modest. This function does also not attempt do to remote searches (i.e. IMAP search).
- *
- * Example to search every account for message containing "no":
- * <informalexample><programlisting>
- * ModestDBusSearchFlags  flags;
- * osso_context_t        *osso_context;
- * GList                 *hits;
- * GList                 *iter;
- * gboolean               res;
- * 
- * [...] Initialize osso context [...]
- *
- * res = libmodest_dbus_client_search (osso_context,
- *				       "no",
- *				       NULL,
- *				       0,
- *				       0,
- *				       0,
- *				       flags,
- *				       &hits);
- * 
- * for (iter = hits; iter; iter = iter->next) {
- *	ModestSearchHit *hit = (ModestSearchHit *) iter->data;
- *   	
- *   	[...] Do something with the hit [...]
- *
- *	}
- *
- *	modest_search_hit_list_free (hits);
- * </programlisting></informalexample>
- * 
- * Return value: TRUE if the search succeded or FALSE for an error during the search
- **/
-gboolean
-libmodest_dbus_client_search (osso_context_t          *osso_ctx,
-			      const gchar             *query,
-			      const gchar             *folder,
-			      time_t		       start_date,
-			      time_t 		       end_date,
-			      guint32                  min_size,
-			      ModestDBusSearchFlags    flags,
-			      GList                  **hits)
+static gint
+modest_dbus_client_default_timeout (ModestDbusClient *client, ModestDbusClientMethod method)
 {
-
-	DBusMessage *msg;
-	dbus_bool_t res;
-	DBusConnection *con;
-	DBusMessageIter iter;
-	DBusMessageIter child;
-	DBusMessage *reply = NULL;
-	gint timeout;
-	int arg_type;
-	dbus_int64_t sd_v;
-	dbus_int64_t ed_v;
-	dbus_int32_t flags_v;
-	dbus_uint32_t size_v;
-
-	if (query == NULL) {
-		return FALSE;
+	switch (method) {
+	case MODEST_DBUS_CLIENT_METHOD_SEARCH:
+	case MODEST_DBUS_CLIENT_METHOD_SEARCH_STREAM:
+	case MODEST_DBUS_CLIENT_METHOD_SEARCH_PAGED:
+	case MODEST_DBUS_CLIENT_METHOD_SEARCH_NEXT_PAGE:
+	case MODEST_DBUS_CLIENT_METHOD_SEARCH_TOP:
+	case MODEST_DBUS_CLIENT_METHOD_SEARCH_FIELDS:
+	case MODEST_DBUS_CLIENT_METHOD_GET_UNREAD_MESSAGES:
+	case MODEST_DBUS_CLIENT_METHOD_GET_FOLDERS:
+	case MODEST_DBUS_CLIENT_METHOD_DELETE_MESSAGES:
+		/* These go through all the messages */
+		return MODEST_DBUS_LONG_TIMEOUT;
+	default:
+		/* What osso-rpc used to use */
+		return client->rpc_timeout;
 	}
+}
 
-	con = osso_get_dbus_connection (osso_ctx);
+static int
+modest_dbus_compare_latencies (const void *a, const void *b)
+{
+	guint la = *(const guint *) a;
+	guint lb = *(const guint *) b;
 
-	if (con == NULL) {
-		g_warning ("Could not get dbus connection\n");
-		return FALSE;
+	return (la > lb) - (la < lb);
+}
+
+/* The timeout to use for a call to @method. In adaptive mode, it is a
+ * few times the 95th percentile of the last latencies, so that a wedged
+ * modest is noticed in seconds, but never more than the set one. */
+static gint
+modest_dbus_client_get_timeout (ModestDbusClient *client, ModestDbusClientMethod method)
+{
+	ModestDbusMethodState *state;
+	guint sorted[MODEST_DBUS_LATENCY_WINDOW];
+	guint p95;
+	gint timeout;
 
+	if (method == MODEST_DBUS_CLIENT_METHOD_NONE) {
+		return -1;
 	}
 
+	state = &client->methods[method];
+	timeout = state->timeout >= 0 ? state->timeout :
+		modest_dbus_client_default_timeout (client, method);
 
-	msg = dbus_message_new_method_call (MODEST_DBUS_SERVICE,
-		MODEST_DBUS_OBJECT,
-		MODEST_DBUS_IFACE,
-		MODEST_DBUS_METHOD_SEARCH);
+	if (!client->adaptive_timeouts ||
+	    state->n_latencies < MODEST_DBUS_ADAPTIVE_MIN_SAMPLES) {
+		return timeout;
+	}
 
-    if (msg == NULL) {
-       	//ULOG_ERR_F("dbus_message_new_method_call failed");
-		return OSSO_ERROR;
-    }
+	memcpy (sorted, state->latencies, state->n_latencies * sizeof (guint));
+	qsort (sorted, state->n_latencies, sizeof (guint), modest_dbus_compare_latencies);
+	p95 = sorted[(state->n_latencies * 95) / 100];
 
-	if (folder == NULL) {
-		folder = "";
+	if (timeout < 0) {
+		timeout = MODEST_DBUS_DEFAULT_TIMEOUT;
 	}
 
-	sd_v = (dbus_int64_t) start_date;
-	ed_v = (dbus_int64_t) end_date;
-	flags_v = (dbus_int32_t) flags;
-	size_v = (dbus_uint32_t) min_size;
+	return CLAMP ((gint) MIN (p95, G_MAXINT / MODEST_DBUS_ADAPTIVE_FACTOR) *
+		      MODEST_DBUS_ADAPTIVE_FACTOR,
+		      MIN (MODEST_DBUS_ADAPTIVE_MIN_TIMEOUT, timeout), timeout);
+}
 
-	res  = dbus_message_append_args (msg,
-					 DBUS_TYPE_STRING, &query,
-					 DBUS_TYPE_STRING, &folder,
-					 DBUS_TYPE_INT64, &sd_v,
-					 DBUS_TYPE_INT64, &ed_v,
-					 DBUS_TYPE_INT32, &flags_v,
-					 DBUS_TYPE_UINT32, &size_v,
-					 DBUS_TYPE_INVALID);
+/* Records how long modest took to answer a call to @method that was
+ * sent at @start, as given by g_get_monotonic_time(). */
+static void
+modest_dbus_client_add_latency (ModestDbusClient *client, ModestDbusClientMethod method,
+				gint64 start)
+{
+	ModestDbusMethodState *state;
 
-	dbus_message_set_auto_start (msg, TRUE);
+	if (method == MODEST_DBUS_CLIENT_METHOD_NONE) {
+		return;
+	}
 
-	/* Use a long timeout (2 minutes) because the search currently 
-	 * gets folders and messages from the servers. */
-	timeout = 120000; //milliseconds.
-	//osso_rpc_get_timeout (osso_ctx, &timeout);
+	state = &client->methods[method];
+	state->latencies[state->next_latency] =
+		(guint) MIN ((g_get_monotonic_time () - start) / 1000, G_MAXUINT);
+	state->next_latency = (state->next_latency + 1) % MODEST_DBUS_LATENCY_WINDOW;
 
-    /*printf("DEBUG: %s: Before dbus_connection_send_with_reply_and_block().\n", 
-		__FUNCTION__); */
-	/* TODO: Detect the timeout somehow. */
-	DBusError err;
-	dbus_error_init (&err);
-	reply = dbus_connection_send_with_reply_and_block (con,
-							   msg, 
-							   timeout,
-							   &err);
-	/* printf("DEBUG: %s: dbus_connection_send_with_reply_and_block() finished.\n", 
-		__FUNCTION__); */
+	if (state->n_latencies < MODEST_DBUS_LATENCY_WINDOW) {
+		state->n_latencies++;
+	}
+}
 
-	dbus_message_unref (msg);
+#define MODEST_DBUS_STAT_ADD(client, method, counter, n)				\
+	G_STMT_START {								\
+		if ((method) != MODEST_DBUS_CLIENT_METHOD_NONE) {		\
+			g_mutex_lock (&(client)->stats_lock);			\
+			(client)->methods[method].counter += (n);		\
+			g_mutex_unlock (&(client)->stats_lock);			\
+		}								\
+	} G_STMT_END
+
+/* Appends a call to @method to the event log. @start is when it was
+ * sent, as given by g_get_monotonic_time(), or 0 if it was not. This is
+ * a few stores, so that it can be done for every call. */
+static void
+modest_dbus_client_log_event (ModestDbusClient *client, ModestDbusClientMethod method,
+			      ModestDbusEventResult result, guint32 serial, gint64 start)
+{
+	ModestDbusEventEntry *entry;
+	guint ticket;
 
-	if (!reply) {
-		g_warning("%s: dbus_connection_send_with_reply_and_block() error: %s", 
-			__FUNCTION__, err.message);
-		return FALSE;
+	if (method == MODEST_DBUS_CLIENT_METHOD_NONE) {
+		return;
 	}
 
-	switch (dbus_message_get_type (reply)) {
-
-		case DBUS_MESSAGE_TYPE_ERROR:
-			dbus_set_error_from_message (&err, reply);
-			//XXX to GError?!
-			dbus_error_free (&err);
-			dbus_message_unref (reply);
-			return FALSE;
+	ticket = (guint) g_atomic_int_add ((volatile gint *) &client->next_event, 1);
+	entry = &client->events[ticket % MODEST_DBUS_CLIENT_EVENT_LOG_SIZE];
 
-		case DBUS_MESSAGE_TYPE_METHOD_RETURN:
-			/* ok we are good to go
-			 * lets drop outa here and handle that */
-			break;
-		default:
-			//ULOG_WARN_F("got unknown message type as reply");
-			//retval->type = DBUS_TYPE_STRING;
-			//retval->value.s = g_strdup("Invalid return value");
-			//XXX to GError?! 
-			dbus_message_unref (reply);
-			return FALSE;
-	}
+	g_atomic_int_set ((volatile gint *) &entry->seq, 0);
+	entry->method = method;
+	entry->result = result;
+	entry->serial = serial;
+	entry->time = g_get_real_time ();
+	entry->duration = start ? MAX (g_get_monotonic_time () - start, 0) : 0;
+	g_atomic_int_set ((volatile gint *) &entry->seq, (gint) (ticket + 1));
+}
 
-	g_debug ("%s: message return", __FUNCTION__);
+/* Brackets the unmarshalling of @reply, a reply to @method, which
+ * gave @n_items results. */
+#define MODEST_DBUS_DECODE_START(method, reply)					\
+	MODEST_DBUS_PROBE_DECODE_START (method_names[method],			\
+					dbus_message_get_reply_serial (reply))
+#define MODEST_DBUS_DECODE_END(client, method, reply, n_items)			\
+	G_STMT_START {								\
+		MODEST_DBUS_STAT_ADD (client, method, items_decoded, n_items);	\
+		MODEST_DBUS_PROBE_DECODE_END (method_names[method],		\
+					      dbus_message_get_reply_serial (reply), \
+					      (guint) (n_items));		\
+	} G_STMT_END
+
+/* Accounts for the final reply to a call to @method sent at @start, as
+ * given by g_get_monotonic_time(). Latencies are only known for the
+ * calls modest answered. A timed out call counts as taking the whole
+ * timeout, so that adaptive timeouts grow again when modest gets slower. */
+static void
+modest_dbus_client_record_reply (ModestDbusClient *client, ModestDbusClientMethod method,
+				 DBusMessage *reply, gint64 start)
+{
+	DBusMessageIter iter;
+	gint64 latency;
+	guint bucket;
 
-	dbus_message_iter_init (reply, &iter);
-	arg_type = dbus_message_iter_get_arg_type (&iter);
-	
-	dbus_message_iter_recurse (&iter, &child);
-	*hits = NULL;
+	if (method == MODEST_DBUS_CLIENT_METHOD_NONE) {
+		return;
+	}
 
-	do {
-		ModestSearchHit *hit;
+	MODEST_DBUS_PROBE_CALL_REPLY (method_names[method],
+				      dbus_message_get_reply_serial (reply),
+				      dbus_message_get_type (reply));
 
-		hit = modest_dbus_message_iter_get_search_hit (&child);
+	if (dbus_message_is_error (reply, DBUS_ERROR_NO_REPLY)) {
+		MODEST_DBUS_STAT_ADD (client, method, timeouts, 1);
+		MODEST_DBUS_STAT_ADD (client, method, failures, 1);
+		modest_dbus_client_add_latency (client, method, start);
+		modest_dbus_client_log_event (client, method, MODEST_DBUS_EVENT_TIMEOUT,
+					      dbus_message_get_reply_serial (reply), start);
+		return;
+	}
 
-		if (hit) {
-			*hits = g_list_prepend (*hits, hit);	
-		}
+	latency = MAX (g_get_monotonic_time () - start, 0);
+	bucket = latency < 2 ? 0 : g_bit_storage ((gulong) latency) - 1;
+	bucket = MIN (bucket, MODEST_DBUS_CLIENT_LATENCY_BUCKETS - 1);
+	MODEST_DBUS_STAT_ADD (client, method, latency_buckets[bucket], 1);
 
-	} while (dbus_message_iter_next (&child));
+	if (dbus_message_get_type (reply) != DBUS_MESSAGE_TYPE_METHOD_RETURN) {
+		MODEST_DBUS_STAT_ADD (client, method, failures, 1);
+		modest_dbus_client_log_event (client, method, MODEST_DBUS_EVENT_ERROR,
+					      dbus_message_get_reply_serial (reply), start);
+		return;
+	}
 
-	dbus_message_unref (reply);
+	modest_dbus_client_add_latency (client, method, start);
+	modest_dbus_client_log_event (client, method, MODEST_DBUS_EVENT_OK,
+				      dbus_message_get_reply_serial (reply), start);
+
+	/* Only the payload of the array of results is counted, not the
+	 * header nor the other arguments, as libdbus gives no way to get
+	 * the size of a whole message without copying it. The length of
+	 * the array is known without walking it, but only from this
+	 * deprecated call. */
+	if (dbus_message_iter_init (reply, &iter) &&
+	    dbus_message_iter_get_arg_type (&iter) == DBUS_TYPE_ARRAY) {
+		G_GNUC_BEGIN_IGNORE_DEPRECATIONS
+		MODEST_DBUS_STAT_ADD (client, method, result_bytes,
+				      dbus_message_iter_get_array_len (&iter));
+		G_GNUC_END_IGNORE_DEPRECATIONS
+	}
+}
 
+/**
+ * libmodest_dbus_client_get_stats:
+ * @client: a #ModestDbusClient
+ * @n_stats: return location for the number of statistics
+ *
+ * Takes a snapshot of the statistics the client keeps about the calls
+ * to every method of modest: the number of calls, of failed and timed
+ * out ones, the payload bytes of the arrays of results received and the
+ * number of items decoded from them, and a histogram of the latencies. The counters are
+ * updated under a lock of their own, so this can be called from any
+ * thread, but the counters of a method may be a call apart from each other.
+ *
+ * Return value: an array of @n_stats statistics, one per method, to be
+ * freed with g_free().
+ **/
+ModestDbusMethodStats *
+libmodest_dbus_client_get_stats (ModestDbusClient *client, guint *n_stats)
+{
+	ModestDbusMethodStats *stats;
+	guint i, j;
 
-	/* TODO: This is from osso source, do we need it? */
-#if 0
-	/* Tell TaskNavigator to show "launch banner" */
-	msg = dbus_message_new_method_call (TASK_NAV_SERVICE,
-					    APP_LAUNCH_BANNER_METHOD_PATH,
-					    APP_LAUNCH_BANNER_METHOD_INTERFACE,
-					    APP_LAUNCH_BANNER_METHOD);
+	g_return_val_if_fail (client != NULL, NULL);
+	g_return_val_if_fail (n_stats != NULL, NULL);
 
-	if (msg == NULL) {
-		g_warn ("dbus_message_new_method_call failed");
-	}
+	stats = g_new0 (ModestDbusMethodStats, MODEST_DBUS_CLIENT_N_METHODS);
 
+	for (i = 0; i < MODEST_DBUS_CLIENT_N_METHODS; i++) {
+		ModestDbusMethodState *state = &client->methods[i];
 
+		g_mutex_lock (&client->stats_lock);
 
-	dbus_message_append_args (msg,
-				  DBUS_TYPE_STRING,
-				  &service,
-				  DBUS_TYPE_INVALID);
+		stats[i].method = method_names[i];
+		stats[i].calls = state->calls;
+		stats[i].failures = state->failures;
+		stats[i].timeouts = state->timeouts;
+		stats[i].result_bytes = state->result_bytes;
+		stats[i].items_decoded = state->items_decoded;
 
-	b = dbus_connection_send (conn, msg, NULL);
+		for (j = 0; j < MODEST_DBUS_CLIENT_LATENCY_BUCKETS; j++) {
+			stats[i].latency_buckets[j] = state->latency_buckets[j];
+		}
 
-	if (b == NULL) {
-		ULOG_WARN_F("dbus_connection_send failed");
+		g_mutex_unlock (&client->stats_lock);
 	}
 
-	dbus_message_unref (msg);
-#endif
+	*n_stats = MODEST_DBUS_CLIENT_N_METHODS;
 
-	return TRUE;
+	return stats;
 }
 
-
-static ModestAccountHits *
-modest_dbus_message_iter_get_account_hits (DBusMessageIter *parent)
+/**
+ * libmodest_dbus_method_stats_get_percentile:
+ * @stats: the statistics of a method
+ * @percentile: the percentile, between 0 and 100
+ *
+ * Return value: an upper bound of the latency, in microseconds, under
+ * which @percentile percent of the answered calls fall, or 0 if no call
+ * was answered. It is the upper limit of a histogram bucket, so it may
+ * be up to twice the real latency.
+ **/
+guint64
+libmodest_dbus_method_stats_get_percentile (const ModestDbusMethodStats *stats,
+					    gdouble                      percentile)
 {
+	guint64 total = 0;
+	guint64 count = 0;
+	guint64 rank;
+	guint i;
 
-	ModestAccountHits *account_hits;
-	int              arg_type;
-	gboolean         error;
-	dbus_bool_t      res;
-	DBusMessageIter  child, traverse;
+	g_return_val_if_fail (stats != NULL, 0);
 
-	error = FALSE;
-	account_hits = g_slice_new0 (ModestAccountHits);
-
-	arg_type = dbus_message_iter_get_arg_type (parent);
+	for (i = 0; i < MODEST_DBUS_CLIENT_LATENCY_BUCKETS; i++) {
+		total += stats->latency_buckets[i];
+	}
 
-	if (arg_type != 'r') {
-		return NULL;
+	if (total == 0) {
+		return 0;
 	}
 
-	dbus_message_iter_recurse (parent, &child);
-	
-	/* accountid  */
-	arg_type = dbus_message_iter_get_arg_type (&child);
+	rank = (guint64) ((CLAMP (percentile, 0.0, 100.0) * total + 99.0) / 100.0);
+	rank = MAX (rank, 1);
 
-	if (arg_type != DBUS_TYPE_STRING) {
-		error = TRUE;
-		goto out;
+	for (i = 0; i < MODEST_DBUS_CLIENT_LATENCY_BUCKETS - 1; i++) {
+		count += stats->latency_buckets[i];
+		if (count >= rank) {
+			break;
+		}
 	}
 
-	account_hits->account_id = _dbus_iter_get_string_or_null (&child);
+	return G_GUINT64_CONSTANT (1) << (i + 1);
+}
 
-	res = dbus_message_iter_next (&child);
-	if (res == FALSE) {
-		error = TRUE;
-		goto out;
-	}
+/**
+ * libmodest_dbus_client_dump_stats:
+ * @client: a #ModestDbusClient
+ * @file: where to write the statistics, such as stderr
+ *
+ * Writes a table of the statistics of the methods that were called,
+ * with their 50th and 99th latency percentiles in milliseconds.
+ **/
+void
+libmodest_dbus_client_dump_stats (ModestDbusClient *client, FILE *file)
+{
+	ModestDbusMethodStats *stats;
+	guint n_stats, i;
 
-	/* account name */
-	arg_type = dbus_message_iter_get_arg_type (&child);
+	g_return_if_fail (client != NULL);
+	g_return_if_fail (file != NULL);
 
-	if (arg_type != DBUS_TYPE_STRING) {
-		error = TRUE;
-		goto out;
-	}
+	stats = libmodest_dbus_client_get_stats (client, &n_stats);
+
+	fprintf (file, "%-26s %8s %8s %8s %10s %8s %9s %9s\n",
+		 "method", "calls", "failures", "timeouts", "res bytes", "items",
+		 "p50 (ms)", "p99 (ms)");
 
-	account_hits->account_name = _dbus_iter_get_string_or_null (&child);
+	for (i = 0; i < n_stats; i++) {
+		if (stats[i].calls == 0) {
+			continue;
+		}
 
-	res = dbus_message_iter_next (&child);
-	if (res == FALSE) {
-		error = TRUE;
-		goto out;
+		fprintf (file, "%-26s %8" G_GUINT64_FORMAT " %8" G_GUINT64_FORMAT
+			 " %8" G_GUINT64_FORMAT " %10" G_GUINT64_FORMAT " %8" G_GUINT64_FORMAT
+			 " %9.1f %9.1f\n",
+			 stats[i].method, stats[i].calls, stats[i].failures,
+			 stats[i].timeouts, stats[i].result_bytes, stats[i].items_decoded,
+			 libmodest_dbus_method_stats_get_percentile (&stats[i], 50) / 1000.0,
+			 libmodest_dbus_method_stats_get_percentile (&stats[i], 99) / 1000.0);
 	}
 
-	/* store protocol */
-	arg_type = dbus_message_iter_get_arg_type (&child);
+	g_free (stats);
+}
 
-	if (arg_type != DBUS_TYPE_STRING) {
-		error = TRUE;
-		goto out;
-	}
+/* Copies the entry for @ticket to @event, if it was written and not
+ * overwritten yet. */
+static gboolean
+modest_dbus_client_read_event (ModestDbusClient *client, guint ticket,
+			       ModestDbusEvent *event)
+{
+	ModestDbusEventEntry *entry;
 
-	account_hits->store_protocol = _dbus_iter_get_string_or_null (&child);
+	entry = &client->events[ticket % MODEST_DBUS_CLIENT_EVENT_LOG_SIZE];
 
-	res = dbus_message_iter_next (&child);
-	if (res == FALSE) {
-		error = TRUE;
-		goto out;
+	if ((guint) g_atomic_int_get ((volatile gint *) &entry->seq) != ticket + 1) {
+		return FALSE;
 	}
 
-	/* unread count */
-	arg_type = dbus_message_iter_get_arg_type (&child);
+	event->method = method_names[entry->method];
+	event->result = entry->result;
+	event->serial = entry->serial;
+	event->time = entry->time;
+	event->duration = entry->duration;
 
-	if (arg_type != DBUS_TYPE_INT64) {
-		error = TRUE;
-		goto out;
-	}
+	return (guint) g_atomic_int_get ((volatile gint *) &entry->seq) == ticket + 1;
+}
 
-	account_hits->unread_count = _dbus_iter_get_int64 (&child);
+/**
+ * libmodest_dbus_client_get_events:
+ * @client: a #ModestDbusClient
+ * @n_events: return location for the number of events
+ *
+ * Takes a snapshot of the event log of the client, which keeps the
+ * time, method, result and duration of its last
+ * %MODEST_DBUS_CLIENT_EVENT_LOG_SIZE calls to modest. The log is
+ * written without locks, so this can be called from any thread; the
+ * calls being logged meanwhile are left out.
+ *
+ * Return value: an array of @n_events events, oldest first, to be freed
+ * with g_free().
+ **/
+ModestDbusEvent *
+libmodest_dbus_client_get_events (ModestDbusClient *client, guint *n_events)
+{
+	ModestDbusEvent *events;
+	guint ticket, last;
 
-	res = dbus_message_iter_next (&child);
-	if (res == FALSE) {
-		error = TRUE;
-		goto out;
-	}
+	g_return_val_if_fail (client != NULL, NULL);
+	g_return_val_if_fail (n_events != NULL, NULL);
 
-	/* list of hits  */
-	dbus_message_iter_recurse (&child, &traverse);
-	account_hits->hits = NULL;
+	events = g_new (ModestDbusEvent, MODEST_DBUS_CLIENT_EVENT_LOG_SIZE);
+	*n_events = 0;
 
-	do {
-		ModestGetUnreadMessagesHit *hit;
+	last = (guint) g_atomic_int_get ((volatile gint *) &client->next_event);
+	ticket = last > MODEST_DBUS_CLIENT_EVENT_LOG_SIZE ?
+		last - MODEST_DBUS_CLIENT_EVENT_LOG_SIZE : 0;
 
-		hit = modest_dbus_message_iter_get_unread_messages_hit (&traverse);
-		if (hit) {
-			account_hits->hits = g_list_prepend (account_hits->hits, hit);
+	for (; ticket != last; ticket++) {
+		if (modest_dbus_client_read_event (client, ticket, &events[*n_events])) {
+			(*n_events)++;
 		}
-	} while (dbus_message_iter_next (&traverse));
-out:
-	if (error) {
-		g_warning ("%s: Error during unmarshalling", __FUNCTION__);
-		modest_account_hits_free (account_hits);
-		account_hits = NULL;
 	}
 
-	return account_hits;
+	return events;
 }
 
-gboolean
-libmodest_dbus_client_get_unread_messages (osso_context_t          *osso_ctx,
-					   gint msgs_per_account,
-					   GList **account_hits_lists)
+/* Writes @value in decimal, padded with zeros to @width digits, before
+ * @end, and returns where it starts. */
+static gchar *
+modest_dbus_format_uint (gchar *end, guint64 value, guint width)
 {
+	do {
+		*--end = '0' + value % 10;
+		value /= 10;
+		width = width ? width - 1 : 0;
+	} while (value || width);
 
-	dbus_bool_t res;
-	DBusMessageIter iter;
-	DBusMessageIter child;
-	DBusMessage *reply = NULL;
-	int arg_type;
+	return end;
+}
 
-	DBusConnection *con;
-	DBusMessage *msg;
-	dbus_int32_t msgs_per_account_v;
-	DBusError err;
-	gint timeout;
+static const gchar *event_results[] = {
+	"ok", "error", "timeout", "send-failed", "not-running"
+};
 
-	if (msgs_per_account < 1) {
-		return FALSE;
-	}
+/**
+ * libmodest_dbus_client_dump_events:
+ * @client: a #ModestDbusClient
+ * @fd: where to write the events, such as STDERR_FILENO
+ *
+ * Writes the event log, oldest call first, as lines of the wall-clock
+ * time in seconds, the method, the result, the duration in
+ * microseconds and the serial of the call. Nothing is allocated and only
+ * write() is called, so that this can be done from a signal handler,
+ * to find out what the application was waiting for when it crashed.
+ **/
+void
+libmodest_dbus_client_dump_events (ModestDbusClient *client, int fd)
+{
+	guint ticket, last;
 
-	con = osso_get_dbus_connection (osso_ctx);
+	g_return_if_fail (client != NULL);
 
-	if (con == NULL) {
-		g_warning ("Could not get dbus connection\n");
-		return FALSE;
+	last = (guint) g_atomic_int_get ((volatile gint *) &client->next_event);
+	ticket = last > MODEST_DBUS_CLIENT_EVENT_LOG_SIZE ?
+		last - MODEST_DBUS_CLIENT_EVENT_LOG_SIZE : 0;
 
-	}
+	for (; ticket != last; ticket++) {
+		ModestDbusEvent event;
+		gchar line[192];
+		gchar *p = line + sizeof (line);
+		const gchar *fields[2];
+		gsize len;
+		guint i;
 
+		if (!modest_dbus_client_read_event (client, ticket, &event)) {
+			continue;
+		}
 
-	msg = dbus_message_new_method_call (MODEST_DBUS_SERVICE,
-		MODEST_DBUS_OBJECT,
-		MODEST_DBUS_IFACE,
-		MODEST_DBUS_METHOD_GET_UNREAD_MESSAGES);
+		/* Built backwards, from the end of the line */
+		*--p = '\n';
+		p = modest_dbus_format_uint (p, event.serial, 0);
+		*--p = ' ';
+		p = modest_dbus_format_uint (p, (guint64) event.duration, 0);
+		*--p = ' ';
+
+		fields[0] = event_results[event.result];
+		fields[1] = event.method;
+		for (i = 0; i < G_N_ELEMENTS (fields); i++) {
+			len = MIN (strlen (fields[i]), 40);
+			p -= len;
+			memcpy (p, fields[i], len);
+			*--p = ' ';
+		}
 
-	if (msg == NULL) {
-		//ULOG_ERR_F("dbus_message_new_method_call failed");
-		return OSSO_ERROR;
+		p = modest_dbus_format_uint (p, (guint64) event.time % G_USEC_PER_SEC, 6);
+		*--p = '.';
+		p = modest_dbus_format_uint (p, (guint64) event.time / G_USEC_PER_SEC, 0);
+
+		len = line + sizeof (line) - p;
+		while (len > 0) {
+			gssize written = write (fd, p, len);
+
+			if (written < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				return;
+			}
+			p += written;
+			len -= written;
+		}
 	}
+}
 
-	msgs_per_account_v = (dbus_int32_t) msgs_per_account;
+/**
+ * libmodest_dbus_client_set_timeout:
+ * @client: a #ModestDbusClient
+ * @method: the name of a method, such as %MODEST_DBUS_METHOD_SEARCH, or
+ * %NULL for all of them
+ * @timeout_ms: the timeout in milliseconds, or -1 for the default one
+ *
+ * Sets how long calls to @method wait for modest to answer. By default,
+ * the methods that go through all the messages, such as searches, wait
+ * two minutes, and the others use the osso rpc timeout.
+ *
+ * Return value: FALSE if @method is not a method of modest
+ **/
+gboolean
+libmodest_dbus_client_set_timeout (ModestDbusClient *client,
+				   const gchar      *method,
+				   gint              timeout_ms)
+{
+	gboolean found = FALSE;
+	guint i;
 
-	res  = dbus_message_append_args (msg,
-					 DBUS_TYPE_INT32, &msgs_per_account,
-					 DBUS_TYPE_INVALID);
+	g_return_val_if_fail (client != NULL, FALSE);
+
+	for (i = 0; i < MODEST_DBUS_CLIENT_N_METHODS; i++) {
+		if (method == NULL || strcmp (method, method_names[i]) == 0) {
+			client->methods[i].timeout = timeout_ms < 0 ? -1 : timeout_ms;
+			found = TRUE;
+		}
+	}
 
-	dbus_message_set_auto_start (msg, TRUE);
+	return found;
+}
 
-	timeout = 120000; //milliseconds.
+/**
+ * libmodest_dbus_client_set_adaptive_timeouts:
+ * @client: a #ModestDbusClient
+ * @adaptive: whether to derive the timeouts from the observed latencies
+ *
+ * In adaptive mode, the timeout of every method is shortened to a few
+ * times the 95th percentile of its last latencies, once enough calls were
+ * made. A modest that stopped answering is then detected in seconds
+ * instead of minutes, and the caller can fall back quickly. The timeouts
+ * set with libmodest_dbus_client_set_timeout() remain the upper bound.
+ **/
+void
+libmodest_dbus_client_set_adaptive_timeouts (ModestDbusClient *client,
+					     gboolean          adaptive)
+{
+	g_return_if_fail (client != NULL);
 
-	dbus_error_init (&err);
-	reply = dbus_connection_send_with_reply_and_block (con,
-							   msg, 
-							   timeout,
-							   &err);
+	client->adaptive_timeouts = adaptive ? TRUE : FALSE;
+}
 
-	dbus_message_unref (msg);
+/* Sends @msg, consuming the reference, and blocks until modest
+ * replies. Returns the method return message or %NULL on error. */
+static DBusMessage *
+modest_dbus_client_send_and_block (ModestDbusClient *client, ModestDbusClientMethod method,
+				   DBusMessage *msg, GError **error)
+{
+	DBusPendingCall *pending = NULL;
+	DBusMessage *reply = NULL;
+	DBusMessage *retry;
+	GError *reply_error = NULL;
+	gint timeout;
+	gint64 start;
 
-	if (!reply) {
-		g_warning("%s: dbus_connection_send_with_reply_and_block() error: %s", 
-			__FUNCTION__, err.message);
-		return FALSE;
+	if (msg == NULL) {
+		g_set_error_literal (error, MODEST_DBUS_CLIENT_ERROR,
+				     MODEST_DBUS_CLIENT_ERROR_FAILED,
+				     "Could not create the method call");
+		return NULL;
 	}
 
-	switch (dbus_message_get_type (reply)) {
+	if (!modest_dbus_client_check_running (client, error)) {
+		modest_dbus_client_log_event (client, method, MODEST_DBUS_EVENT_NOT_RUNNING, 0, 0);
+		dbus_message_unref (msg);
+		return NULL;
+	}
 
-		case DBUS_MESSAGE_TYPE_ERROR:
-			dbus_set_error_from_message (&err, reply);
-			//XXX to GError?!
-			dbus_error_free (&err);
-			dbus_message_unref (reply);
-			return FALSE;
+	timeout = modest_dbus_client_get_timeout (client, method);
+	MODEST_DBUS_STAT_ADD (client, method, calls, 1);
+
+	while (TRUE) {
+		start = g_get_monotonic_time ();
+
+		if (client->connection == NULL ||
+		    !dbus_connection_send_with_reply (client->connection, msg, &pending, timeout) ||
+		    pending == NULL) {
+			g_warning ("%s: dbus_connection_send_with_reply() failed", __FUNCTION__);
+			g_set_error_literal (error, MODEST_DBUS_CLIENT_ERROR,
+					     MODEST_DBUS_CLIENT_ERROR_FAILED,
+					     "Could not send the method call");
+			MODEST_DBUS_STAT_ADD (client, method, failures, 1);
+			modest_dbus_client_log_event (client, method, MODEST_DBUS_EVENT_SEND_FAILED,
+						      0, start);
+			dbus_message_unref (msg);
+			return NULL;
+		}
 
-		case DBUS_MESSAGE_TYPE_METHOD_RETURN:
-			/* ok we are good to go
-			 * lets drop outa here and handle that */
+		MODEST_DBUS_PROBE_CALL_SEND (dbus_message_get_member (msg),
+					     dbus_message_get_serial (msg));
+
+		dbus_pending_call_block (pending);
+		reply = dbus_pending_call_steal_reply (pending);
+		dbus_pending_call_unref (pending);
+		pending = NULL;
+
+		retry = reply ? modest_dbus_client_handle_reply (client, msg, reply) : NULL;
+		dbus_message_unref (msg);
+
+		if (retry == NULL) {
 			break;
-		default:
-			//ULOG_WARN_F("got unknown message type as reply");
-			//retval->type = DBUS_TYPE_STRING;
-			//retval->value.s = g_strdup("Invalid return value");
-			//XXX to GError?! 
-			dbus_message_unref (reply);
-			return FALSE;
+		}
+
+		dbus_message_unref (reply);
+		msg = retry;
 	}
 
-	g_debug ("%s: message return", __FUNCTION__);
+	if (reply == NULL) {
+		g_set_error_literal (error, MODEST_DBUS_CLIENT_ERROR,
+				     MODEST_DBUS_CLIENT_ERROR_FAILED,
+				     "No reply received");
+		MODEST_DBUS_STAT_ADD (client, method, failures, 1);
+		modest_dbus_client_log_event (client, method, MODEST_DBUS_EVENT_ERROR, 0, start);
+		return NULL;
+	}
 
-	dbus_message_iter_init (reply, &iter);
-	arg_type = dbus_message_iter_get_arg_type (&iter);
-	
-	dbus_message_iter_recurse (&iter, &child);
-	*account_hits_lists = NULL;
+	modest_dbus_client_record_reply (client, method, reply, start);
 
-	do {
-		ModestAccountHits *account_hits;
+	if (!modest_dbus_check_reply (reply, &reply_error)) {
+		g_debug ("%s: %s", __FUNCTION__, reply_error->message);
+		g_propagate_error (error, reply_error);
+		dbus_message_unref (reply);
+		return NULL;
+	}
 
-		account_hits = modest_dbus_message_iter_get_account_hits (&child);
+	return reply;
+}
 
-		if (account_hits) {
-			*account_hits_lists = g_list_prepend (*account_hits_lists, account_hits);	
-		}
+/* Sends @msg, consuming the reference, without asking modest for a
+ * reply, so that it does not need to wait for one. */
+static gboolean
+modest_dbus_client_send_no_reply (ModestDbusClient *client, ModestDbusClientMethod method,
+				  DBusMessage *msg)
+{
+	dbus_bool_t res;
+
+	if (msg == NULL) {
+		return FALSE;
+	}
 
-	} while (dbus_message_iter_next (&child));
+	if (!modest_dbus_client_check_running (client, NULL)) {
+		modest_dbus_client_log_event (client, method, MODEST_DBUS_EVENT_NOT_RUNNING, 0, 0);
+		dbus_message_unref (msg);
+		return FALSE;
+	}
 
-	dbus_message_unref (reply);
+	dbus_message_set_no_reply (msg, TRUE);
 
+	/* With no reply, nothing would tell us that the cached unique name
+	 * is gone, and the bus cannot start modest for it: use the
+	 * well-known name. The bus keeps our messages in order either way. */
+	res = client->connection &&
+		dbus_message_set_destination (msg, MODEST_DBUS_SERVICE) &&
+		dbus_connection_send (client->connection, msg, NULL);
 
-	return TRUE;
-}
+	if (res) {
+		MODEST_DBUS_PROBE_CALL_SEND (dbus_message_get_member (msg),
+					     dbus_message_get_serial (msg));
+	}
 
+	modest_dbus_client_log_event (client, method,
+				      res ? MODEST_DBUS_EVENT_OK : MODEST_DBUS_EVENT_SEND_FAILED,
+				      dbus_message_get_serial (msg), 0);
+	dbus_message_unref (msg);
 
-static void
-modest_folder_result_free (ModestFolderResult *item)
-{
-	g_free (item->folder_name);
-	g_free (item->folder_uri);
-	g_slice_free (ModestFolderResult, item);
+	MODEST_DBUS_STAT_ADD (client, method, calls, 1);
+	if (!res) {
+		MODEST_DBUS_STAT_ADD (client, method, failures, 1);
+	}
+
+	return res;
 }
 
-void
-modest_folder_result_list_free (GList *list)
+/* Calls @method with osso-rpc like arguments: a DBUS_TYPE_INVALID
+ * terminated list of types, each one followed by its value. %NULL
+ * strings are sent as empty ones. The reply carries nothing useful,
+ * so we only wait for it if @wait_reply is %TRUE. */
+static gboolean
+modest_dbus_client_call_simple (ModestDbusClient *client, ModestDbusClientMethod method,
+				gboolean wait_reply, int first_arg_type, ...)
 {
-	GList *iter;
+	DBusMessage *msg;
+	DBusMessage *reply;
+	va_list args;
+	int type;
+	gboolean res = TRUE;
 
-	if (list == NULL) {
-		return;
-	}
+	msg = modest_dbus_client_new_call (client, method);
 
-	for (iter = list; iter; iter = iter->next) {
-		modest_folder_result_free ((ModestFolderResult *) iter->data);
+	if (msg == NULL) {
+		return FALSE;
 	}
 
-	g_list_free (list);
-}
+	va_start (args, first_arg_type);
 
+	for (type = first_arg_type; res && type != DBUS_TYPE_INVALID; type = va_arg (args, int)) {
+		const gchar *str;
+		dbus_bool_t bool_v;
 
-/** Get the values from the complex type (GET_FOLDERS_RESULT_DBUS_TYPE)
- * in the D-Bus return message. */
-static ModestFolderResult *
-modest_dbus_message_iter_get_folder_item (DBusMessageIter *parent)
-{
-	gboolean error = FALSE;
-	ModestFolderResult *item = g_slice_new0 (ModestFolderResult);
+		switch (type) {
+		case DBUS_TYPE_STRING:
+			str = va_arg (args, const gchar *);
+			if (str == NULL) {
+				str = "";
+			}
+			res = dbus_message_append_args (msg, DBUS_TYPE_STRING, &str,
+							DBUS_TYPE_INVALID);
+			break;
+		case DBUS_TYPE_BOOLEAN:
+			bool_v = va_arg (args, gboolean) ? TRUE : FALSE;
+			res = dbus_message_append_args (msg, DBUS_TYPE_BOOLEAN, &bool_v,
+							DBUS_TYPE_INVALID);
+			break;
+		default:
+			g_warning ("%s: unsupported argument type %c", __FUNCTION__, type);
+			res = FALSE;
+			break;
+		}
+	}
 
-	int arg_type = dbus_message_iter_get_arg_type (parent);
+	va_end (args);
 
-	if (arg_type != 'r') {
-		return NULL;
+	if (!res) {
+		dbus_message_unref (msg);
+		return FALSE;
+	}
+
+	if (!wait_reply) {
+		return modest_dbus_client_send_no_reply (client, method, msg);
 	}
 
-	DBusMessageIter  child;
-	dbus_message_iter_recurse (parent, &child);
-	
-	/* folder name: */
-	arg_type = dbus_message_iter_get_arg_type (&child);
+	/* The result is in the event log of the client */
+	reply = modest_dbus_client_send_and_block (client, method, msg, NULL);
 
-	if (arg_type != DBUS_TYPE_STRING) {
-		error = TRUE;
-		goto out;
+	if (reply == NULL) {
+		return FALSE;
 	}
 
-	item->folder_name = _dbus_iter_get_string_or_null (&child);
-	
-	
-	dbus_bool_t res = dbus_message_iter_next (&child);
-	if (res == FALSE) {
-		error = TRUE;
-		goto out;
+	dbus_message_unref (reply);
+
+	return TRUE;
+}
+
+/* How the reply of an asynchronous call is turned into the result
+ * handed to the _finish() function. */
+typedef struct {
+	GList *(*unmarshal) (DBusMessage *reply, guint *n_items);
+	GDestroyNotify free_result;
+
+	/* Called with the result before it is returned, or %NULL.
+	 * @folders_generation is the one of the client when the call
+	 * was sent. */
+	void (*store) (ModestDbusClient *client, guint folders_generation, GList *result);
+} ModestDbusReplyHandler;
+
+typedef struct {
+	ModestDbusClient *client;
+	ModestDbusClientMethod method;
+	DBusMessage      *msg;   /* kept to send it again if modest went away */
+	gint              timeout;
+	gint64            start;
+	guint             folders_generation;	/* when the call was made */
+	GTask            *task;
+
+	/* Our reference, dropped once the call is over */
+	DBusPendingCall  *pending;
+	gulong            cancelled_id;
+
+	/* Set by whichever of the notify function and the cancellation
+	 * idle runs first; the other one then does nothing */
+	volatile gint     completed;
+} ModestDbusAsyncCall;
+
+static void modest_dbus_async_call_send (ModestDbusAsyncCall *call);
+
+/* Tells modest to stop working on something, with @method taking its
+ * @id: CancelRequest the serial of a call, CancelSearchStream the id of
+ * a search. Modest versions without @method ignore it, as no reply is
+ * asked. */
+static void
+modest_dbus_client_send_cancel (ModestDbusClient *client, ModestDbusClientMethod method,
+				dbus_uint32_t id)
+{
+	DBusMessage *msg;
+
+	msg = modest_dbus_client_new_call (client, method);
+
+	if (msg == NULL) {
+		return;
 	}
 
-	/* folder URI:  */
-	arg_type = dbus_message_iter_get_arg_type (&child);
+	/* Not worth starting modest for */
+	dbus_message_set_auto_start (msg, FALSE);
 
-	if (arg_type != DBUS_TYPE_STRING) {
-		error = TRUE;
-		goto out;
+	if (!dbus_message_append_args (msg, DBUS_TYPE_UINT32, &id, DBUS_TYPE_INVALID)) {
+		dbus_message_unref (msg);
+		return;
 	}
 
-	item->folder_uri = _dbus_iter_get_string_or_null (&child);
+	dbus_message_set_no_reply (msg, TRUE);
 
+	if (client->connection) {
+		dbus_connection_send (client->connection, msg, NULL);
+	}
 
-out:
-	if (error) {
-		g_warning ("%s: Error during unmarshalling", __FUNCTION__);
-		modest_folder_result_free (item);
-		item = NULL;
+	dbus_message_unref (msg);
+}
+
+/* Stops following the cancellable of the task of @call. Must not be
+ * called from the cancelled handler, which would dead-lock. */
+static void
+modest_dbus_async_call_disconnect (ModestDbusAsyncCall *call)
+{
+	if (call->cancelled_id) {
+		g_cancellable_disconnect (g_task_get_cancellable (call->task),
+					  call->cancelled_id);
+		call->cancelled_id = 0;
 	}
+}
 
-	return item;
+/* Drops our reference to the pending call, which frees @call once
+ * libdbus, and the cancellation idle if any, are done with it. */
+static void
+modest_dbus_async_call_release (ModestDbusAsyncCall *call)
+{
+	dbus_pending_call_unref (call->pending);
 }
 
-/**
- * libmodest_dbus_client_get_folders:
- * @osso_ctx: A valid #osso_context_t object.
- * @folders: A pointer to a valid GList pointer that will contain the folder items
- * (ModestFolderResult). The list and the items must be freed by the caller 
- * with modest_folder_result_list_free().
- *
- * This method will obtain a list of folders in the default account.
- *
- * Upon success TRUE is returned and @folders will include the folders or the list
- * might be empty if there are no folders. The returned
- * list must be freed with modest_folder_result_list_free ().
- *
- * NOTE: A folder will only be retrieved if it was previously downloaded by
- * modest. This function does also not attempt do to remote refreshes (i.e. IMAP).
- * 
- * Return value: TRUE if the request succeded or FALSE for an error.
- **/
-gboolean
-libmodest_dbus_client_get_folders (osso_context_t          *osso_ctx,
-			      GList                  **folders)
+/* Returns %TRUE if the caller is the one completing the call */
+static gboolean
+modest_dbus_async_call_complete (ModestDbusAsyncCall *call)
 {
-	/* Initialize output argument: */
-	if (folders)
-		*folders = NULL;
-	else
-		return FALSE;
+	return g_atomic_int_compare_and_exchange (&call->completed, FALSE, TRUE);
+}
 
-	DBusConnection *con = osso_get_dbus_connection (osso_ctx);
+static gboolean
+on_async_call_cancelled_idle (gpointer user_data)
+{
+	ModestDbusAsyncCall *call = user_data;
+	DBusPendingCall *pending = call->pending;
 
-	if (con == NULL) {
-		g_warning ("Could not get dbus connection\n");
-		return FALSE;
+	/* Unless the reply was being handled when the call was cancelled */
+	if (modest_dbus_async_call_complete (call)) {
+		modest_dbus_async_call_disconnect (call);
+		modest_dbus_client_send_cancel (call->client,
+						MODEST_DBUS_CLIENT_METHOD_CANCEL_REQUEST,
+						dbus_message_get_serial (call->msg));
+
+		/* Reports the cancellation, without looking at any reply */
+		g_task_return_error_if_cancelled (call->task);
 
+		modest_dbus_async_call_release (call);
 	}
 
-	DBusMessage *msg = dbus_message_new_method_call (MODEST_DBUS_SERVICE,
-		MODEST_DBUS_OBJECT,
-		MODEST_DBUS_IFACE,
-		MODEST_DBUS_METHOD_GET_FOLDERS);
+	/* The reference of on_async_call_cancelled(); last, as it may
+	 * free @call */
+	dbus_pending_call_unref (pending);
+
+	return FALSE;
+}
+
+/* May be called from any thread, the one cancelling */
+static void
+on_async_call_cancelled (GCancellable *cancellable, gpointer user_data)
+{
+	ModestDbusAsyncCall *call = user_data;
+	GSource *source;
+
+	/* The notify function may already be running, in which case it
+	 * waits for this handler to return before releasing the call; the
+	 * idle keeps the call alive until it has run either way */
+	dbus_pending_call_ref (call->pending);
+	dbus_pending_call_cancel (call->pending);
+
+	source = g_idle_source_new ();
+	g_source_set_callback (source, on_async_call_cancelled_idle, call, NULL);
+	g_source_attach (source, g_task_get_context (call->task));
+	g_source_unref (source);
+}
 
-    if (msg == NULL) {
-       	//ULOG_ERR_F("dbus_message_new_method_call failed");
-		return OSSO_ERROR;
-    }
+static void
+modest_dbus_async_call_free (void *data)
+{
+	ModestDbusAsyncCall *call = data;
 
-	dbus_message_set_auto_start (msg, TRUE);
+	if (call->msg) {
+		dbus_message_unref (call->msg);
+	}
+	if (call->task) {
+		g_object_unref (call->task);
+	}
+	libmodest_dbus_client_unref (call->client);
+	g_slice_free (ModestDbusAsyncCall, call);
+}
 
-	/* Use a long timeout (2 minutes) because the search currently 
-	 * gets folders from the servers. */
-	gint timeout = 120000;
-	//osso_rpc_get_timeout (osso_ctx, &timeout);
+static void
+on_pending_call_notify (DBusPendingCall *pending, void *user_data)
+{
+	ModestDbusAsyncCall *call = user_data;
+	const ModestDbusReplyHandler *handler;
+	DBusMessage *reply;
+	DBusMessage *retry = NULL;
+	GError *error = NULL;
+
+	if (!modest_dbus_async_call_complete (call)) {
+		/* Cancelled meanwhile, and the idle already reported it */
+		return;
+	}
 
-  	DBusError err;
-  	dbus_error_init (&err);
-	DBusMessage *reply = dbus_connection_send_with_reply_and_block (con,
-							   msg, 
-							   timeout,
-							   &err);
+	handler = g_task_get_task_data (call->task);
+	reply = dbus_pending_call_steal_reply (pending);
 
-	dbus_message_unref (msg);
-	msg = NULL;
+	modest_dbus_async_call_disconnect (call);
 
 	if (reply == NULL) {
-		g_warning("%s: dbus_connection_send_with_reply_and_block() error:\n   %s", 
-			__FUNCTION__, err.message);
-		return FALSE;
-	}
+		MODEST_DBUS_STAT_ADD (call->client, call->method, failures, 1);
+		modest_dbus_client_log_event (call->client, call->method, MODEST_DBUS_EVENT_ERROR,
+					      0, call->start);
+		g_task_return_new_error (call->task, MODEST_DBUS_CLIENT_ERROR,
+					 MODEST_DBUS_CLIENT_ERROR_FAILED,
+					 "No reply received");
+	} else if (g_task_return_error_if_cancelled (call->task)) {
+		/* Cancelled after the reply was queued: do not decode it for nothing */
+	} else if ((retry = modest_dbus_client_handle_reply (call->client, call->msg, reply))) {
+		ModestDbusAsyncCall *again;
+
+		/* Hand the task over to a new call for the well-known name */
+		again = g_slice_new0 (ModestDbusAsyncCall);
+		again->client = libmodest_dbus_client_ref (call->client);
+		again->method = call->method;
+		again->msg = retry;
+		again->timeout = call->timeout;
+		again->folders_generation = call->folders_generation;
+		again->task = call->task;
+		call->task = NULL;
+
+		modest_dbus_async_call_send (again);
+	} else {
+		modest_dbus_client_record_reply (call->client, call->method, reply, call->start);
 
-	switch (dbus_message_get_type (reply)) {
+		if (modest_dbus_check_reply (reply, &error)) {
+			GList *result;
+			guint n_items;
 
-		case DBUS_MESSAGE_TYPE_ERROR:
-			dbus_set_error_from_message (&err, reply);
-			//XXX to GError?!
-			dbus_error_free (&err);
-			dbus_message_unref (reply);
-			return FALSE;
+			MODEST_DBUS_DECODE_START (call->method, reply);
+			result = handler->unmarshal (reply, &n_items);
+			MODEST_DBUS_DECODE_END (call->client, call->method, reply, n_items);
 
-		case DBUS_MESSAGE_TYPE_METHOD_RETURN:
-			/* ok we are good to go
-			 * lets drop outa here and handle that */
-			break;
-		default:
-			//ULOG_WARN_F("got unknown message type as reply");
-			//retval->type = DBUS_TYPE_STRING;
-			//retval->value.s = g_strdup("Invalid return value");
-			//XXX to GError?! 
-			dbus_message_unref (reply);
-			return FALSE;
+			if (handler->store) {
+				handler->store (call->client, call->folders_generation, result);
+			}
+
+			g_task_return_pointer (call->task, result, handler->free_result);
+		} else {
+			g_task_return_error (call->task, error);
+		}
 	}
 
-	g_debug ("%s: message return", __FUNCTION__);
+	if (reply) {
+		dbus_message_unref (reply);
+	}
 
-	DBusMessageIter iter;
-	dbus_message_iter_init (reply, &iter);
-	/* int arg_type = dbus_message_iter_get_arg_type (&iter); */
-	
-	DBusMessageIter child;
-	dbus_message_iter_recurse (&iter, &child);
+	/* Last, as it may free @call */
+	modest_dbus_async_call_release (call);
+}
 
-	do {
-		ModestFolderResult *item = modest_dbus_message_iter_get_folder_item (&child);
+/* Sends the message of @call, which is freed with the pending call. */
+static void
+modest_dbus_async_call_send (ModestDbusAsyncCall *call)
+{
+	GCancellable *cancellable = g_task_get_cancellable (call->task);
+	DBusPendingCall *pending = NULL;
 
-		if (item) {
-			*folders = g_list_append (*folders, item);	
-		}
+	if (g_task_return_error_if_cancelled (call->task)) {
+		modest_dbus_async_call_free (call);
+		return;
+	}
 
-	} while (dbus_message_iter_next (&child));
+	call->start = g_get_monotonic_time ();
+
+	if (call->client->connection == NULL ||
+	    !dbus_connection_send_with_reply (call->client->connection, call->msg,
+					      &pending, call->timeout) ||
+	    pending == NULL) {
+		g_task_return_new_error (call->task, MODEST_DBUS_CLIENT_ERROR,
+					 MODEST_DBUS_CLIENT_ERROR_FAILED,
+					 "dbus_connection_send_with_reply() failed");
+		MODEST_DBUS_STAT_ADD (call->client, call->method, failures, 1);
+		modest_dbus_client_log_event (call->client, call->method,
+					      MODEST_DBUS_EVENT_SEND_FAILED, 0, call->start);
+		modest_dbus_async_call_free (call);
+		return;
+	}
 
-	dbus_message_unref (reply);
+	MODEST_DBUS_PROBE_CALL_SEND (dbus_message_get_member (call->msg),
+				     dbus_message_get_serial (call->msg));
 
+	call->pending = pending;
+	dbus_pending_call_set_notify (pending, on_pending_call_notify,
+				      call, modest_dbus_async_call_free);
 
-	/* TODO: This is from osso source, do we need it? */
-#if 0
-	/* Tell TaskNavigator to show "launch banner" */
-	msg = dbus_message_new_method_call (TASK_NAV_SERVICE,
-					    APP_LAUNCH_BANNER_METHOD_PATH,
-					    APP_LAUNCH_BANNER_METHOD_INTERFACE,
-					    APP_LAUNCH_BANNER_METHOD);
+	if (cancellable) {
+		call->cancelled_id = g_cancellable_connect (cancellable,
+							    G_CALLBACK (on_async_call_cancelled),
+							    call, NULL);
+	}
+}
+
+/* Sends @msg without blocking, consuming the references to @msg and
+ * @task. The reply is unmarshalled by the handler stored as task data
+ * once it is dispatched by the main loop the connection is attached to. */
+static void
+modest_dbus_client_send_async (ModestDbusClient *client, ModestDbusClientMethod method,
+			       DBusMessage *msg, GTask *task)
+{
+	ModestDbusAsyncCall *call;
+	GError *error = NULL;
+
+	if (client == NULL) {
+		g_task_return_new_error (task, MODEST_DBUS_CLIENT_ERROR,
+					 MODEST_DBUS_CLIENT_ERROR_FAILED,
+					 "Could not get dbus connection");
+		g_object_unref (task);
+		if (msg) {
+			dbus_message_unref (msg);
+		}
+		return;
+	}
 
 	if (msg == NULL) {
-		g_warn ("dbus_message_new_method_call failed");
+		g_task_return_new_error (task, MODEST_DBUS_CLIENT_ERROR,
+					 MODEST_DBUS_CLIENT_ERROR_FAILED,
+					 "Could not create the method call");
+		g_object_unref (task);
+		return;
 	}
 
+	if (!modest_dbus_client_check_running (client, &error)) {
+		modest_dbus_client_log_event (client, method, MODEST_DBUS_EVENT_NOT_RUNNING, 0, 0);
+		g_task_return_error (task, error);
+		g_object_unref (task);
+		dbus_message_unref (msg);
+		return;
+	}
 
+	call = g_slice_new0 (ModestDbusAsyncCall);
+	call->client = libmodest_dbus_client_ref (client);
+	call->method = method;
+	call->msg = msg;
+	call->timeout = modest_dbus_client_get_timeout (client, method);
+	call->folders_generation = client->folders_generation;
+	call->task = task;
 
-	dbus_message_append_args (msg,
-				  DBUS_TYPE_STRING,
-				  &service,
-				  DBUS_TYPE_INVALID);
+	MODEST_DBUS_STAT_ADD (client, method, calls, 1);
 
-	b = dbus_connection_send (conn, msg, NULL);
+	modest_dbus_async_call_send (call);
+}
 
-	if (b == NULL) {
-		ULOG_WARN_F("dbus_connection_send failed");
+static gboolean
+modest_dbus_propagate_list (GAsyncResult *result, gpointer source_tag,
+			    GList **list, GError **error)
+{
+	GError *err = NULL;
+	GList *res;
+
+	g_return_val_if_fail (g_task_is_valid (result, NULL), FALSE);
+	g_return_val_if_fail (g_task_get_source_tag (G_TASK (result)) == source_tag, FALSE);
+	g_return_val_if_fail (list != NULL, FALSE);
+
+	res = g_task_propagate_pointer (G_TASK (result), &err);
+
+	if (err) {
+		g_propagate_error (error, err);
+		return FALSE;
 	}
 
-	dbus_message_unref (msg);
-#endif
+	*list = res;
 
 	return TRUE;
 }
 
+/**
+ * libmodest_dbus_client_mail_to:
+ * @osso_context: a valid #osso_context_t object.
+ * @mailto_uri: A mailto URI.
+ * 
+ * This function will try to do a remote procedure call (rpc)
+ * into modest (or start it if necessary) and open a composer
+ * window with the supplied parameters prefilled.
+ *
+ * Return value: Whether or not the rpc call to modest
+ * was successfull
+ **/
+gboolean 
+libmodest_dbus_client_mail_to (osso_context_t *osso_context, const gchar *mailto_uri)
+{
+	return modest_dbus_client_call_simple (modest_dbus_client_get (osso_context),
+					       MODEST_DBUS_CLIENT_METHOD_MAIL_TO, TRUE,
+					       DBUS_TYPE_STRING, mailto_uri,
+					       DBUS_TYPE_INVALID);
+}
 
+/**
+ * libmodest_dbus_client_compose_mail:
+ * @osso_context: a valid #osso_context_t object.
+ * @to: The Recipients (From: line)
+ * @cc: Recipients for carbon copies
+ * @bcc: Recipients for blind carbon copies
+ * @subject: Subject line
+ * @body: The actual body of the mail to compose.
+ * @attachments: Additional list of attachments. A list of URI strings.
+ * 
+ * This function will try to do a remote procedure call (rpc)
+ * into modest (or start it if necessary) and open a composer
+ * window with the supplied parameters prefilled.
+ *
+ * Return value: Whether or not the rpc call to modest
+ * was successfull
+ **/
+gboolean
+libmodest_dbus_client_compose_mail (osso_context_t *osso_context, const gchar *to, const gchar *cc, 
+	const gchar *bcc, const gchar* subject, const gchar* body, GSList *attachments)
+{
+	gboolean res;
+
+	gchar *attachments_str = get_attachments_string(attachments);
+
+	res = modest_dbus_client_call_simple (modest_dbus_client_get (osso_context),
+					      MODEST_DBUS_CLIENT_METHOD_COMPOSE_MAIL, TRUE,
+					      DBUS_TYPE_STRING, to, 
+					      DBUS_TYPE_STRING, cc, 
+					      DBUS_TYPE_STRING, bcc, 
+					      DBUS_TYPE_STRING, subject, 
+					      DBUS_TYPE_STRING, body,
+					      DBUS_TYPE_STRING, attachments_str,
+					      DBUS_TYPE_INVALID);
+
+	g_free (attachments_str);
+
+	return res;
+}
+
+/**
+ * libmodest_dbus_client_open_message:
+ * @osso_context: a valid #osso_context_t object.
+ * @msg_uri: A valid url to a mail
+ *
+ * This method will try to find the message supplied
+ * by @msg_uri and open it for display if found. 
+ * It will use remote procedure calls (rpc) over 
+ * dbus to do so.
+ *  
+ * Return value: TRUE on successs, FALSE on error
+ **/
+gboolean 
+libmodest_dbus_client_open_message (osso_context_t *osso_context, const gchar *mail_uri)
+{
+	return modest_dbus_client_call_simple (modest_dbus_client_get (osso_context),
+					       MODEST_DBUS_CLIENT_METHOD_OPEN_MESSAGE, TRUE,
+					       DBUS_TYPE_STRING, mail_uri,
+					       DBUS_TYPE_INVALID);
+}
+
+/* A request held back to be merged with the same ones that follow. It
+ * keeps the client alive until it is sent. */
+typedef struct {
+	ModestDbusClient       *client;
+	ModestDbusClientMethod  method;
+	gchar                  *key;
+	gchar                  *account;
+	gboolean                manual;
+	guint                   source_id;
+} ModestDbusCoalescedCall;
+
+static void
+modest_dbus_coalesced_call_free (ModestDbusCoalescedCall *call)
+{
+	if (call->source_id) {
+		g_source_remove (call->source_id);
+	}
+
+	libmodest_dbus_client_unref (call->client);
+	g_free (call->key);
+	g_free (call->account);
+	g_slice_free (ModestDbusCoalescedCall, call);
+}
+
+/* Sends a request of @method without waiting for modest. */
+static gboolean
+modest_dbus_client_call_no_reply (ModestDbusClient *client, ModestDbusClientMethod method,
+				  const gchar *account, gboolean manual)
+{
+	switch (method) {
+	case MODEST_DBUS_CLIENT_METHOD_SEND_RECEIVE_FULL:
+		return modest_dbus_client_call_simple (client, method, FALSE,
+						       DBUS_TYPE_STRING, account,
+						       DBUS_TYPE_BOOLEAN, manual,
+						       DBUS_TYPE_INVALID);
+	case MODEST_DBUS_CLIENT_METHOD_UPDATE_FOLDER_COUNTS:
+		return modest_dbus_client_call_simple (client, method, FALSE,
+						       DBUS_TYPE_STRING, account,
+						       DBUS_TYPE_INVALID);
+	default:
+		return modest_dbus_client_call_simple (client, method, FALSE,
+						       DBUS_TYPE_INVALID);
+	}
+}
+
+static void
+modest_dbus_coalesced_call_send (ModestDbusCoalescedCall *call)
+{
+	if (!modest_dbus_client_call_no_reply (call->client, call->method,
+					       call->account, call->manual)) {
+		g_warning ("%s: could not send a held back %s request", __FUNCTION__,
+			   method_names[call->method]);
+	}
+}
+
+static gboolean
+on_coalesce_window_end (gpointer user_data)
+{
+	ModestDbusCoalescedCall *call = user_data;
+	ModestDbusClient *client;
+
+	/* Removing @call may drop the last reference to the client */
+	client = libmodest_dbus_client_ref (call->client);
+
+	call->source_id = 0;
+	modest_dbus_coalesced_call_send (call);
+	g_hash_table_remove (client->coalesced, call->key);
+
+	libmodest_dbus_client_unref (client);
+
+	return FALSE;
+}
+
+static gboolean
+modest_dbus_coalesced_call_flush (gpointer key, gpointer value, gpointer user_data)
+{
+	modest_dbus_coalesced_call_send (value);
+
+	return TRUE;
+}
+
+/* Sends the requests held back at once */
+static void
+modest_dbus_client_flush_coalesced (ModestDbusClient *client)
+{
+	if (client->coalesced == NULL) {
+		return;
+	}
+
+	libmodest_dbus_client_ref (client);
+	g_hash_table_foreach_remove (client->coalesced, modest_dbus_coalesced_call_flush, NULL);
+	libmodest_dbus_client_unref (client);
+}
+
+/* Queues a request, merging it with a queued one for the same method
+ * and account. It is sent once the coalescing window has passed, or
+ * right away if there is none. */
+static gboolean
+modest_dbus_client_coalesce (ModestDbusClient *client, ModestDbusClientMethod method,
+			     const gchar *account, gboolean manual)
+{
+	ModestDbusCoalescedCall *call;
+	gchar *key;
+
+	g_return_val_if_fail (client != NULL, FALSE);
+
+	if (client->coalesce_window == 0) {
+		return modest_dbus_client_call_no_reply (client, method, account, manual);
+	}
+
+	/* NULL accounts are sent as empty strings */
+	key = g_strdup_printf ("%d:%s", method, account ? account : "");
+
+	if (client->coalesced == NULL) {
+		client->coalesced = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+							   (GDestroyNotify) modest_dbus_coalesced_call_free);
+	}
+
+	call = g_hash_table_lookup (client->coalesced, key);
+
+	if (call) {
+		/* A manual request must not wait for the heartbeat */
+		call->manual = call->manual || manual;
+		g_free (key);
+		return TRUE;
+	}
+
+	call = g_slice_new0 (ModestDbusCoalescedCall);
+	call->client = libmodest_dbus_client_ref (client);
+	call->method = method;
+	call->key = key;
+	call->account = g_strdup (account);
+	call->manual = manual;
+	call->source_id = g_timeout_add (client->coalesce_window, on_coalesce_window_end, call);
+	g_hash_table_insert (client->coalesced, call->key, call);
+
+	return TRUE;
+}
+
+/**
+ * libmodest_dbus_client_set_coalesce_window:
+ * @client: a #ModestDbusClient
+ * @window_ms: how long to hold requests back, in milliseconds, or 0
+ *
+ * Makes libmodest_dbus_client_send_and_receive_coalesced(),
+ * libmodest_dbus_client_send_and_receive_full_coalesced() and
+ * libmodest_dbus_client_update_folder_counts_coalesced() hold their
+ * request back for @window_ms milliseconds. The same requests made
+ * during that time, for the same account, are merged into it, so that
+ * modest does the work only once. If any of the merged send and receive
+ * requests is manual, the request sent is manual.
+ *
+ * Only those functions coalesce: the other ones, such as
+ * libmodest_dbus_client_send_and_receive(), always send their request
+ * right away and wait for modest, whatever the window.
+ *
+ * The default, 0, makes the _coalesced() functions send every request
+ * right away, without waiting for modest. Setting it back to 0 sends the
+ * requests held back at once.
+ **/
+void
+libmodest_dbus_client_set_coalesce_window (ModestDbusClient *client,
+					   guint             window_ms)
+{
+	g_return_if_fail (client != NULL);
+
+	client->coalesce_window = window_ms;
+
+	if (window_ms == 0) {
+		modest_dbus_client_flush_coalesced (client);
+	}
+}
+
+/**
+ * libmodest_dbus_client_send_and_receive_coalesced:
+ * @client: a #ModestDbusClient
+ *
+ * Like libmodest_dbus_client_send_and_receive(), but the request is held
+ * back and merged with the same ones, as set with
+ * libmodest_dbus_client_set_coalesce_window(). It returns as soon as the
+ * request is queued, like the _no_reply() functions, and the request is
+ * sent from the main loop; libmodest_dbus_client_flush() sends it at
+ * once. The request is sent even if @client is unreferenced meanwhile.
+ *
+ * Return value: Whether or not the request could be queued
+ **/
+gboolean
+libmodest_dbus_client_send_and_receive_coalesced (ModestDbusClient *client)
+{
+	return modest_dbus_client_coalesce (client, MODEST_DBUS_CLIENT_METHOD_SEND_RECEIVE,
+					    NULL, TRUE);
+}
+
+/**
+ * libmodest_dbus_client_send_and_receive_full_coalesced:
+ * @client: a #ModestDbusClient
+ * @account: the account to send and receive, as for
+ * libmodest_dbus_client_send_and_receive_full()
+ * @manual: whether the user asked for it
+ *
+ * Like libmodest_dbus_client_send_and_receive_coalesced(), for
+ * libmodest_dbus_client_send_and_receive_full().
+ *
+ * Return value: Whether or not the request could be queued
+ **/
+gboolean
+libmodest_dbus_client_send_and_receive_full_coalesced (ModestDbusClient *client,
+						       const gchar      *account,
+						       gboolean          manual)
+{
+	return modest_dbus_client_coalesce (client, MODEST_DBUS_CLIENT_METHOD_SEND_RECEIVE_FULL,
+					    account, manual);
+}
+
+/**
+ * libmodest_dbus_client_update_folder_counts_coalesced:
+ * @client: a #ModestDbusClient
+ * @account: the account whose folder counts to update
+ *
+ * Like libmodest_dbus_client_send_and_receive_coalesced(), for
+ * libmodest_dbus_client_update_folder_counts().
+ *
+ * Return value: Whether or not the request could be queued
+ **/
+gboolean
+libmodest_dbus_client_update_folder_counts_coalesced (ModestDbusClient *client,
+						      const gchar      *account)
+{
+	return modest_dbus_client_coalesce (client, MODEST_DBUS_CLIENT_METHOD_UPDATE_FOLDER_COUNTS,
+					    account, FALSE);
+}
+
+gboolean 
+libmodest_dbus_client_send_and_receive (osso_context_t *osso_context)
+{
+	return modest_dbus_client_call_simple (modest_dbus_client_get (osso_context),
+					       MODEST_DBUS_CLIENT_METHOD_SEND_RECEIVE, TRUE,
+					       DBUS_TYPE_INVALID);
+}
+
+gboolean 
+libmodest_dbus_client_send_and_receive_full (osso_context_t *osso_context, 
+					     const gchar *account, 
+					     gboolean manual)
+{
+	return modest_dbus_client_call_simple (modest_dbus_client_get (osso_context),
+					       MODEST_DBUS_CLIENT_METHOD_SEND_RECEIVE_FULL, TRUE,
+					       DBUS_TYPE_STRING, account,
+					       DBUS_TYPE_BOOLEAN, manual,
+					       DBUS_TYPE_INVALID);
+}
+
+gboolean 
+libmodest_dbus_client_update_folder_counts (osso_context_t *osso_context, 
+					    const gchar *account)
+{
+	return modest_dbus_client_call_simple (modest_dbus_client_get (osso_context),
+					       MODEST_DBUS_CLIENT_METHOD_UPDATE_FOLDER_COUNTS, TRUE,
+					       DBUS_TYPE_STRING, account,
+					       DBUS_TYPE_INVALID);
+}
+
+gboolean 
+libmodest_dbus_client_open_default_inbox (osso_context_t *osso_context)
+{
+	return modest_dbus_client_call_simple (modest_dbus_client_get (osso_context),
+					       MODEST_DBUS_CLIENT_METHOD_OPEN_DEFAULT_INBOX, TRUE,
+					       DBUS_TYPE_INVALID);
+}
+
+gboolean
+libmodest_dbus_client_open_account (osso_context_t *osso_context,
+				    const gchar *account_id)
+{
+	return modest_dbus_client_call_simple (modest_dbus_client_get (osso_context),
+					       MODEST_DBUS_CLIENT_METHOD_OPEN_ACCOUNT, TRUE,
+					       DBUS_TYPE_STRING, account_id,
+					       DBUS_TYPE_INVALID);
+}
+
+gboolean
+libmodest_dbus_client_open_edit_accounts_dialog (osso_context_t *osso_context)
+{
+	return modest_dbus_client_call_simple (modest_dbus_client_get (osso_context),
+					       MODEST_DBUS_CLIENT_METHOD_OPEN_EDIT_ACCOUNTS_DIALOG, TRUE,
+					       DBUS_TYPE_INVALID);
+}
+
+/**
+ * libmodest_dbus_client_delete_message:
+ * @osso_context: a valid #osso_context_t object.
+ * @msg_uri: A valid url to a mail 
+ *
+ * This method will try to find the message supplied
+ * by @msg_uri and if found delete it. It will use
+ * remote procedure calls (rpc) over dbus to do so.
+ * 
+ * Return value: TRUE on successs, FALSE on error
+ **/
+gboolean
+libmodest_dbus_client_delete_message (osso_context_t   *osso_ctx,
+				      const char       *msg_uri)
+{
+	return modest_dbus_client_call_simple (modest_dbus_client_get (osso_ctx),
+					       MODEST_DBUS_CLIENT_METHOD_DELETE_MESSAGE, TRUE,
+					       DBUS_TYPE_STRING, msg_uri,
+					       DBUS_TYPE_INVALID);
+}
+
+/* Turns @array into a list of its items, in the same order or reversed,
+ * and frees the array but not the items */
+static GList *
+modest_dbus_ptr_array_steal_list (GPtrArray *array, gboolean reversed)
+{
+	GList *list = NULL;
+	guint i;
+
+	if (reversed) {
+		for (i = 0; i < array->len; i++) {
+			list = g_list_prepend (list, g_ptr_array_index (array, i));
+		}
+	} else {
+		for (i = array->len; i > 0; i--) {
+			list = g_list_prepend (list, g_ptr_array_index (array, i - 1));
+		}
+	}
+
+	g_ptr_array_set_free_func (array, NULL);
+	g_ptr_array_free (array, TRUE);
+
+	return list;
+}
+
+void
+modest_search_hit_list_free (GList *hits)
+{
+	modest_dbus_free_search_hit_list (hits);
+}
+
+void
+modest_account_hits_list_free (GList *account_hits_list)
+{
+	modest_dbus_free_account_hits_list (account_hits_list);
+}
+
+static DBusMessage *
+modest_dbus_new_search_message (ModestDbusClient        *client,
+				ModestDbusClientMethod   method,
+				const gchar             *query,
+				const gchar             *folder,
+				time_t                   start_date,
+				time_t                   end_date,
+				guint32                  min_size,
+				ModestDBusSearchFlags    flags)
+{
+	DBusMessage *msg;
+	dbus_bool_t res;
+	dbus_int64_t sd_v;
+	dbus_int64_t ed_v;
+	dbus_int32_t flags_v;
+	dbus_uint32_t size_v;
+
+	msg = modest_dbus_client_new_call (client, method);
+
+	if (msg == NULL) {
+		return NULL;
+	}
+
+	if (folder == NULL) {
+		folder = "";
+	}
+
+	sd_v = (dbus_int64_t) start_date;
+	ed_v = (dbus_int64_t) end_date;
+	flags_v = (dbus_int32_t) flags;
+	size_v = (dbus_uint32_t) min_size;
+
+	res  = dbus_message_append_args (msg,
+					 DBUS_TYPE_STRING, &query,
+					 DBUS_TYPE_STRING, &folder,
+					 DBUS_TYPE_INT64, &sd_v,
+					 DBUS_TYPE_INT64, &ed_v,
+					 DBUS_TYPE_INT32, &flags_v,
+					 DBUS_TYPE_UINT32, &size_v,
+					 DBUS_TYPE_INVALID);
+
+	if (!res) {
+		dbus_message_unref (msg);
+		return NULL;
+	}
+
+	return msg;
+}
+
+/* Sends a search and waits for the reply; %NULL on error */
+static DBusMessage *
+modest_dbus_client_search_and_block (ModestDbusClient        *client,
+				     const gchar             *query,
+				     const gchar             *folder,
+				     time_t                   start_date,
+				     time_t                   end_date,
+				     guint32                  min_size,
+				     ModestDBusSearchFlags    flags)
+{
+	DBusMessage *msg;
+
+	if (query == NULL) {
+		return NULL;
+	}
+
+	msg = modest_dbus_new_search_message (client,
+					      MODEST_DBUS_CLIENT_METHOD_SEARCH,
+					      query, folder, start_date,
+					      end_date, min_size, flags);
+
+	if (msg == NULL) {
+		return NULL;
+	}
+
+	return modest_dbus_client_send_and_block (client, MODEST_DBUS_CLIENT_METHOD_SEARCH,
+						  msg, NULL);
+}
+
+GPtrArray *
+modest_dbus_message_get_search_hit_array (DBusMessage *reply)
+{
+	DBusMessageIter iter;
+
+	if (!modest_dbus_message_is_search_hit_list (reply)) {
+		g_warning ("%s: Error during unmarshalling", __FUNCTION__);
+		return NULL;
+	}
+
+	dbus_message_iter_init (reply, &iter);
+
+	return modest_dbus_read_search_hit_ptr_array (&iter);
+}
+
+GList *
+modest_dbus_message_get_search_hits (DBusMessage *reply, guint *n_items)
+{
+	GPtrArray *hits = modest_dbus_message_get_search_hit_array (reply);
+
+	if (n_items) {
+		*n_items = hits ? hits->len : 0;
+	}
+
+	/* In reverse order, as this always returned them */
+	return hits ? modest_dbus_ptr_array_steal_list (hits, TRUE) : NULL;
+}
+
+/* A #ModestSearchHitSet, with the arena holding the hits */
+typedef struct {
+	ModestSearchHitSet set;
+	ModestDbusArena    arena;
+} ModestDbusSearchHitSet;
+
+ModestSearchHitSet *
+modest_dbus_message_get_search_hit_set (DBusMessage *reply, ModestDbusInternMode intern_mode)
+{
+	ModestDbusSearchHitSet *real;
+	DBusMessageIter iter;
+
+	if (!modest_dbus_message_is_search_hit_list (reply)) {
+		g_warning ("%s: Error during unmarshalling", __FUNCTION__);
+		return NULL;
+	}
+
+	real = g_slice_new (ModestDbusSearchHitSet);
+	modest_dbus_arena_init (&real->arena, intern_mode);
+
+	dbus_message_iter_init (reply, &iter);
+	real->set.hits = modest_dbus_read_search_hit_array_in (&iter, &real->arena,
+							       &real->set.n_hits);
+
+	return &real->set;
+}
+
+/* The columns of a SearchFields reply, in the order modest sends them */
+typedef struct {
+	ModestDBusSearchFields field;
+	int                    type;
+	gboolean               shared;
+	gsize                  offset;
+} ModestDbusSearchHitColumn;
+
+static const ModestDbusSearchHitColumn search_hit_columns[] = {
+	{ MODEST_DBUS_SEARCH_FIELD_MSGID, DBUS_TYPE_STRING, FALSE,
+	  G_STRUCT_OFFSET (ModestSearchHit, msgid) },
+	{ MODEST_DBUS_SEARCH_FIELD_SUBJECT, DBUS_TYPE_STRING, FALSE,
+	  G_STRUCT_OFFSET (ModestSearchHit, subject) },
+	{ MODEST_DBUS_SEARCH_FIELD_FOLDER, DBUS_TYPE_STRING, TRUE,
+	  G_STRUCT_OFFSET (ModestSearchHit, folder) },
+	{ MODEST_DBUS_SEARCH_FIELD_SENDER, DBUS_TYPE_STRING, TRUE,
+	  G_STRUCT_OFFSET (ModestSearchHit, sender) },
+	{ MODEST_DBUS_SEARCH_FIELD_SIZE, DBUS_TYPE_UINT64, FALSE,
+	  G_STRUCT_OFFSET (ModestSearchHit, msize) },
+	{ MODEST_DBUS_SEARCH_FIELD_HAS_ATTACHMENT, DBUS_TYPE_BOOLEAN, FALSE,
+	  G_STRUCT_OFFSET (ModestSearchHit, has_attachment) },
+	{ MODEST_DBUS_SEARCH_FIELD_IS_UNREAD, DBUS_TYPE_BOOLEAN, FALSE,
+	  G_STRUCT_OFFSET (ModestSearchHit, is_unread) },
+	{ MODEST_DBUS_SEARCH_FIELD_TIMESTAMP, DBUS_TYPE_INT64, FALSE,
+	  G_STRUCT_OFFSET (ModestSearchHit, timestamp) }
+};
+
+/* Writes the signature of a SearchFields reply with @fields, "" for none,
+ * into @signature, which has room for all the columns */
+static void
+modest_dbus_search_fields_signature (ModestDBusSearchFields fields, gchar *signature)
+{
+	guint i;
+
+	for (i = 0; i < G_N_ELEMENTS (search_hit_columns); i++) {
+		if (fields & search_hit_columns[i].field) {
+			*signature++ = DBUS_TYPE_ARRAY;
+			*signature++ = search_hit_columns[i].type;
+		}
+	}
+
+	*signature = '\0';
+}
+
+/* How many values the column @array has */
+static guint
+modest_dbus_count_column (DBusMessageIter *array)
+{
+	DBusMessageIter items;
+	guint n_items = 0;
+
+	dbus_message_iter_recurse (array, &items);
+
+	if (dbus_type_is_fixed (dbus_message_iter_get_element_type (array))) {
+		const void *values;
+		int n_values;
+
+		dbus_message_iter_get_fixed_array (&items, &values, &n_values);
+		return n_values;
+	}
+
+	while (dbus_message_iter_get_arg_type (&items) != DBUS_TYPE_INVALID) {
+		n_items++;
+		dbus_message_iter_next (&items);
+	}
+
+	return n_items;
+}
+
+/* Reads @column from @array into the @n_hits first @hits; FALSE if it
+ * does not have as many values */
+static gboolean
+modest_dbus_read_search_hit_column (DBusMessageIter                 *array,
+				    const ModestDbusSearchHitColumn *column,
+				    ModestSearchHit                 *hits,
+				    guint                            n_hits,
+				    ModestDbusArena                 *arena)
+{
+	DBusMessageIter items;
+	const void *values;
+	int n_values;
+	guint i;
+
+	dbus_message_iter_recurse (array, &items);
+
+	if (column->type == DBUS_TYPE_STRING) {
+		for (i = 0; i < n_hits; i++) {
+			gchar **dest = G_STRUCT_MEMBER_P (&hits[i], column->offset);
+
+			if (dbus_message_iter_get_arg_type (&items) != DBUS_TYPE_STRING) {
+				return FALSE;
+			}
+
+			if (column->shared) {
+				MODEST_DBUS_READ_IN_SHARED_STRING (&items, *dest, arena);
+			} else {
+				MODEST_DBUS_READ_IN_STRING (&items, *dest, arena);
+			}
+			dbus_message_iter_next (&items);
+		}
+
+		return dbus_message_iter_get_arg_type (&items) == DBUS_TYPE_INVALID;
+	}
+
+	/* The other columns are read in one go */
+	dbus_message_iter_get_fixed_array (&items, &values, &n_values);
+	if ((guint) n_values != n_hits) {
+		return FALSE;
+	}
+
+	switch (column->type) {
+	case DBUS_TYPE_UINT64:
+		for (i = 0; i < n_hits; i++) {
+			G_STRUCT_MEMBER (guint64, &hits[i], column->offset) =
+				((const dbus_uint64_t *) values)[i];
+		}
+		break;
+	case DBUS_TYPE_INT64:
+		for (i = 0; i < n_hits; i++) {
+			G_STRUCT_MEMBER (gint64, &hits[i], column->offset) =
+				((const dbus_int64_t *) values)[i];
+		}
+		break;
+	case DBUS_TYPE_BOOLEAN:
+		for (i = 0; i < n_hits; i++) {
+			G_STRUCT_MEMBER (gboolean, &hits[i], column->offset) =
+				((const dbus_bool_t *) values)[i] != FALSE;
+		}
+		break;
+	default:
+		g_assert_not_reached ();
+	}
+
+	return TRUE;
+}
+
+ModestSearchHitSet *
+modest_dbus_message_get_search_hit_columns (DBusMessage            *reply,
+					    ModestDBusSearchFields  fields,
+					    ModestDbusInternMode    intern_mode)
+{
+	gchar signature[2 * G_N_ELEMENTS (search_hit_columns) + 1];
+	ModestDbusSearchHitSet *real;
+	DBusMessageIter iter;
+	guint i;
+
+	modest_dbus_search_fields_signature (fields, signature);
+
+	if (signature[0] == '\0' || !dbus_message_has_signature (reply, signature)) {
+		g_warning ("%s: Error during unmarshalling", __FUNCTION__);
+		return NULL;
+	}
+
+	real = g_slice_new (ModestDbusSearchHitSet);
+	modest_dbus_arena_init (&real->arena, intern_mode);
+
+	dbus_message_iter_init (reply, &iter);
+	real->set.n_hits = modest_dbus_count_column (&iter);
+	real->set.hits = modest_dbus_arena_alloc (&real->arena,
+						  real->set.n_hits * sizeof (ModestSearchHit));
+	if (real->set.n_hits > 0) {
+		memset (real->set.hits, 0, real->set.n_hits * sizeof (ModestSearchHit));
+	}
+
+	for (i = 0; i < G_N_ELEMENTS (search_hit_columns); i++) {
+		if (!(fields & search_hit_columns[i].field)) {
+			continue;
+		}
+
+		if (!modest_dbus_read_search_hit_column (&iter, &search_hit_columns[i],
+							 real->set.hits, real->set.n_hits,
+							 &real->arena)) {
+			g_warning ("%s: Columns of different lengths", __FUNCTION__);
+			modest_search_hit_set_free (&real->set);
+			return NULL;
+		}
+
+		dbus_message_iter_next (&iter);
+	}
+
+	return &real->set;
+}
+
+/* A #ModestSearchHitView, with the reply its strings point into */
+typedef struct {
+	ModestSearchHitView view;
+	ModestDbusArena     arena;
+	DBusMessage        *reply;
+} ModestDbusSearchHitView;
+
+ModestSearchHitView *
+modest_dbus_message_get_search_hit_view (DBusMessage *reply)
+{
+	ModestDbusSearchHitView *real;
+	DBusMessageIter iter;
+
+	if (!modest_dbus_message_is_search_hit_list (reply)) {
+		g_warning ("%s: Error during unmarshalling", __FUNCTION__);
+		return NULL;
+	}
+
+	real = g_slice_new (ModestDbusSearchHitView);
+	modest_dbus_arena_init (&real->arena, MODEST_DBUS_INTERN_NONE);
+	real->arena.borrow_strings = TRUE;
+	real->reply = dbus_message_ref (reply);
+
+	dbus_message_iter_init (reply, &iter);
+	real->view.hits = modest_dbus_read_search_hit_array_in (&iter, &real->arena,
+								&real->view.n_hits);
+
+	return &real->view;
+}
+
+/**
+ * modest_search_hit_view_free:
+ * @hits: a #ModestSearchHitView, or %NULL
+ *
+ * Frees @hits, and releases the reply its strings point into.
+ **/
+void
+modest_search_hit_view_free (ModestSearchHitView *hits)
+{
+	ModestDbusSearchHitView *real = (ModestDbusSearchHitView *) hits;
+
+	if (real == NULL) {
+		return;
+	}
+
+	modest_dbus_arena_clear (&real->arena);
+	dbus_message_unref (real->reply);
+	g_slice_free (ModestDbusSearchHitView, real);
+}
+
+/**
+ * libmodest_dbus_client_set_intern_mode:
+ * @client: a #ModestDbusClient
+ * @intern_mode: how to store the repeated strings of the sets
+ *
+ * Sets how the #ModestSearchHitSet and #ModestAccountHitsSet returned
+ * through @client store the strings that repeat across their items: the
+ * folder and sender of the hits, and the store protocol of the accounts.
+ *
+ * With %MODEST_DBUS_INTERN_RESULT, equal strings share one copy within a
+ * set, which saves memory and lets them be compared by pointer.
+ * %MODEST_DBUS_INTERN_PROCESS shares them across all the sets, with
+ * g_intern_string(); as interned strings are never freed, this is only
+ * worth it when they take few values, as folder names usually do.
+ **/
+void
+libmodest_dbus_client_set_intern_mode (ModestDbusClient     *client,
+				       ModestDbusInternMode  intern_mode)
+{
+	g_return_if_fail (client != NULL);
+
+	client->intern_mode = intern_mode;
+}
+
+/**
+ * modest_search_hit_set_free:
+ * @hits: a #ModestSearchHitSet, or %NULL
+ *
+ * Frees @hits, with all its hits and their strings.
+ **/
+void
+modest_search_hit_set_free (ModestSearchHitSet *hits)
+{
+	ModestDbusSearchHitSet *real = (ModestDbusSearchHitSet *) hits;
+
+	if (real == NULL) {
+		return;
+	}
+
+	modest_dbus_arena_clear (&real->arena);
+	g_slice_free (ModestDbusSearchHitSet, real);
+}
+
+static const ModestDbusReplyHandler search_reply_handler = {
+	modest_dbus_message_get_search_hits,
+	(GDestroyNotify) modest_search_hit_list_free,
+	NULL
+};
+
+/**
+ * libmodest_dbus_client_search:
+ * @osso_ctx: A valid #osso_context_t object.
+ * @query: The term to search for.
+ * @folder: An url to specific folder or %NULL to search everywhere.
+ * @start_date: Search hits before this date will be ignored.
+ * @end_date: Search hits after this date will be ignored.
+ * @min_size: Messagers smaller then this size will be ingored.
+ * @flags: A list of flags where to search so the documentation 
+ * of %ModestDBusSearchFlags for details.
+ * @hits: A pointer to a valid GList pointer that will contain the search
+ * hits (ModestSearchHit). The list and the items must be freed by the caller 
+ * with modest_search_hit_list_free().
+ *
+ * This method will search the folder specified by a valid url in @folder or all
+ * known accounts (local and remote) if %NULL for matches of the search term(s)
+ * specified in @query. It is legal to specify 0 in @start_date, @end_date and
+ * @min_size to ignore these parameters during the search otherwise those message
+ * that do not meet the specifed dates or size will be ignored.
+ * Where to search, be it subject, sender or the whole body can be specified by
+ * the @flags parameter.
+ *
+ * Upon success TRUE is returned and @hits will include the search hits or the list
+ * migh be empty if none of the messages matched the search criteria. The returned
+ * list must be freed with modest_search_hit_list_free (). It is save to pass
+ * %NULL to this function so you can call this function on the result list no matter
+ * if a hit was found or not (means the list is empty - i.e. %NULL)
+ * FALSE will only be return if an error during the remote procedure call (rpc) 
+ * occured or if the specified folder could not be found.
+ *
+ * NOTE: The body of a message can only be searched if it was previously downloaded by
+ * modest. This function does also not attempt do to remote searches (i.e. IMAP search).
+ *
+ * Example to search every account for message containing "no":
+ * <informalexample><programlisting>
+ * ModestDBusSearchFlags  flags;
+ * osso_context_t        *osso_context;
+ * GList                 *hits;
+ * GList                 *iter;
+ * gboolean               res;
+ * 
+ * [...] Initialize osso context [...]
+ *
+ * res = libmodest_dbus_client_search (osso_context,
+ *				       "no",
+ *				       NULL,
+ *				       0,
+ *				       0,
+ *				       0,
+ *				       flags,
+ *				       &hits);
+ * 
+ * for (iter = hits; iter; iter = iter->next) {
+ *	ModestSearchHit *hit = (ModestSearchHit *) iter->data;
+ *   	
+ *   	[...] Do something with the hit [...]
+ *
+ *	}
+ *
+ *	modest_search_hit_list_free (hits);
+ * </programlisting></informalexample>
+ * 
+ * Return value: TRUE if the search succeded or FALSE for an error during the search
+ **/
+gboolean
+libmodest_dbus_client_search (osso_context_t          *osso_ctx,
+			      const gchar             *query,
+			      const gchar             *folder,
+			      time_t		       start_date,
+			      time_t 		       end_date,
+			      guint32                  min_size,
+			      ModestDBusSearchFlags    flags,
+			      GList                  **hits)
+{
+	ModestDbusClient *client;
+	DBusMessage *reply;
+	guint n_hits;
+
+	client = modest_dbus_client_get (osso_ctx);
+	reply = modest_dbus_client_search_and_block (client, query, folder, start_date,
+						     end_date, min_size, flags);
+
+	if (reply == NULL) {
+		return FALSE;
+	}
+
+	g_debug ("%s: message return", __FUNCTION__);
+
+	MODEST_DBUS_DECODE_START (MODEST_DBUS_CLIENT_METHOD_SEARCH, reply);
+	*hits = modest_dbus_message_get_search_hits (reply, &n_hits);
+	MODEST_DBUS_DECODE_END (client, MODEST_DBUS_CLIENT_METHOD_SEARCH, reply, n_hits);
+
+	dbus_message_unref (reply);
+
+
+	/* TODO: This is from osso source, do we need it? */
+#if 0
+	/* Tell TaskNavigator to show "launch banner" */
+	msg = dbus_message_new_method_call (TASK_NAV_SERVICE,
+					    APP_LAUNCH_BANNER_METHOD_PATH,
+					    APP_LAUNCH_BANNER_METHOD_INTERFACE,
+					    APP_LAUNCH_BANNER_METHOD);
+
+	if (msg == NULL) {
+		g_warn ("dbus_message_new_method_call failed");
+	}
+
+
+
+	dbus_message_append_args (msg,
+				  DBUS_TYPE_STRING,
+				  &service,
+				  DBUS_TYPE_INVALID);
+
+	b = dbus_connection_send (conn, msg, NULL);
+
+	if (b == NULL) {
+		ULOG_WARN_F("dbus_connection_send failed");
+	}
+
+	dbus_message_unref (msg);
+#endif
+
+	return TRUE;
+}
+
+/**
+ * libmodest_dbus_client_search_array:
+ * @osso_ctx: A valid #osso_context_t object.
+ * @query: The term to search for.
+ * @folder: An url to specific folder or %NULL to search everywhere.
+ * @start_date: Search hits before this date will be ignored.
+ * @end_date: Search hits after this date will be ignored.
+ * @min_size: Messagers smaller then this size will be ingored.
+ * @flags: A list of flags where to search.
+ * @hits: Return location for a #GPtrArray of #ModestSearchHit, which
+ * frees the hits too. Free with g_ptr_array_unref().
+ *
+ * Searches like libmodest_dbus_client_search(), with the hits in the
+ * order modest sent them, and indexed in constant time.
+ *
+ * Return value: TRUE if the search succeded or FALSE for an error during the search
+ **/
+gboolean
+libmodest_dbus_client_search_array (osso_context_t          *osso_ctx,
+				    const gchar             *query,
+				    const gchar             *folder,
+				    time_t                   start_date,
+				    time_t                   end_date,
+				    guint32                  min_size,
+				    ModestDBusSearchFlags    flags,
+				    GPtrArray              **hits)
+{
+	ModestDbusClient *client;
+	DBusMessage *reply;
+
+	client = modest_dbus_client_get (osso_ctx);
+	reply = modest_dbus_client_search_and_block (client, query, folder, start_date,
+						     end_date, min_size, flags);
+
+	if (reply == NULL) {
+		return FALSE;
+	}
+
+	MODEST_DBUS_DECODE_START (MODEST_DBUS_CLIENT_METHOD_SEARCH, reply);
+	*hits = modest_dbus_message_get_search_hit_array (reply);
+	MODEST_DBUS_DECODE_END (client, MODEST_DBUS_CLIENT_METHOD_SEARCH, reply,
+				*hits ? (*hits)->len : 0);
+
+	dbus_message_unref (reply);
+
+	return *hits != NULL;
+}
+
+/**
+ * libmodest_dbus_client_search_set:
+ * @osso_ctx: A valid #osso_context_t object.
+ * @query: The term to search for.
+ * @folder: An url to specific folder or %NULL to search everywhere.
+ * @start_date: Search hits before this date will be ignored.
+ * @end_date: Search hits after this date will be ignored.
+ * @min_size: Messagers smaller then this size will be ingored.
+ * @flags: A list of flags where to search.
+ * @hits: Return location for the hits, to free with modest_search_hit_set_free().
+ *
+ * Searches like libmodest_dbus_client_search(), but all the hits and
+ * their strings are allocated in a few large blocks instead of one by
+ * one, and are kept in the order modest sent them. For large results
+ * this is much cheaper to build and to free, and fragments the heap
+ * less.
+ *
+ * Return value: TRUE if the search succeded or FALSE for an error during the search
+ **/
+gboolean
+libmodest_dbus_client_search_set (osso_context_t          *osso_ctx,
+				  const gchar             *query,
+				  const gchar             *folder,
+				  time_t                   start_date,
+				  time_t                   end_date,
+				  guint32                  min_size,
+				  ModestDBusSearchFlags    flags,
+				  ModestSearchHitSet     **hits)
+{
+	ModestDbusClient *client;
+	DBusMessage *reply;
+
+	client = modest_dbus_client_get (osso_ctx);
+	reply = modest_dbus_client_search_and_block (client, query, folder, start_date,
+						     end_date, min_size, flags);
+
+	if (reply == NULL) {
+		return FALSE;
+	}
+
+	MODEST_DBUS_DECODE_START (MODEST_DBUS_CLIENT_METHOD_SEARCH, reply);
+	*hits = modest_dbus_message_get_search_hit_set (reply, client->intern_mode);
+	MODEST_DBUS_DECODE_END (client, MODEST_DBUS_CLIENT_METHOD_SEARCH, reply,
+				*hits ? (*hits)->n_hits : 0);
+
+	dbus_message_unref (reply);
+
+	return *hits != NULL;
+}
+
+/**
+ * libmodest_dbus_client_search_fields:
+ * @osso_ctx: A valid #osso_context_t object.
+ * @query: The term to search for.
+ * @folder: An url to specific folder or %NULL to search everywhere.
+ * @start_date: Search hits before this date will be ignored.
+ * @end_date: Search hits after this date will be ignored.
+ * @min_size: Messagers smaller then this size will be ingored.
+ * @flags: A list of flags where to search.
+ * @fields: The fields of the hits to get.
+ * @hits: Return location for the hits, to free with modest_search_hit_set_free().
+ *
+ * Searches like libmodest_dbus_client_search_set(), but modest only sends
+ * @fields of the hits, the others being %NULL or 0; for instance only
+ * the msgid and the timestamp. The reply comes as one array per field,
+ * so what goes over the bus and the time to decode it shrink with the
+ * fields left out, and the numbers and flags are read in one go.
+ *
+ * With a modest that cannot leave fields out, all the fields of the hits
+ * are got.
+ *
+ * Return value: TRUE if the search succeded or FALSE for an error during the search
+ **/
+gboolean
+libmodest_dbus_client_search_fields (osso_context_t          *osso_ctx,
+				     const gchar             *query,
+				     const gchar             *folder,
+				     time_t                   start_date,
+				     time_t                   end_date,
+				     guint32                  min_size,
+				     ModestDBusSearchFlags    flags,
+				     ModestDBusSearchFields   fields,
+				     ModestSearchHitSet     **hits)
+{
+	ModestDbusClient *client;
+	DBusMessage *msg;
+	DBusMessage *reply;
+	dbus_uint32_t fields_v;
+	GError *error = NULL;
+
+	fields &= MODEST_DBUS_SEARCH_FIELD_ALL;
+	fields_v = fields;
+
+	if (query == NULL || fields == 0) {
+		return FALSE;
+	}
+
+	client = modest_dbus_client_get (osso_ctx);
+	msg = modest_dbus_new_search_message (client,
+					      MODEST_DBUS_CLIENT_METHOD_SEARCH_FIELDS,
+					      query, folder, start_date,
+					      end_date, min_size, flags);
+
+	if (msg == NULL) {
+		return FALSE;
+	}
+
+	if (!dbus_message_append_args (msg, DBUS_TYPE_UINT32, &fields_v, DBUS_TYPE_INVALID)) {
+		dbus_message_unref (msg);
+		return FALSE;
+	}
+
+	reply = modest_dbus_client_send_and_block (client, MODEST_DBUS_CLIENT_METHOD_SEARCH_FIELDS,
+						   msg, &error);
+
+	if (reply == NULL) {
+		gboolean res = FALSE;
+
+		/* This modest always sends all the fields */
+		if (g_error_matches (error, MODEST_DBUS_CLIENT_ERROR,
+				     MODEST_DBUS_CLIENT_ERROR_UNKNOWN_METHOD)) {
+			res = libmodest_dbus_client_search_set (osso_ctx, query, folder, start_date,
+								end_date, min_size, flags, hits);
+		}
+
+		g_clear_error (&error);
+		return res;
+	}
+
+	MODEST_DBUS_DECODE_START (MODEST_DBUS_CLIENT_METHOD_SEARCH_FIELDS, reply);
+	*hits = modest_dbus_message_get_search_hit_columns (reply, fields, client->intern_mode);
+	MODEST_DBUS_DECODE_END (client, MODEST_DBUS_CLIENT_METHOD_SEARCH_FIELDS, reply,
+				*hits ? (*hits)->n_hits : 0);
+
+	dbus_message_unref (reply);
+
+	return *hits != NULL;
+}
+
+/**
+ * libmodest_dbus_client_search_view:
+ * @osso_ctx: A valid #osso_context_t object.
+ * @query: The term to search for.
+ * @folder: An url to specific folder or %NULL to search everywhere.
+ * @start_date: Search hits before this date will be ignored.
+ * @end_date: Search hits after this date will be ignored.
+ * @min_size: Messagers smaller then this size will be ingored.
+ * @flags: A list of flags where to search.
+ * @hits: Return location for the hits, to free with modest_search_hit_view_free().
+ *
+ * Searches like libmodest_dbus_client_search(), but without copying any
+ * string: the strings of the hits point into the reply of modest, which
+ * is kept until the view is freed. Building the view takes a single
+ * array of hits, so this suits callers that only look at the hits for a
+ * short while, such as to show the first ones; the hits must be copied to
+ * be kept longer.
+ *
+ * Return value: TRUE if the search succeded or FALSE for an error during the search
+ **/
+gboolean
+libmodest_dbus_client_search_view (osso_context_t          *osso_ctx,
+				   const gchar             *query,
+				   const gchar             *folder,
+				   time_t                   start_date,
+				   time_t                   end_date,
+				   guint32                  min_size,
+				   ModestDBusSearchFlags    flags,
+				   ModestSearchHitView    **hits)
+{
+	ModestDbusClient *client;
+	DBusMessage *reply;
+
+	client = modest_dbus_client_get (osso_ctx);
+	reply = modest_dbus_client_search_and_block (client, query, folder, start_date,
+						     end_date, min_size, flags);
+
+	if (reply == NULL) {
+		return FALSE;
+	}
+
+	MODEST_DBUS_DECODE_START (MODEST_DBUS_CLIENT_METHOD_SEARCH, reply);
+	*hits = modest_dbus_message_get_search_hit_view (reply);
+	MODEST_DBUS_DECODE_END (client, MODEST_DBUS_CLIENT_METHOD_SEARCH, reply,
+				*hits ? (*hits)->n_hits : 0);
+
+	dbus_message_unref (reply);
+
+	return *hits != NULL;
+}
+
+/* The order asked to libmodest_dbus_client_search_top() */
+typedef struct {
+	ModestDBusSearchSortKey sort_key;
+	gboolean                descending;
+} ModestDbusSearchOrder;
+
+/* Negative if @a comes before @b in @order, positive if after */
+static gint
+modest_dbus_search_order_compare (const ModestDbusSearchOrder *order,
+				  const ModestSearchHit       *a,
+				  const ModestSearchHit       *b)
+{
+	gint res;
+
+	if (order->sort_key == MODEST_DBUS_SEARCH_SORT_SIZE) {
+		res = (a->msize > b->msize) - (a->msize < b->msize);
+	} else {
+		res = (a->timestamp > b->timestamp) - (a->timestamp < b->timestamp);
+	}
+
+	return order->descending ? -res : res;
+}
+
+static gint
+modest_dbus_search_order_compare_ptrs (gconstpointer a, gconstpointer b, gpointer order)
+{
+	return modest_dbus_search_order_compare (order,
+						 *(ModestSearchHit * const *) a,
+						 *(ModestSearchHit * const *) b);
+}
+
+/* Restores the heap property below @i in the @n first hits, where every
+ * hit comes after its children in @order */
+static void
+modest_dbus_search_heap_sift_down (gpointer *heap, guint n, guint i,
+				   const ModestDbusSearchOrder *order)
+{
+	while (2 * i + 1 < n) {
+		guint child = 2 * i + 1;
+		gpointer tmp;
+
+		if (child + 1 < n &&
+		    modest_dbus_search_order_compare (order, heap[child + 1], heap[child]) > 0) {
+			child++;
+		}
+
+		if (modest_dbus_search_order_compare (order, heap[child], heap[i]) <= 0) {
+			break;
+		}
+
+		tmp = heap[i];
+		heap[i] = heap[child];
+		heap[child] = tmp;
+		i = child;
+	}
+}
+
+/* Keeps the @max_hits first hits of @hits in @order, sorted, and frees
+ * the others. The candidates are kept in a bounded heap whose root is the
+ * last of them, so this takes O(n log @max_hits). */
+static void
+modest_dbus_search_hits_select_top (GPtrArray                   *hits,
+				    const ModestDbusSearchOrder *order,
+				    guint                        max_hits)
+{
+	gpointer *heap = hits->pdata;
+	guint n_kept = MIN (max_hits, hits->len);
+	guint i;
+
+	for (i = n_kept / 2; i > 0; i--) {
+		modest_dbus_search_heap_sift_down (heap, n_kept, i - 1, order);
+	}
+
+	for (i = n_kept; i < hits->len; i++) {
+		if (n_kept > 0 && modest_dbus_search_order_compare (order, heap[i], heap[0]) < 0) {
+			gpointer tmp = heap[0];
+
+			heap[0] = heap[i];
+			heap[i] = tmp;
+			modest_dbus_search_heap_sift_down (heap, n_kept, 0, order);
+		}
+	}
+
+	/* Frees the hits left out */
+	g_ptr_array_set_size (hits, n_kept);
+	g_ptr_array_sort_with_data (hits, modest_dbus_search_order_compare_ptrs, (gpointer) order);
+}
+
+/**
+ * libmodest_dbus_client_search_top:
+ * @osso_ctx: A valid #osso_context_t object.
+ * @query: The term to search for.
+ * @folder: An url to specific folder or %NULL to search everywhere.
+ * @start_date: Search hits before this date will be ignored.
+ * @end_date: Search hits after this date will be ignored.
+ * @min_size: Messagers smaller then this size will be ingored.
+ * @flags: A list of flags where to search.
+ * @sort_key: What to sort the hits on.
+ * @descending: Whether to sort the hits from the newest or largest message.
+ * @max_hits: The maximum number of hits to get.
+ * @hits: Return location for a #GPtrArray of #ModestSearchHit, which frees
+ * them too. Free with g_ptr_array_unref().
+ *
+ * Searches like libmodest_dbus_client_search(), but only gets the first
+ * @max_hits hits once sorted on @sort_key, in that order; for instance the
+ * 50 newest messages. Modest only keeps those while searching, so the
+ * reply, and the time to decode it, are bounded by @max_hits instead of
+ * growing with the number of matches.
+ *
+ * With a modest that cannot sort the hits, all of them are got and the
+ * first ones picked here.
+ *
+ * Return value: TRUE if the search succeded or FALSE for an error during the search
+ **/
+gboolean
+libmodest_dbus_client_search_top (osso_context_t          *osso_ctx,
+				  const gchar             *query,
+				  const gchar             *folder,
+				  time_t                   start_date,
+				  time_t                   end_date,
+				  guint32                  min_size,
+				  ModestDBusSearchFlags    flags,
+				  ModestDBusSearchSortKey  sort_key,
+				  gboolean                 descending,
+				  guint                    max_hits,
+				  GPtrArray              **hits)
+{
+	ModestDbusSearchOrder order;
+	ModestDbusClient *client;
+	DBusMessage *msg;
+	DBusMessage *reply;
+	dbus_uint32_t sort_key_v = sort_key;
+	dbus_bool_t descending_v = descending ? TRUE : FALSE;
+	dbus_uint32_t max_hits_v = max_hits;
+	GError *error = NULL;
+
+	if (query == NULL || max_hits == 0) {
+		return FALSE;
+	}
+
+	order.sort_key = sort_key;
+	order.descending = descending;
+
+	client = modest_dbus_client_get (osso_ctx);
+	msg = modest_dbus_new_search_message (client,
+					      MODEST_DBUS_CLIENT_METHOD_SEARCH_TOP,
+					      query, folder, start_date,
+					      end_date, min_size, flags);
+
+	if (msg == NULL) {
+		return FALSE;
+	}
+
+	if (!dbus_message_append_args (msg,
+				       DBUS_TYPE_UINT32, &sort_key_v,
+				       DBUS_TYPE_BOOLEAN, &descending_v,
+				       DBUS_TYPE_UINT32, &max_hits_v,
+				       DBUS_TYPE_INVALID)) {
+		dbus_message_unref (msg);
+		return FALSE;
+	}
+
+	reply = modest_dbus_client_send_and_block (client, MODEST_DBUS_CLIENT_METHOD_SEARCH_TOP,
+						   msg, &error);
+
+	if (reply == NULL) {
+		gboolean res = FALSE;
+
+		if (g_error_matches (error, MODEST_DBUS_CLIENT_ERROR,
+				     MODEST_DBUS_CLIENT_ERROR_UNKNOWN_METHOD) &&
+		    libmodest_dbus_client_search_array (osso_ctx, query, folder, start_date,
+							end_date, min_size, flags, hits)) {
+			/* This modest cannot sort: pick the first hits here */
+			modest_dbus_search_hits_select_top (*hits, &order, max_hits);
+			res = TRUE;
+		}
+
+		g_clear_error (&error);
+		return res;
+	}
+
+	MODEST_DBUS_DECODE_START (MODEST_DBUS_CLIENT_METHOD_SEARCH_TOP, reply);
+	*hits = modest_dbus_message_get_search_hit_array (reply);
+	MODEST_DBUS_DECODE_END (client, MODEST_DBUS_CLIENT_METHOD_SEARCH_TOP, reply,
+				*hits ? (*hits)->len : 0);
+
+	dbus_message_unref (reply);
+
+	return *hits != NULL;
+}
+
+/* A search whose hits are fetched page by page */
+struct _ModestSearchCursor {
+	ModestDbusClient *client;
+	guint             page_size;
+	gchar            *token;	/* of modest, or %NULL after the last page */
+
+	/* With a modest that does not page, all the hits, handed out page
+	 * by page from next_hit; the array does not own them */
+	GPtrArray        *hits;
+	guint             next_hit;
+};
+
+/* A page of hits, an array of search_hit (see libmodest-dbus-types.def),
+ * and the cursor to the next page */
+#define MODEST_DBUS_SEARCH_PAGE_SIGNATURE "a(sssstbbx)s"
+
+static GPtrArray *
+modest_dbus_message_get_search_page (DBusMessage *reply, gchar **token)
+{
+	DBusMessageIter iter;
+	GPtrArray *hits;
+	const char *str;
+
+	if (!dbus_message_has_signature (reply, MODEST_DBUS_SEARCH_PAGE_SIGNATURE)) {
+		g_warning ("%s: Error during unmarshalling", __FUNCTION__);
+		return NULL;
+	}
+
+	dbus_message_iter_init (reply, &iter);
+	hits = modest_dbus_read_search_hit_ptr_array (&iter);
+
+	dbus_message_iter_next (&iter);
+	dbus_message_iter_get_basic (&iter, &str);
+	*token = *str ? g_strdup (str) : NULL;
+
+	return hits;
+}
+
+/* Decodes the page in the reply to @method, and moves @cursor on */
+static gboolean
+modest_search_cursor_read_page (ModestSearchCursor     *cursor,
+				ModestDbusClientMethod  method,
+				DBusMessage            *reply,
+				GPtrArray             **hits)
+{
+	gchar *token = NULL;
+
+	MODEST_DBUS_DECODE_START (method, reply);
+	*hits = modest_dbus_message_get_search_page (reply, &token);
+	MODEST_DBUS_DECODE_END (cursor->client, method, reply, *hits ? (*hits)->len : 0);
+
+	dbus_message_unref (reply);
+
+	if (*hits == NULL) {
+		return FALSE;
+	}
+
+	g_free (cursor->token);
+	cursor->token = token;
+
+	return TRUE;
+}
+
+/* The next page of the hits got at once */
+static GPtrArray *
+modest_search_cursor_take_page (ModestSearchCursor *cursor)
+{
+	GPtrArray *page;
+	guint last;
+
+	page = g_ptr_array_new_with_free_func ((GDestroyNotify) modest_dbus_free_search_hit);
+	last = MIN (cursor->next_hit + cursor->page_size, cursor->hits->len);
+
+	for (; cursor->next_hit < last; cursor->next_hit++) {
+		g_ptr_array_add (page, g_ptr_array_index (cursor->hits, cursor->next_hit));
+	}
+
+	return page;
+}
+
+/**
+ * libmodest_dbus_client_search_paged:
+ * @osso_ctx: A valid #osso_context_t object.
+ * @query: The term to search for.
+ * @folder: An url to specific folder or %NULL to search everywhere.
+ * @start_date: Search hits before this date will be ignored.
+ * @end_date: Search hits after this date will be ignored.
+ * @min_size: Messagers smaller then this size will be ingored.
+ * @flags: A list of flags where to search.
+ * @page_size: The maximum number of hits per page.
+ * @hits: Return location for a #GPtrArray of the #ModestSearchHit of the
+ * first page. Free with g_ptr_array_unref().
+ * @cursor: Return location for the cursor to the next pages. Free with
+ * libmodest_dbus_client_search_cursor_close().
+ *
+ * Searches like libmodest_dbus_client_search(), but only gets the first
+ * @page_size hits; libmodest_dbus_client_search_next_page() gets the next
+ * ones, until libmodest_dbus_client_search_cursor_is_done(). This bounds
+ * the size of every reply, and the memory taken by the hits, however many
+ * messages match.
+ *
+ * With a modest that does not page its results, all the hits are got at
+ * once and handed out page by page.
+ *
+ * Return value: TRUE if the search succeded or FALSE for an error during the search
+ **/
+gboolean
+libmodest_dbus_client_search_paged (osso_context_t          *osso_ctx,
+				    const gchar             *query,
+				    const gchar             *folder,
+				    time_t                   start_date,
+				    time_t                   end_date,
+				    guint32                  min_size,
+				    ModestDBusSearchFlags    flags,
+				    guint                    page_size,
+				    GPtrArray              **hits,
+				    ModestSearchCursor     **cursor)
+{
+	ModestDbusClient *client;
+	ModestSearchCursor *result;
+	DBusMessage *msg;
+	DBusMessage *reply;
+	dbus_uint32_t page_size_v = page_size;
+	GError *error = NULL;
+
+	if (query == NULL || page_size == 0) {
+		return FALSE;
+	}
+
+	client = modest_dbus_client_get (osso_ctx);
+	msg = modest_dbus_new_search_message (client,
+					      MODEST_DBUS_CLIENT_METHOD_SEARCH_PAGED,
+					      query, folder, start_date,
+					      end_date, min_size, flags);
+
+	if (msg == NULL) {
+		return FALSE;
+	}
+
+	if (!dbus_message_append_args (msg, DBUS_TYPE_UINT32, &page_size_v, DBUS_TYPE_INVALID)) {
+		dbus_message_unref (msg);
+		return FALSE;
+	}
+
+	reply = modest_dbus_client_send_and_block (client, MODEST_DBUS_CLIENT_METHOD_SEARCH_PAGED,
+						   msg, &error);
+
+	result = g_slice_new0 (ModestSearchCursor);
+	result->client = libmodest_dbus_client_ref (client);
+	result->page_size = page_size;
+
+	if (reply) {
+		if (!modest_search_cursor_read_page (result, MODEST_DBUS_CLIENT_METHOD_SEARCH_PAGED,
+						     reply, hits)) {
+			libmodest_dbus_client_search_cursor_close (result);
+			return FALSE;
+		}
+	} else if (g_error_matches (error, MODEST_DBUS_CLIENT_ERROR,
+				    MODEST_DBUS_CLIENT_ERROR_UNKNOWN_METHOD) &&
+		   libmodest_dbus_client_search_array (osso_ctx, query, folder, start_date,
+						       end_date, min_size, flags,
+						       &result->hits)) {
+		/* This modest does not page: hand out all the hits page by page */
+		g_ptr_array_set_free_func (result->hits, NULL);
+		*hits = modest_search_cursor_take_page (result);
+	} else {
+		g_clear_error (&error);
+		libmodest_dbus_client_search_cursor_close (result);
+		return FALSE;
+	}
+
+	g_clear_error (&error);
+	*cursor = result;
+
+	return TRUE;
+}
+
+/**
+ * libmodest_dbus_client_search_next_page:
+ * @cursor: A #ModestSearchCursor.
+ * @hits: Return location for a #GPtrArray of the #ModestSearchHit of the
+ * next page, empty if there are no more hits. Free with g_ptr_array_unref().
+ *
+ * Gets the next page of the search of @cursor, started with
+ * libmodest_dbus_client_search_paged().
+ *
+ * Return value: TRUE upon success, FALSE otherwise
+ **/
+gboolean
+libmodest_dbus_client_search_next_page (ModestSearchCursor  *cursor,
+					GPtrArray          **hits)
+{
+	DBusMessage *msg;
+	DBusMessage *reply;
+	dbus_uint32_t page_size_v;
+
+	g_return_val_if_fail (cursor != NULL, FALSE);
+
+	if (cursor->hits) {
+		*hits = modest_search_cursor_take_page (cursor);
+		return TRUE;
+	}
+
+	if (cursor->token == NULL) {
+		*hits = g_ptr_array_new_with_free_func ((GDestroyNotify) modest_dbus_free_search_hit);
+		return TRUE;
+	}
+
+	msg = modest_dbus_client_new_call (cursor->client,
+					   MODEST_DBUS_CLIENT_METHOD_SEARCH_NEXT_PAGE);
+
+	if (msg == NULL) {
+		return FALSE;
+	}
+
+	page_size_v = cursor->page_size;
+
+	if (!dbus_message_append_args (msg,
+				       DBUS_TYPE_STRING, &cursor->token,
+				       DBUS_TYPE_UINT32, &page_size_v,
+				       DBUS_TYPE_INVALID)) {
+		dbus_message_unref (msg);
+		return FALSE;
+	}
+
+	reply = modest_dbus_client_send_and_block (cursor->client,
+						   MODEST_DBUS_CLIENT_METHOD_SEARCH_NEXT_PAGE,
+						   msg, NULL);
+
+	if (reply == NULL) {
+		return FALSE;
+	}
+
+	return modest_search_cursor_read_page (cursor, MODEST_DBUS_CLIENT_METHOD_SEARCH_NEXT_PAGE,
+					       reply, hits);
+}
+
+/**
+ * libmodest_dbus_client_search_cursor_is_done:
+ * @cursor: A #ModestSearchCursor.
+ *
+ * Return value: TRUE if all the pages of the search of @cursor have been got
+ **/
+gboolean
+libmodest_dbus_client_search_cursor_is_done (ModestSearchCursor *cursor)
+{
+	g_return_val_if_fail (cursor != NULL, TRUE);
+
+	if (cursor->hits) {
+		return cursor->next_hit >= cursor->hits->len;
+	}
+
+	return cursor->token == NULL;
+}
+
+/**
+ * libmodest_dbus_client_search_cursor_close:
+ * @cursor: A #ModestSearchCursor, or %NULL.
+ *
+ * Frees @cursor. If it is closed before its last page, modest is told
+ * to forget the rest of the search.
+ **/
+void
+libmodest_dbus_client_search_cursor_close (ModestSearchCursor *cursor)
+{
+	DBusMessage *msg = NULL;
+	guint i;
+
+	if (cursor == NULL) {
+		return;
+	}
+
+	if (cursor->token) {
+		msg = modest_dbus_client_new_call (cursor->client,
+						   MODEST_DBUS_CLIENT_METHOD_CLOSE_SEARCH_CURSOR);
+	}
+
+	if (msg) {
+		/* Not worth starting modest for */
+		dbus_message_set_auto_start (msg, FALSE);
+		dbus_message_set_no_reply (msg, TRUE);
+
+		if (dbus_message_append_args (msg, DBUS_TYPE_STRING, &cursor->token,
+					      DBUS_TYPE_INVALID)) {
+			dbus_connection_send (cursor->client->connection, msg, NULL);
+		}
+
+		dbus_message_unref (msg);
+	}
+
+	if (cursor->hits) {
+		for (i = cursor->next_hit; i < cursor->hits->len; i++) {
+			modest_dbus_free_search_hit (g_ptr_array_index (cursor->hits, i));
+		}
+		g_ptr_array_free (cursor->hits, TRUE);
+	}
+
+	libmodest_dbus_client_unref (cursor->client);
+	g_free (cursor->token);
+	g_slice_free (ModestSearchCursor, cursor);
+}
+
+/**
+ * libmodest_dbus_client_search_async:
+ * @osso_ctx: A valid #osso_context_t object.
+ * @query: The term to search for.
+ * @folder: An url to specific folder or %NULL to search everywhere.
+ * @start_date: Search hits before this date will be ignored.
+ * @end_date: Search hits after this date will be ignored.
+ * @min_size: Messagers smaller then this size will be ingored.
+ * @flags: A list of flags where to search.
+ * @cancellable: A #GCancellable or %NULL.
+ * @callback: Function to call when the search has finished.
+ * @user_data: Data to pass to @callback.
+ *
+ * Asynchronous version of libmodest_dbus_client_search(). The call is
+ * sent immediately and @callback is invoked from the main loop the D-Bus
+ * connection of @osso_ctx is attached to, once modest has replied. Call
+ * libmodest_dbus_client_search_finish() from @callback to get the hits.
+ *
+ * Cancelling @cancellable completes the request at once with
+ * %G_IO_ERROR_CANCELLED. The reply is then dropped without being
+ * decoded, and modest is asked to stop searching.
+ **/
+void
+libmodest_dbus_client_search_async (osso_context_t          *osso_ctx,
+				    const gchar             *query,
+				    const gchar             *folder,
+				    time_t                   start_date,
+				    time_t                   end_date,
+				    guint32                  min_size,
+				    ModestDBusSearchFlags    flags,
+				    GCancellable            *cancellable,
+				    GAsyncReadyCallback      callback,
+				    gpointer                 user_data)
+{
+	ModestDbusClient *client;
+	GTask *task;
+	DBusMessage *msg;
+
+	task = g_task_new (NULL, cancellable, callback, user_data);
+	g_task_set_source_tag (task, libmodest_dbus_client_search_async);
+	g_task_set_task_data (task, (gpointer) &search_reply_handler, NULL);
+
+	if (query == NULL) {
+		g_task_return_new_error (task, MODEST_DBUS_CLIENT_ERROR,
+					 MODEST_DBUS_CLIENT_ERROR_FAILED,
+					 "No search query given");
+		g_object_unref (task);
+		return;
+	}
+
+	client = modest_dbus_client_get (osso_ctx);
+	msg = modest_dbus_new_search_message (client,
+					      MODEST_DBUS_CLIENT_METHOD_SEARCH,
+					      query, folder, start_date,
+					      end_date, min_size, flags);
+
+	modest_dbus_client_send_async (client, MODEST_DBUS_CLIENT_METHOD_SEARCH, msg, task);
+}
+
+/**
+ * libmodest_dbus_client_search_finish:
+ * @result: The #GAsyncResult passed to the callback.
+ * @hits: Return location for the list of #ModestSearchHit, to be freed
+ * with modest_search_hit_list_free().
+ * @error: Return location for a #GError or %NULL.
+ *
+ * Finishes a search started with libmodest_dbus_client_search_async().
+ *
+ * Return value: TRUE if the search succeded or FALSE for an error during the search
+ **/
+gboolean
+libmodest_dbus_client_search_finish (GAsyncResult  *result,
+				     GList        **hits,
+				     GError       **error)
+{
+	return modest_dbus_propagate_list (result, libmodest_dbus_client_search_async,
+					   hits, error);
+}
+
+/* A search started with libmodest_dbus_client_search_stream() */
+typedef struct {
+	guint                  search_id;
+	osso_context_t        *osso_ctx;
+	ModestDbusClient      *client;
+	DBusMessage           *msg;	/* the SearchStream call, to send it again */
+	dbus_uint32_t          serial;	/* of that call */
+	gint64                 start;	/* when it was sent */
+	ModestSearchChunkFunc  chunk_func;
+	gpointer               user_data;
+	GDestroyNotify         destroy;
+
+	/* Kept to fall back to a plain Search on older modest versions */
+	gchar                 *query;
+	gchar                 *folder;
+	time_t                 start_date;
+	time_t                 end_date;
+	guint32                min_size;
+	ModestDBusSearchFlags  flags;
+	GCancellable          *fallback;	/* cancels that plain Search */
+} ModestDbusSearchStream;
+
+/* A search id, an array of search_hit (see libmodest-dbus-types.def), finished */
+#define MODEST_DBUS_SEARCH_HITS_SIGNATURE "ua(sssstbbx)b"
+
+static GHashTable *search_streams = NULL; /* search id -> ModestDbusSearchStream */
+static guint last_search_id = 0;
+
+static void
+modest_dbus_search_stream_free (ModestDbusSearchStream *stream)
+{
+	/* Nobody waits for the hits of the fallback search anymore, if it
+	 * is still running */
+	g_cancellable_cancel (stream->fallback);
+	g_object_unref (stream->fallback);
+
+	if (stream->destroy) {
+		stream->destroy (stream->user_data);
+	}
+
+	if (stream->msg) {
+		dbus_message_unref (stream->msg);
+	}
+
+	libmodest_dbus_client_unref (stream->client);
+	g_free (stream->query);
+	g_free (stream->folder);
+	g_slice_free (ModestDbusSearchStream, stream);
+}
+
+/* Ends the search @search_id, calling its chunk function one last
+ * time with @hits or @error. */
+static void
+modest_dbus_search_stream_finish (guint search_id, GList *hits, const GError *error)
+{
+	ModestDbusSearchStream *stream;
+
+	stream = g_hash_table_lookup (search_streams, GUINT_TO_POINTER (search_id));
+
+	if (stream == NULL) {
+		return;
+	}
+
+	/* Removed before calling out, so that the search can no longer be
+	 * cancelled from the chunk function */
+	g_hash_table_steal (search_streams, GUINT_TO_POINTER (search_id));
+
+	stream->chunk_func (search_id, hits, TRUE, error, stream->user_data);
+
+	modest_dbus_search_stream_free (stream);
+}
+
+/* Ends the searches streamed to @client, as the modest sending them
+ * is gone. */
+static void
+modest_dbus_client_end_search_streams (ModestDbusClient *client)
+{
+	GHashTableIter iter;
+	gpointer search_id;
+	ModestDbusSearchStream *stream;
+	GSList *ended = NULL;
+	GSList *l;
+	GError *error;
+
+	if (search_streams == NULL) {
+		return;
+	}
+
+	g_hash_table_iter_init (&iter, search_streams);
+	while (g_hash_table_iter_next (&iter, &search_id, (gpointer *) &stream)) {
+		if (stream->client == client) {
+			ended = g_slist_prepend (ended, search_id);
+		}
+	}
+
+	error = g_error_new_literal (MODEST_DBUS_CLIENT_ERROR,
+				     MODEST_DBUS_CLIENT_ERROR_NOT_RUNNING,
+				     "modest exited during the search");
+
+	/* The chunk functions may start or cancel other searches */
+	for (l = ended; l; l = l->next) {
+		modest_dbus_search_stream_finish (GPOINTER_TO_UINT (l->data), NULL, error);
+	}
+
+	g_error_free (error);
+	g_slist_free (ended);
+}
+
+static DBusHandlerResult
+modest_dbus_search_stream_filter (DBusConnection *con, DBusMessage *message, void *user_data)
+{
+	ModestDbusClient *client = user_data;
+	ModestDbusSearchStream *stream;
+	DBusMessageIter iter;
+	dbus_uint32_t search_id;
+	dbus_bool_t finished;
+	GList *hits = NULL;
+	guint n_hits;
+
+	if (!dbus_message_is_signal (message, MODEST_DBUS_IFACE,
+				     MODEST_DBUS_SIGNAL_SEARCH_HITS)) {
+		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+	}
+
+	/* Search ids are only unique per client, so ignore chunks that
+	 * were not sent to us. Unicast signals get through without a match
+	 * rule, so also ignore those that modest did not send. */
+	if (g_strcmp0 (dbus_message_get_destination (message),
+		       dbus_bus_get_unique_name (con)) != 0 ||
+	    client->owner == NULL ||
+	    !dbus_message_has_sender (message, client->owner) ||
+	    !dbus_message_has_signature (message, MODEST_DBUS_SEARCH_HITS_SIGNATURE)) {
+		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+	}
+
+	dbus_message_iter_init (message, &iter);
+	dbus_message_iter_get_basic (&iter, &search_id);
+
+	stream = g_hash_table_lookup (search_streams, GUINT_TO_POINTER (search_id));
+
+	if (stream == NULL || stream->client != client) {
+		/* A late chunk of a cancelled search */
+		return DBUS_HANDLER_RESULT_HANDLED;
+	}
+
+	MODEST_DBUS_PROBE_DECODE_START (MODEST_DBUS_SIGNAL_SEARCH_HITS, stream->serial);
+
+	dbus_message_iter_next (&iter);
+	hits = g_list_reverse (modest_dbus_read_search_hit_list (&iter, &n_hits));
+
+	MODEST_DBUS_PROBE_DECODE_END (MODEST_DBUS_SIGNAL_SEARCH_HITS, stream->serial, n_hits);
+
+	dbus_message_iter_next (&iter);
+	dbus_message_iter_get_basic (&iter, &finished);
+
+	if (finished) {
+		modest_dbus_search_stream_finish (search_id, hits, NULL);
+	} else {
+		stream->chunk_func (search_id, hits, FALSE, NULL, stream->user_data);
+	}
+
+	modest_search_hit_list_free (hits);
+
+	return DBUS_HANDLER_RESULT_HANDLED;
+}
+
+static void
+on_search_stream_fallback_ready (GObject *source, GAsyncResult *result, gpointer user_data)
+{
+	GList *hits = NULL;
+	GError *error = NULL;
+
+	if (!libmodest_dbus_client_search_finish (result, &hits, &error)) {
+		modest_dbus_search_stream_finish (GPOINTER_TO_UINT (user_data), NULL, error);
+		g_error_free (error);
+		return;
+	}
+
+	/* Deliver the hits in the order modest sent them */
+	hits = g_list_reverse (hits);
+	modest_dbus_search_stream_finish (GPOINTER_TO_UINT (user_data), hits, NULL);
+	modest_search_hit_list_free (hits);
+}
+
+static void on_search_stream_started (DBusPendingCall *pending, void *user_data);
+
+/* Sends @msg, the SearchStream call of @stream, consuming the
+ * reference. Returns %FALSE if it could not be sent. */
+static gboolean
+modest_dbus_search_stream_send (ModestDbusSearchStream *stream, DBusMessage *msg)
+{
+	ModestDbusClient *client = stream->client;
+	DBusPendingCall *pending = NULL;
+
+	stream->start = g_get_monotonic_time ();
+
+	if (client->connection == NULL ||
+	    !dbus_connection_send_with_reply (client->connection, msg, &pending,
+					      modest_dbus_client_get_timeout (client,
+									      MODEST_DBUS_CLIENT_METHOD_SEARCH_STREAM)) ||
+	    pending == NULL) {
+		MODEST_DBUS_STAT_ADD (client, MODEST_DBUS_CLIENT_METHOD_SEARCH_STREAM, failures, 1);
+		modest_dbus_client_log_event (client, MODEST_DBUS_CLIENT_METHOD_SEARCH_STREAM,
+					      MODEST_DBUS_EVENT_SEND_FAILED, 0, stream->start);
+		dbus_message_unref (msg);
+		return FALSE;
+	}
+
+	if (stream->msg) {
+		dbus_message_unref (stream->msg);
+	}
+	stream->msg = msg;
+	stream->serial = dbus_message_get_serial (msg);
+
+	MODEST_DBUS_PROBE_CALL_SEND (method_names[MODEST_DBUS_CLIENT_METHOD_SEARCH_STREAM],
+				     stream->serial);
+
+	dbus_pending_call_set_notify (pending, on_search_stream_started,
+				      GUINT_TO_POINTER (stream->search_id), NULL);
+	dbus_pending_call_unref (pending);
+
+	return TRUE;
+}
+
+static void
+on_search_stream_started (DBusPendingCall *pending, void *user_data)
+{
+	guint search_id = GPOINTER_TO_UINT (user_data);
+	ModestDbusSearchStream *stream;
+	DBusMessage *reply;
+	DBusMessage *retry;
+	GError *error = NULL;
+
+	stream = g_hash_table_lookup (search_streams, GUINT_TO_POINTER (search_id));
+	reply = dbus_pending_call_steal_reply (pending);
+
+	/* Not accounted for if cancelled, like the other asynchronous calls */
+	if (stream == NULL) {
+		if (reply) {
+			dbus_message_unref (reply);
+		}
+		return;
+	}
+
+	if (reply == NULL) {
+		MODEST_DBUS_STAT_ADD (stream->client, MODEST_DBUS_CLIENT_METHOD_SEARCH_STREAM,
+				      failures, 1);
+		modest_dbus_client_log_event (stream->client, MODEST_DBUS_CLIENT_METHOD_SEARCH_STREAM,
+					      MODEST_DBUS_EVENT_ERROR, 0, stream->start);
+		error = g_error_new_literal (MODEST_DBUS_CLIENT_ERROR,
+					     MODEST_DBUS_CLIENT_ERROR_FAILED,
+					     "No reply received");
+		modest_dbus_search_stream_finish (search_id, NULL, error);
+		g_error_free (error);
+		return;
+	}
+
+	/* On success, this learns who answered: the chunks come after this
+	 * reply, and only from that modest */
+	retry = modest_dbus_client_handle_reply (stream->client, stream->msg, reply);
+
+	if (retry) {
+		/* Sent to a modest that is gone: start over on the new one */
+		dbus_message_unref (reply);
+
+		if (!modest_dbus_search_stream_send (stream, retry)) {
+			error = g_error_new_literal (MODEST_DBUS_CLIENT_ERROR,
+						     MODEST_DBUS_CLIENT_ERROR_FAILED,
+						     "Could not send the method call");
+			modest_dbus_search_stream_finish (search_id, NULL, error);
+			g_error_free (error);
+		}
+		return;
+	}
+
+	modest_dbus_client_record_reply (stream->client, MODEST_DBUS_CLIENT_METHOD_SEARCH_STREAM,
+					 reply, stream->start);
+
+	if (dbus_message_get_type (reply) == DBUS_MESSAGE_TYPE_METHOD_RETURN) {
+		/* The search has started */
+	} else if (dbus_message_is_error (reply, DBUS_ERROR_UNKNOWN_METHOD)) {
+		/* This modest does not stream results: get them all at once */
+		libmodest_dbus_client_search_async (stream->osso_ctx, stream->query,
+						    stream->folder, stream->start_date,
+						    stream->end_date, stream->min_size,
+						    stream->flags, stream->fallback,
+						    on_search_stream_fallback_ready,
+						    GUINT_TO_POINTER (search_id));
+	} else if (!modest_dbus_check_reply (reply, &error)) {
+		modest_dbus_search_stream_finish (search_id, NULL, error);
+		g_error_free (error);
+	}
+
+	dbus_message_unref (reply);
+}
+
+/**
+ * libmodest_dbus_client_search_stream:
+ * @osso_ctx: A valid #osso_context_t object.
+ * @query: The term to search for.
+ * @folder: An url to specific folder or %NULL to search everywhere.
+ * @start_date: Search hits before this date will be ignored.
+ * @end_date: Search hits after this date will be ignored.
+ * @min_size: Messagers smaller then this size will be ingored.
+ * @flags: A list of flags where to search.
+ * @chunk_size: The maximum number of hits per chunk, or 0 to let modest decide.
+ * @chunk_func: Function called for every chunk of hits.
+ * @user_data: Data to pass to @chunk_func.
+ * @destroy: Function to free @user_data once the search is over, or %NULL.
+ *
+ * Starts a search like libmodest_dbus_client_search(), but instead of
+ * waiting for all the hits, modest sends them in chunks of at most
+ * @chunk_size hits as soon as they are found. @chunk_func is called from
+ * the main loop for every chunk, with the hits in the order modest found
+ * them. The hits are freed when @chunk_func returns, so only one chunk
+ * is kept in memory at a time. The last call has @finished set to %TRUE,
+ * and @error set if the search failed; if modest exits during the search,
+ * that is %MODEST_DBUS_CLIENT_ERROR_NOT_RUNNING.
+ *
+ * With a modest that does not support streaming, all the hits are
+ * delivered in a single, final chunk.
+ *
+ * Return value: the id of the search, or 0 if it could not be started.
+ **/
+guint
+libmodest_dbus_client_search_stream (osso_context_t          *osso_ctx,
+				     const gchar             *query,
+				     const gchar             *folder,
+				     time_t                   start_date,
+				     time_t                   end_date,
+				     guint32                  min_size,
+				     ModestDBusSearchFlags    flags,
+				     guint                    chunk_size,
+				     ModestSearchChunkFunc    chunk_func,
+				     gpointer                 user_data,
+				     GDestroyNotify           destroy)
+{
+	ModestDbusSearchStream *stream;
+	ModestDbusClient *client;
+	DBusMessage *msg;
+	dbus_uint32_t search_id_v;
+	dbus_uint32_t chunk_size_v;
+
+	g_return_val_if_fail (chunk_func != NULL, 0);
+
+	if (query == NULL) {
+		return 0;
+	}
+
+	/* Also installs the filter that receives the chunks */
+	client = modest_dbus_client_get (osso_ctx);
+
+	if (client == NULL) {
+		return 0;
+	}
+
+	if (!modest_dbus_client_check_running (client, NULL)) {
+		modest_dbus_client_log_event (client, MODEST_DBUS_CLIENT_METHOD_SEARCH_STREAM,
+					      MODEST_DBUS_EVENT_NOT_RUNNING, 0, 0);
+		return 0;
+	}
+
+	if (search_streams == NULL) {
+		search_streams = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
+							(GDestroyNotify) modest_dbus_search_stream_free);
+	}
+
+	msg = modest_dbus_new_search_message (client,
+					      MODEST_DBUS_CLIENT_METHOD_SEARCH_STREAM,
+					      query, folder, start_date,
+					      end_date, min_size, flags);
+
+	if (msg == NULL) {
+		return 0;
+	}
+
+	if (++last_search_id == 0) {
+		++last_search_id;
+	}
+
+	search_id_v = (dbus_uint32_t) last_search_id;
+	chunk_size_v = (dbus_uint32_t) chunk_size;
+
+	/* The chunks come from whichever modest answers, and the reply
+	 * tells us which one */
+	if (!dbus_message_set_destination (msg, MODEST_DBUS_SERVICE) ||
+	    !dbus_message_append_args (msg,
+				       DBUS_TYPE_UINT32, &search_id_v,
+				       DBUS_TYPE_UINT32, &chunk_size_v,
+				       DBUS_TYPE_INVALID)) {
+		dbus_message_unref (msg);
+		return 0;
+	}
+
+	stream = g_slice_new0 (ModestDbusSearchStream);
+	stream->search_id  = last_search_id;
+	stream->osso_ctx   = osso_ctx;
+	stream->client     = libmodest_dbus_client_ref (client);
+	stream->chunk_func = chunk_func;
+	stream->user_data  = user_data;
+	stream->destroy    = destroy;
+	stream->query      = g_strdup (query);
+	stream->folder     = g_strdup (folder);
+	stream->start_date = start_date;
+	stream->end_date   = end_date;
+	stream->min_size   = min_size;
+	stream->flags      = flags;
+	stream->fallback   = g_cancellable_new ();
+
+	MODEST_DBUS_STAT_ADD (client, MODEST_DBUS_CLIENT_METHOD_SEARCH_STREAM, calls, 1);
+
+	if (!modest_dbus_search_stream_send (stream, msg)) {
+		/* The caller keeps @user_data */
+		stream->destroy = NULL;
+		modest_dbus_search_stream_free (stream);
+		return 0;
+	}
+
+	/* The reply is only dispatched from the main loop */
+	g_hash_table_insert (search_streams, GUINT_TO_POINTER (stream->search_id), stream);
+
+	return stream->search_id;
+}
+
+/**
+ * libmodest_dbus_client_search_stream_cancel:
+ * @osso_ctx: A valid #osso_context_t object.
+ * @search_id: The id returned by libmodest_dbus_client_search_stream().
+ *
+ * Stops delivering the hits of a streaming search, and asks modest to
+ * stop searching. The chunk function will not be called anymore. With
+ * an older modest, the plain search standing in for the stream is
+ * cancelled instead.
+ **/
+void
+libmodest_dbus_client_search_stream_cancel (osso_context_t *osso_ctx,
+					    guint           search_id)
+{
+	ModestDbusSearchStream *stream;
+
+	if (search_streams == NULL) {
+		return;
+	}
+
+	stream = g_hash_table_lookup (search_streams, GUINT_TO_POINTER (search_id));
+
+	if (stream == NULL) {
+		return;
+	}
+
+	/* Let modest stop searching too; it answered SearchStream already,
+	 * so this goes by search id rather than by serial */
+	modest_dbus_client_send_cancel (stream->client,
+					MODEST_DBUS_CLIENT_METHOD_CANCEL_SEARCH_STREAM,
+					search_id);
+
+	g_hash_table_remove (search_streams, GUINT_TO_POINTER (search_id));
+}
+
+
+
+static DBusMessage *
+modest_dbus_new_get_unread_messages_message (ModestDbusClient *client, gint msgs_per_account)
+{
+	DBusMessage *msg;
+	dbus_int32_t msgs_per_account_v;
+
+	msg = modest_dbus_client_new_call (client, MODEST_DBUS_CLIENT_METHOD_GET_UNREAD_MESSAGES);
+
+	if (msg == NULL) {
+		return NULL;
+	}
+
+	msgs_per_account_v = (dbus_int32_t) msgs_per_account;
+
+	if (!dbus_message_append_args (msg,
+				       DBUS_TYPE_INT32, &msgs_per_account_v,
+				       DBUS_TYPE_INVALID)) {
+		dbus_message_unref (msg);
+		return NULL;
+	}
+
+	return msg;
+}
+
+/* Sends a GetUnreadMessages and waits for the reply; %NULL on error */
+static DBusMessage *
+modest_dbus_client_get_unread_messages_and_block (ModestDbusClient *client,
+						  gint              msgs_per_account)
+{
+	DBusMessage *msg;
+
+	if (msgs_per_account < 1) {
+		return NULL;
+	}
+
+	msg = modest_dbus_new_get_unread_messages_message (client, msgs_per_account);
+
+	if (msg == NULL) {
+		return NULL;
+	}
+
+	return modest_dbus_client_send_and_block (client,
+						  MODEST_DBUS_CLIENT_METHOD_GET_UNREAD_MESSAGES,
+						  msg, NULL);
+}
+
+/* The accounts in the order of modest, with their hits reversed, as
+ * modest_dbus_read_unread_hit_list() builds them */
+static GPtrArray *
+modest_dbus_message_read_account_hits (DBusMessage *reply)
+{
+	DBusMessageIter iter;
+
+	if (!modest_dbus_message_is_account_hits_list (reply)) {
+		g_warning ("%s: Error during unmarshalling", __FUNCTION__);
+		return NULL;
+	}
+
+	dbus_message_iter_init (reply, &iter);
+
+	return modest_dbus_read_account_hits_ptr_array (&iter);
+}
+
+GPtrArray *
+modest_dbus_message_get_account_hits_array (DBusMessage *reply)
+{
+	GPtrArray *accounts = modest_dbus_message_read_account_hits (reply);
+	guint i;
+
+	if (accounts == NULL) {
+		return NULL;
+	}
+
+	for (i = 0; i < accounts->len; i++) {
+		ModestAccountHits *account = g_ptr_array_index (accounts, i);
+
+		account->hits = g_list_reverse (account->hits);
+	}
+
+	return accounts;
+}
+
+GList *
+modest_dbus_message_get_account_hits_list (DBusMessage *reply, guint *n_items)
+{
+	GPtrArray *accounts = modest_dbus_message_read_account_hits (reply);
+
+	if (n_items) {
+		*n_items = accounts ? accounts->len : 0;
+	}
+
+	/* All in reverse order, as this always returned them */
+	return accounts ? modest_dbus_ptr_array_steal_list (accounts, TRUE) : NULL;
+}
+
+/* A #ModestAccountHitsSet, with the arena holding the accounts */
+typedef struct {
+	ModestAccountHitsSet set;
+	ModestDbusArena      arena;
+} ModestDbusAccountHitsSet;
+
+ModestAccountHitsSet *
+modest_dbus_message_get_account_hits_set (DBusMessage *reply, ModestDbusInternMode intern_mode)
+{
+	ModestDbusAccountHitsSet *real;
+	DBusMessageIter iter;
+
+	if (!modest_dbus_message_is_account_hits_list (reply)) {
+		g_warning ("%s: Error during unmarshalling", __FUNCTION__);
+		return NULL;
+	}
+
+	real = g_slice_new (ModestDbusAccountHitsSet);
+	modest_dbus_arena_init (&real->arena, intern_mode);
+
+	dbus_message_iter_init (reply, &iter);
+	real->set.accounts = modest_dbus_read_account_hits_array_in (&iter, &real->arena,
+								     &real->set.n_accounts);
+
+	return &real->set;
+}
+
+/**
+ * modest_account_hits_set_free:
+ * @account_hits: a #ModestAccountHitsSet, or %NULL
+ *
+ * Frees @account_hits, with all its accounts and their hits.
+ **/
+void
+modest_account_hits_set_free (ModestAccountHitsSet *account_hits)
+{
+	ModestDbusAccountHitsSet *real = (ModestDbusAccountHitsSet *) account_hits;
+
+	if (real == NULL) {
+		return;
+	}
+
+	modest_dbus_arena_clear (&real->arena);
+	g_slice_free (ModestDbusAccountHitsSet, real);
+}
+
+static const ModestDbusReplyHandler account_hits_reply_handler = {
+	modest_dbus_message_get_account_hits_list,
+	(GDestroyNotify) modest_account_hits_list_free,
+	NULL
+};
+
+gboolean
+libmodest_dbus_client_get_unread_messages (osso_context_t          *osso_ctx,
+					   gint msgs_per_account,
+					   GList **account_hits_lists)
+{
+	ModestDbusClient *client;
+	DBusMessage *reply;
+	guint n_accounts;
+
+	client = modest_dbus_client_get (osso_ctx);
+	reply = modest_dbus_client_get_unread_messages_and_block (client, msgs_per_account);
+
+	if (reply == NULL) {
+		return FALSE;
+	}
+
+	g_debug ("%s: message return", __FUNCTION__);
+
+	MODEST_DBUS_DECODE_START (MODEST_DBUS_CLIENT_METHOD_GET_UNREAD_MESSAGES, reply);
+	*account_hits_lists = modest_dbus_message_get_account_hits_list (reply, &n_accounts);
+	MODEST_DBUS_DECODE_END (client, MODEST_DBUS_CLIENT_METHOD_GET_UNREAD_MESSAGES,
+				reply, n_accounts);
+
+	dbus_message_unref (reply);
+
+
+	return TRUE;
+}
+
+/**
+ * libmodest_dbus_client_get_unread_messages_array:
+ * @osso_ctx: A valid #osso_context_t object.
+ * @msgs_per_account: The maximum number of unread messages to get per account.
+ * @account_hits: Return location for a #GPtrArray of #ModestAccountHits,
+ * which frees them too. Free with g_ptr_array_unref().
+ *
+ * Gets the unread messages like libmodest_dbus_client_get_unread_messages(),
+ * with the accounts, and the hits of each account, in the order modest
+ * sent them.
+ *
+ * Return value: TRUE upon success, FALSE otherwise
+ **/
+gboolean
+libmodest_dbus_client_get_unread_messages_array (osso_context_t  *osso_ctx,
+						 gint             msgs_per_account,
+						 GPtrArray      **account_hits)
+{
+	ModestDbusClient *client;
+	DBusMessage *reply;
+
+	client = modest_dbus_client_get (osso_ctx);
+	reply = modest_dbus_client_get_unread_messages_and_block (client, msgs_per_account);
+
+	if (reply == NULL) {
+		return FALSE;
+	}
+
+	MODEST_DBUS_DECODE_START (MODEST_DBUS_CLIENT_METHOD_GET_UNREAD_MESSAGES, reply);
+	*account_hits = modest_dbus_message_get_account_hits_array (reply);
+	MODEST_DBUS_DECODE_END (client, MODEST_DBUS_CLIENT_METHOD_GET_UNREAD_MESSAGES,
+				reply, *account_hits ? (*account_hits)->len : 0);
+
+	dbus_message_unref (reply);
+
+	return *account_hits != NULL;
+}
+
+/**
+ * libmodest_dbus_client_get_unread_messages_set:
+ * @osso_ctx: A valid #osso_context_t object.
+ * @msgs_per_account: The maximum number of unread messages to get per account.
+ * @account_hits: Return location for the accounts, to free with
+ * modest_account_hits_set_free().
+ *
+ * Gets the unread messages like libmodest_dbus_client_get_unread_messages(),
+ * with the accounts, their hits and all the strings allocated in a few
+ * large blocks, in the order modest sent them.
+ *
+ * Return value: TRUE upon success, FALSE otherwise
+ **/
+gboolean
+libmodest_dbus_client_get_unread_messages_set (osso_context_t        *osso_ctx,
+					       gint                   msgs_per_account,
+					       ModestAccountHitsSet **account_hits)
+{
+	ModestDbusClient *client;
+	DBusMessage *reply;
+
+	client = modest_dbus_client_get (osso_ctx);
+	reply = modest_dbus_client_get_unread_messages_and_block (client, msgs_per_account);
+
+	if (reply == NULL) {
+		return FALSE;
+	}
+
+	MODEST_DBUS_DECODE_START (MODEST_DBUS_CLIENT_METHOD_GET_UNREAD_MESSAGES, reply);
+	*account_hits = modest_dbus_message_get_account_hits_set (reply, client->intern_mode);
+	MODEST_DBUS_DECODE_END (client, MODEST_DBUS_CLIENT_METHOD_GET_UNREAD_MESSAGES,
+				reply, *account_hits ? (*account_hits)->n_accounts : 0);
+
+	dbus_message_unref (reply);
+
+	return *account_hits != NULL;
+}
+
+/**
+ * libmodest_dbus_client_get_unread_messages_async:
+ * @osso_ctx: A valid #osso_context_t object.
+ * @msgs_per_account: The maximum number of unread messages to get per account.
+ * @cancellable: A #GCancellable or %NULL.
+ * @callback: Function to call when the request has finished.
+ * @user_data: Data to pass to @callback.
+ *
+ * Asynchronous version of libmodest_dbus_client_get_unread_messages().
+ * Call libmodest_dbus_client_get_unread_messages_finish() from @callback
+ * to get the result. Cancelling @cancellable works as with
+ * libmodest_dbus_client_search_async().
+ **/
+void
+libmodest_dbus_client_get_unread_messages_async (osso_context_t      *osso_ctx,
+						 gint                 msgs_per_account,
+						 GCancellable        *cancellable,
+						 GAsyncReadyCallback  callback,
+						 gpointer             user_data)
+{
+	ModestDbusClient *client;
+	GTask *task;
+
+	task = g_task_new (NULL, cancellable, callback, user_data);
+	g_task_set_source_tag (task, libmodest_dbus_client_get_unread_messages_async);
+	g_task_set_task_data (task, (gpointer) &account_hits_reply_handler, NULL);
+
+	if (msgs_per_account < 1) {
+		g_task_return_new_error (task, MODEST_DBUS_CLIENT_ERROR,
+					 MODEST_DBUS_CLIENT_ERROR_FAILED,
+					 "Invalid number of messages per account");
+		g_object_unref (task);
+		return;
+	}
+
+	client = modest_dbus_client_get (osso_ctx);
+	modest_dbus_client_send_async (client, MODEST_DBUS_CLIENT_METHOD_GET_UNREAD_MESSAGES,
+				       modest_dbus_new_get_unread_messages_message (client,
+										    msgs_per_account),
+				       task);
+}
+
+/**
+ * libmodest_dbus_client_get_unread_messages_finish:
+ * @result: The #GAsyncResult passed to the callback.
+ * @account_hits_list: Return location for the list of #ModestAccountHits,
+ * to be freed with modest_account_hits_list_free().
+ * @error: Return location for a #GError or %NULL.
+ *
+ * Finishes a request started with libmodest_dbus_client_get_unread_messages_async().
+ *
+ * Return value: TRUE upon success, FALSE otherwise
+ **/
+gboolean
+libmodest_dbus_client_get_unread_messages_finish (GAsyncResult  *result,
+						  GList        **account_hits_list,
+						  GError       **error)
+{
+	return modest_dbus_propagate_list (result,
+					   libmodest_dbus_client_get_unread_messages_async,
+					   account_hits_list, error);
+}
+
+/* Time to wait for more changes before updating an unread model */
+#define MODEST_UNREAD_MODEL_REFRESH_DELAY 500
+
+struct _ModestUnreadModel {
+	gint              ref_count;
+	ModestDbusClient *client;
+	gint              msgs_per_account;
+
+	GList            *account_hits;
+	gboolean          ready;
+
+	guint             refresh_id;	/* pending refresh timeout */
+	gboolean          refreshing;	/* a GetUnreadMessages is in flight */
+	gboolean          dirty;	/* changed while refreshing */
+
+	GHookList         watches;
+};
+
+static void modest_unread_model_refresh (ModestUnreadModel *model);
+
+static void
+modest_unread_model_notify_watch (GHook *hook, gpointer marshal_data)
+{
+	((ModestUnreadModelChangedFunc) hook->func) (marshal_data, hook->data);
+}
+
+static void
+on_unread_model_refreshed (GObject *source, GAsyncResult *result, gpointer user_data)
+{
+	ModestUnreadModel *model = user_data;
+	GList *account_hits = NULL;
+	GError *error = NULL;
+
+	model->refreshing = FALSE;
+
+	if (libmodest_dbus_client_get_unread_messages_finish (result, &account_hits, &error)) {
+		modest_account_hits_list_free (model->account_hits);
+		model->account_hits = account_hits;
+		model->ready = TRUE;
+
+		g_hook_list_marshal (&model->watches, FALSE,
+				     modest_unread_model_notify_watch, model);
+	} else {
+		/* Keep what we had, the next change signal will retry */
+		g_debug ("%s: %s", __FUNCTION__, error->message);
+		g_error_free (error);
+	}
+
+	if (model->dirty && model->ref_count > 1) {
+		modest_unread_model_refresh (model);
+	}
+
+	libmodest_dbus_client_unread_model_unref (model);
+}
+
+static void
+modest_unread_model_refresh (ModestUnreadModel *model)
+{
+	ModestDbusClient *client = model->client;
+	GTask *task;
+
+	model->dirty = FALSE;
+	model->refreshing = TRUE;
+
+	task = g_task_new (NULL, NULL, on_unread_model_refreshed,
+			   libmodest_dbus_client_unread_model_ref (model));
+	g_task_set_source_tag (task, libmodest_dbus_client_get_unread_messages_async);
+	g_task_set_task_data (task, (gpointer) &account_hits_reply_handler, NULL);
+
+	modest_dbus_client_send_async (client, MODEST_DBUS_CLIENT_METHOD_GET_UNREAD_MESSAGES,
+				       modest_dbus_new_get_unread_messages_message (client,
+										    model->msgs_per_account),
+				       task);
+}
+
+static gboolean
+on_unread_model_refresh_timeout (gpointer user_data)
+{
+	ModestUnreadModel *model = user_data;
+
+	model->refresh_id = 0;
+
+	if (model->refreshing) {
+		/* Refresh again once the current one is over */
+		model->dirty = TRUE;
+	} else {
+		modest_unread_model_refresh (model);
+	}
+
+	return FALSE;
+}
+
+/* Called when a signal tells that unread messages may have changed. A
+ * burst of signals results in a single refresh. */
+static void
+modest_unread_model_schedule_refresh (ModestUnreadModel *model)
+{
+	if (model->refresh_id == 0) {
+		model->refresh_id = g_timeout_add (MODEST_UNREAD_MODEL_REFRESH_DELAY,
+						   on_unread_model_refresh_timeout,
+						   model);
+	}
+}
+
+/**
+ * libmodest_dbus_client_unread_model_new:
+ * @client: a #ModestDbusClient
+ * @msgs_per_account: The maximum number of unread messages to keep per account.
+ *
+ * Creates a model of the unread messages, like the ones returned by
+ * libmodest_dbus_client_get_unread_messages(), that keeps itself up to
+ * date. It is filled once from the main loop, and then fetched again,
+ * in the background, when modest signals that a message was read or
+ * unread or that a folder was updated. Several signals in a row only
+ * cause one update.
+ *
+ * Reading the model does not talk to modest, so there is no need to
+ * poll: add a watch with libmodest_dbus_client_unread_model_add_watch()
+ * to know when it changes.
+ *
+ * Return value: the new model, to be released with
+ * libmodest_dbus_client_unread_model_unref(), or %NULL on error.
+ **/
+ModestUnreadModel *
+libmodest_dbus_client_unread_model_new (ModestDbusClient *client,
+					gint              msgs_per_account)
+{
+	ModestUnreadModel *model;
+
+	g_return_val_if_fail (client != NULL, NULL);
+
+	if (msgs_per_account < 1) {
+		return NULL;
+	}
+
+	model = g_slice_new0 (ModestUnreadModel);
+	model->ref_count = 1;
+	model->client = libmodest_dbus_client_ref (client);
+	model->msgs_per_account = msgs_per_account;
+	g_hook_list_init (&model->watches, sizeof (GHook));
+
+	modest_dbus_client_add_match (client,
+				      MODEST_DBUS_SIGNAL_RULE (MODEST_DBUS_SIGNAL_MSG_READ_CHANGED));
+	modest_dbus_client_add_match (client,
+				      MODEST_DBUS_SIGNAL_RULE (MODEST_DBUS_SIGNAL_FOLDER_UPDATED));
+	client->unread_models = g_list_prepend (client->unread_models, model);
+
+	modest_unread_model_refresh (model);
+
+	return model;
+}
+
+/**
+ * libmodest_dbus_client_unread_model_ref:
+ * @model: a #ModestUnreadModel
+ *
+ * Return value: @model
+ **/
+ModestUnreadModel *
+libmodest_dbus_client_unread_model_ref (ModestUnreadModel *model)
+{
+	g_return_val_if_fail (model != NULL, NULL);
+
+	model->ref_count++;
+
+	return model;
+}
+
+/**
+ * libmodest_dbus_client_unread_model_unref:
+ * @model: a #ModestUnreadModel
+ *
+ * Drops a reference to @model. The model stops following modest when
+ * the last reference is dropped.
+ **/
+void
+libmodest_dbus_client_unread_model_unref (ModestUnreadModel *model)
+{
+	ModestDbusClient *client;
+
+	g_return_if_fail (model != NULL);
+
+	if (--model->ref_count > 0) {
+		return;
+	}
+
+	client = model->client;
+
+	if (model->refresh_id) {
+		g_source_remove (model->refresh_id);
+	}
+
+	client->unread_models = g_list_remove (client->unread_models, model);
+	modest_dbus_client_remove_match (client,
+					 MODEST_DBUS_SIGNAL_RULE (MODEST_DBUS_SIGNAL_MSG_READ_CHANGED));
+	modest_dbus_client_remove_match (client,
+					 MODEST_DBUS_SIGNAL_RULE (MODEST_DBUS_SIGNAL_FOLDER_UPDATED));
+
+	g_hook_list_clear (&model->watches);
+	modest_account_hits_list_free (model->account_hits);
+	libmodest_dbus_client_unref (client);
+	g_slice_free (ModestUnreadModel, model);
+}
+
+/**
+ * libmodest_dbus_client_unread_model_is_ready:
+ * @model: a #ModestUnreadModel
+ *
+ * Return value: TRUE once @model was filled from modest
+ **/
+gboolean
+libmodest_dbus_client_unread_model_is_ready (ModestUnreadModel *model)
+{
+	g_return_val_if_fail (model != NULL, FALSE);
+
+	return model->ready;
+}
+
+/**
+ * libmodest_dbus_client_unread_model_get_account_hits:
+ * @model: a #ModestUnreadModel
+ *
+ * Gets the #ModestAccountHits of every account, as returned by
+ * libmodest_dbus_client_get_unread_messages(). The list belongs to
+ * @model and is only valid until it changes: copy what you need to keep.
+ *
+ * Return value: the list of #ModestAccountHits, %NULL until the model
+ * is ready.
+ **/
+const GList *
+libmodest_dbus_client_unread_model_get_account_hits (ModestUnreadModel *model)
+{
+	g_return_val_if_fail (model != NULL, NULL);
+
+	return model->account_hits;
+}
+
+/**
+ * libmodest_dbus_client_unread_model_get_unread_count:
+ * @model: a #ModestUnreadModel
+ * @account_id: the id of an account
+ *
+ * Return value: the number of unread messages in the account
+ * @account_id, or -1 if the model does not know that account.
+ **/
+gint
+libmodest_dbus_client_unread_model_get_unread_count (ModestUnreadModel *model,
+						     const gchar       *account_id)
+{
+	GList *iter;
+
+	g_return_val_if_fail (model != NULL, -1);
+
+	for (iter = model->account_hits; iter; iter = iter->next) {
+		ModestAccountHits *account_hits = iter->data;
+
+		if (g_strcmp0 (account_hits->account_id, account_id) == 0) {
+			return account_hits->unread_count;
+		}
+	}
+
+	return -1;
+}
+
+/**
+ * libmodest_dbus_client_unread_model_add_watch:
+ * @model: a #ModestUnreadModel
+ * @func: function called every time @model changes
+ * @user_data: data to pass to @func
+ * @destroy: function to free @user_data when the watch is removed, or %NULL
+ *
+ * Return value: the id of the watch, to remove it with
+ * libmodest_dbus_client_unread_model_remove_watch().
+ **/
+gulong
+libmodest_dbus_client_unread_model_add_watch (ModestUnreadModel         *model,
+					      ModestUnreadModelChangedFunc func,
+					      gpointer                   user_data,
+					      GDestroyNotify             destroy)
+{
+	GHook *hook;
+
+	g_return_val_if_fail (model != NULL, 0);
+	g_return_val_if_fail (func != NULL, 0);
+
+	hook = g_hook_alloc (&model->watches);
+	hook->func = (gpointer) func;
+	hook->data = user_data;
+	hook->destroy = destroy;
+	g_hook_append (&model->watches, hook);
+
+	return hook->hook_id;
+}
+
+/**
+ * libmodest_dbus_client_unread_model_remove_watch:
+ * @model: a #ModestUnreadModel
+ * @watch_id: the id returned by libmodest_dbus_client_unread_model_add_watch()
+ *
+ * Stops calling the function of the watch @watch_id. This can be done
+ * from that function.
+ **/
+void
+libmodest_dbus_client_unread_model_remove_watch (ModestUnreadModel *model,
+						 gulong             watch_id)
+{
+	g_return_if_fail (model != NULL);
+
+	g_hook_destroy (&model->watches, watch_id);
+}
+
+void
+modest_folder_result_list_free (GList *list)
+{
+	modest_dbus_free_folder_result_list (list);
+}
+
+
+GPtrArray *
+modest_dbus_message_get_folder_array (DBusMessage *reply)
+{
+	DBusMessageIter iter;
+
+	if (!modest_dbus_message_is_folder_result_list (reply)) {
+		g_warning ("%s: Error during unmarshalling", __FUNCTION__);
+		return NULL;
+	}
+
+	dbus_message_iter_init (reply, &iter);
+
+	return modest_dbus_read_folder_result_ptr_array (&iter);
+}
+
+GList *
+modest_dbus_message_get_folders (DBusMessage *reply, guint *n_items)
+{
+	GPtrArray *folders = modest_dbus_message_get_folder_array (reply);
+
+	if (n_items) {
+		*n_items = folders ? folders->len : 0;
+	}
+
+	/* In the order of modest */
+	return folders ? modest_dbus_ptr_array_steal_list (folders, FALSE) : NULL;
+}
+
+static ModestFolderResult *
+modest_folder_result_copy (const ModestFolderResult *item)
+{
+	ModestFolderResult *item_copy = g_slice_new (ModestFolderResult);
+
+	item_copy->folder_name = g_strdup (item->folder_name);
+	item_copy->folder_uri = g_strdup (item->folder_uri);
+
+	return item_copy;
+}
+
+static GList *
+modest_folder_result_list_copy (GList *folders)
+{
+	GList *copy = NULL;
+	GList *iter;
+
+	for (iter = folders; iter; iter = iter->next) {
+		copy = g_list_prepend (copy, modest_folder_result_copy (iter->data));
+	}
+
+	return g_list_reverse (copy);
+}
+
+/* Caches @folders, got from a call made at @generation, unless they
+ * changed since */
+static void
+modest_dbus_client_store_folders (ModestDbusClient *client, guint generation, GList *folders)
+{
+	if (!client->cache_folders || generation != client->folders_generation) {
+		return;
+	}
+
+	modest_dbus_client_drop_folders (client);
+	client->folders = modest_folder_result_list_copy (folders);
+	client->have_folders = TRUE;
+}
+
+static void
+modest_dbus_client_store_folder_array (ModestDbusClient *client, guint generation,
+				       GPtrArray *folders)
+{
+	guint i;
+
+	if (!client->cache_folders || generation != client->folders_generation) {
+		return;
+	}
+
+	modest_dbus_client_drop_folders (client);
+	for (i = folders->len; i > 0; i--) {
+		client->folders = g_list_prepend (client->folders,
+						  modest_folder_result_copy (g_ptr_array_index (folders, i - 1)));
+	}
+	client->have_folders = TRUE;
+}
+
+static const ModestDbusReplyHandler folders_reply_handler = {
+	modest_dbus_message_get_folders,
+	(GDestroyNotify) modest_folder_result_list_free,
+	modest_dbus_client_store_folders
+};
+
+/**
+ * libmodest_dbus_client_set_folder_cache:
+ * @client: a #ModestDbusClient
+ * @enabled: whether to cache the folder list
+ *
+ * If @enabled is %TRUE, the client keeps the last folder list got from
+ * modest, and libmodest_dbus_client_get_folders() and its asynchronous
+ * version return a copy of it instead of calling modest. The list is
+ * dropped when modest signals that a folder was updated or an account
+ * was created or removed, or when modest restarts.
+ *
+ * Disabled by default. This applies to all the users of the D-Bus
+ * connection of @client.
+ **/
+void
+libmodest_dbus_client_set_folder_cache (ModestDbusClient *client,
+					gboolean          enabled)
+{
+	g_return_if_fail (client != NULL);
+
+	enabled = enabled ? TRUE : FALSE;
+
+	if (client->cache_folders == enabled) {
+		return;
+	}
+
+	client->cache_folders = enabled;
+
+	if (enabled) {
+		modest_dbus_client_add_match (client,
+					      MODEST_DBUS_SIGNAL_RULE (MODEST_DBUS_SIGNAL_FOLDER_UPDATED));
+		modest_dbus_client_add_match (client,
+					      MODEST_DBUS_SIGNAL_RULE (MODEST_DBUS_SIGNAL_ACCOUNT_CREATED));
+		modest_dbus_client_add_match (client,
+					      MODEST_DBUS_SIGNAL_RULE (MODEST_DBUS_SIGNAL_ACCOUNT_REMOVED));
+	} else {
+		modest_dbus_client_remove_match (client,
+						 MODEST_DBUS_SIGNAL_RULE (MODEST_DBUS_SIGNAL_FOLDER_UPDATED));
+		modest_dbus_client_remove_match (client,
+						 MODEST_DBUS_SIGNAL_RULE (MODEST_DBUS_SIGNAL_ACCOUNT_CREATED));
+		modest_dbus_client_remove_match (client,
+						 MODEST_DBUS_SIGNAL_RULE (MODEST_DBUS_SIGNAL_ACCOUNT_REMOVED));
+		modest_dbus_client_invalidate_folders (client);
+	}
+}
+
+/**
+ * libmodest_dbus_client_get_folders_array:
+ * @osso_ctx: A valid #osso_context_t object.
+ * @folders: Return location for a #GPtrArray of #ModestFolderResult, which
+ * frees them too. Free with g_ptr_array_unref().
+ *
+ * Gets the folders like libmodest_dbus_client_get_folders(), in the order
+ * modest sent them, and indexed in constant time.
+ *
+ * Return value: TRUE if the request succeded or FALSE for an error.
+ **/
+gboolean
+libmodest_dbus_client_get_folders_array (osso_context_t  *osso_ctx,
+					 GPtrArray      **folders)
+{
+	ModestDbusClient *client;
+	DBusMessage *msg;
+	DBusMessage *reply;
+	guint generation;
+
+	client = modest_dbus_client_get (osso_ctx);
+
+	if (client && client->have_folders) {
+		GList *iter;
+
+		*folders = g_ptr_array_new_with_free_func ((GDestroyNotify) modest_dbus_free_folder_result);
+		for (iter = client->folders; iter; iter = iter->next) {
+			g_ptr_array_add (*folders, modest_folder_result_copy (iter->data));
+		}
+
+		return TRUE;
+	}
+
+	msg = modest_dbus_client_new_call (client, MODEST_DBUS_CLIENT_METHOD_GET_FOLDERS);
+
+	if (msg == NULL) {
+		return FALSE;
+	}
+
+	generation = client->folders_generation;
+	reply = modest_dbus_client_send_and_block (client, MODEST_DBUS_CLIENT_METHOD_GET_FOLDERS,
+						   msg, NULL);
+
+	if (reply == NULL) {
+		return FALSE;
+	}
+
+	MODEST_DBUS_DECODE_START (MODEST_DBUS_CLIENT_METHOD_GET_FOLDERS, reply);
+	*folders = modest_dbus_message_get_folder_array (reply);
+	MODEST_DBUS_DECODE_END (client, MODEST_DBUS_CLIENT_METHOD_GET_FOLDERS, reply,
+				*folders ? (*folders)->len : 0);
+
+	if (*folders) {
+		modest_dbus_client_store_folder_array (client, generation, *folders);
+	}
+
+	dbus_message_unref (reply);
+
+	return *folders != NULL;
+}
+
+/**
+ * libmodest_dbus_client_get_folders:
+ * @osso_ctx: A valid #osso_context_t object.
+ * @folders: A pointer to a valid GList pointer that will contain the folder items
+ * (ModestFolderResult). The list and the items must be freed by the caller 
+ * with modest_folder_result_list_free().
+ *
+ * This method will obtain a list of folders in the default account.
+ *
+ * Upon success TRUE is returned and @folders will include the folders or the list
+ * might be empty if there are no folders. The returned
+ * list must be freed with modest_folder_result_list_free ().
+ *
+ * NOTE: A folder will only be retrieved if it was previously downloaded by
+ * modest. This function does also not attempt do to remote refreshes (i.e. IMAP).
+ * 
+ * Return value: TRUE if the request succeded or FALSE for an error.
+ **/
+gboolean
+libmodest_dbus_client_get_folders (osso_context_t          *osso_ctx,
+			      GList                  **folders)
+{
+	GPtrArray *array;
+
+	/* Initialize output argument: */
+	if (folders)
+		*folders = NULL;
+	else
+		return FALSE;
+
+	if (!libmodest_dbus_client_get_folders_array (osso_ctx, &array)) {
+		return FALSE;
+	}
+
+	*folders = modest_dbus_ptr_array_steal_list (array, FALSE);
+
+	return TRUE;
+}
+
+/**
+ * libmodest_dbus_client_get_folders_async:
+ * @osso_ctx: A valid #osso_context_t object.
+ * @cancellable: A #GCancellable or %NULL.
+ * @callback: Function to call when the request has finished.
+ * @user_data: Data to pass to @callback.
+ *
+ * Asynchronous version of libmodest_dbus_client_get_folders().
+ * Call libmodest_dbus_client_get_folders_finish() from @callback
+ * to get the folders.
+ **/
+void
+libmodest_dbus_client_get_folders_async (osso_context_t      *osso_ctx,
+					 GCancellable        *cancellable,
+					 GAsyncReadyCallback  callback,
+					 gpointer             user_data)
+{
+	ModestDbusClient *client;
+	GTask *task;
+
+	task = g_task_new (NULL, cancellable, callback, user_data);
+	g_task_set_source_tag (task, libmodest_dbus_client_get_folders_async);
+	g_task_set_task_data (task, (gpointer) &folders_reply_handler, NULL);
+
+	client = modest_dbus_client_get (osso_ctx);
+
+	if (client && client->have_folders) {
+		g_task_return_pointer (task, modest_folder_result_list_copy (client->folders),
+				       (GDestroyNotify) modest_folder_result_list_free);
+		g_object_unref (task);
+		return;
+	}
+
+	modest_dbus_client_send_async (client, MODEST_DBUS_CLIENT_METHOD_GET_FOLDERS,
+				       modest_dbus_client_new_call (client,
+								    MODEST_DBUS_CLIENT_METHOD_GET_FOLDERS),
+				       task);
+}
+
+/**
+ * libmodest_dbus_client_get_folders_finish:
+ * @result: The #GAsyncResult passed to the callback.
+ * @folders: Return location for the list of #ModestFolderResult, to be
+ * freed with modest_folder_result_list_free().
+ * @error: Return location for a #GError or %NULL.
+ *
+ * Finishes a request started with libmodest_dbus_client_get_folders_async().
+ *
+ * Return value: TRUE if the request succeded or FALSE for an error.
+ **/
+gboolean
+libmodest_dbus_client_get_folders_finish (GAsyncResult  *result,
+					  GList        **folders,
+					  GError       **error)
+{
+	return modest_dbus_propagate_list (result, libmodest_dbus_client_get_folders_async,
+					   folders, error);
+}
+
+/**
+ * libmodest_dbus_client_delete_messages:
+ * @osso_ctx: a valid #osso_context_t object.
+ * @msg_uris: A %NULL-terminated array of valid urls to mails
+ * @results: Return location for the per-message results, or %NULL
+ *
+ * Deletes all the messages in @msg_uris with a single remote procedure
+ * call, instead of one call per message. If @results is not %NULL, it
+ * is set to a newly allocated array with one entry per URI in @msg_uris,
+ * %TRUE if the message was found and deleted. It must be freed with g_free().
+ *
+ * If modest does not support deleting several messages at once, they are
+ * deleted one by one.
+ *
+ * Return value: TRUE if modest processed the request, FALSE on error
+ **/
+gboolean
+libmodest_dbus_client_delete_messages (osso_context_t       *osso_ctx,
+				       const gchar * const  *msg_uris,
+				       gboolean            **results)
+{
+	ModestDbusClient *client;
+	DBusMessage *msg;
+	DBusMessage *reply;
+	dbus_bool_t *statuses = NULL;
+	int n_statuses = 0;
+	gboolean *deleted;
+	GError *error = NULL;
+	guint n_uris, i;
+
+	if (results) {
+		*results = NULL;
+	}
+
+	if (msg_uris == NULL) {
+		return FALSE;
+	}
+
+	n_uris = g_strv_length ((gchar **) msg_uris);
+
+	client = modest_dbus_client_get (osso_ctx);
+	msg = modest_dbus_client_new_call (client, MODEST_DBUS_CLIENT_METHOD_DELETE_MESSAGES);
+
+	if (msg == NULL) {
+		return FALSE;
+	}
+
+	if (!dbus_message_append_args (msg,
+				       DBUS_TYPE_ARRAY, DBUS_TYPE_STRING, &msg_uris, n_uris,
+				       DBUS_TYPE_INVALID)) {
+		dbus_message_unref (msg);
+		return FALSE;
+	}
+
+	reply = modest_dbus_client_send_and_block (client, MODEST_DBUS_CLIENT_METHOD_DELETE_MESSAGES,
+						   msg, &error);
+
+	if (reply == NULL) {
+		if (!g_error_matches (error, MODEST_DBUS_CLIENT_ERROR,
+				      MODEST_DBUS_CLIENT_ERROR_UNKNOWN_METHOD)) {
+			g_clear_error (&error);
+			return FALSE;
+		}
+		g_clear_error (&error);
+
+		/* Older modest: one call per message */
+		deleted = g_new0 (gboolean, n_uris);
+		for (i = 0; i < n_uris; i++) {
+			deleted[i] = libmodest_dbus_client_delete_message (osso_ctx, msg_uris[i]);
+		}
+
+		if (results) {
+			*results = deleted;
+		} else {
+			g_free (deleted);
+		}
+
+		return TRUE;
+	}
+
+	MODEST_DBUS_DECODE_START (MODEST_DBUS_CLIENT_METHOD_DELETE_MESSAGES, reply);
+
+	if (!dbus_message_get_args (reply, NULL,
+				    DBUS_TYPE_ARRAY, DBUS_TYPE_BOOLEAN, &statuses, &n_statuses,
+				    DBUS_TYPE_INVALID) ||
+	    n_statuses != (int) n_uris) {
+		g_warning ("%s: Error during unmarshalling", __FUNCTION__);
+		dbus_message_unref (reply);
+		return FALSE;
+	}
+
+	MODEST_DBUS_DECODE_END (client, MODEST_DBUS_CLIENT_METHOD_DELETE_MESSAGES, reply,
+				n_statuses);
+
+	if (results) {
+		deleted = g_new0 (gboolean, n_uris);
+		for (i = 0; i < n_uris; i++) {
+			deleted[i] = statuses[i] ? TRUE : FALSE;
+		}
+		*results = deleted;
+	}
+
+	dbus_message_unref (reply);
+
+	return TRUE;
+}
+
+/**
+ * libmodest_dbus_client_mail_to_no_reply:
+ * @osso_context: a valid #osso_context_t object.
+ * @mailto_uri: A mailto URI.
+ *
+ * Like libmodest_dbus_client_mail_to(), but returns as soon as the
+ * request has been queued, without waiting for modest to handle it.
+ * Use libmodest_dbus_client_sync() to wait for modest to receive it.
+ *
+ * Return value: Whether or not the request could be queued
+ **/
+gboolean
+libmodest_dbus_client_mail_to_no_reply (osso_context_t *osso_context,
+					const gchar    *mailto_uri)
+{
+	return modest_dbus_client_call_simple (modest_dbus_client_get (osso_context),
+					       MODEST_DBUS_CLIENT_METHOD_MAIL_TO, FALSE,
+					       DBUS_TYPE_STRING, mailto_uri,
+					       DBUS_TYPE_INVALID);
+}
+
+/**
+ * libmodest_dbus_client_open_message_no_reply:
+ * @osso_context: a valid #osso_context_t object.
+ * @mail_uri: A valid url to a mail
+ *
+ * Like libmodest_dbus_client_open_message(), but does not wait for
+ * modest to handle the request.
+ *
+ * Return value: Whether or not the request could be queued
+ **/
+gboolean
+libmodest_dbus_client_open_message_no_reply (osso_context_t *osso_context,
+					     const gchar    *mail_uri)
+{
+	return modest_dbus_client_call_simple (modest_dbus_client_get (osso_context),
+					       MODEST_DBUS_CLIENT_METHOD_OPEN_MESSAGE, FALSE,
+					       DBUS_TYPE_STRING, mail_uri,
+					       DBUS_TYPE_INVALID);
+}
+
+/**
+ * libmodest_dbus_client_open_account_no_reply:
+ * @osso_context: a valid #osso_context_t object.
+ * @account_id: the id of the account to open
+ *
+ * Like libmodest_dbus_client_open_account(), but does not wait for
+ * modest to handle the request.
+ *
+ * Return value: Whether or not the request could be queued
+ **/
+gboolean
+libmodest_dbus_client_open_account_no_reply (osso_context_t *osso_context,
+					     const gchar    *account_id)
+{
+	return modest_dbus_client_call_simple (modest_dbus_client_get (osso_context),
+					       MODEST_DBUS_CLIENT_METHOD_OPEN_ACCOUNT, FALSE,
+					       DBUS_TYPE_STRING, account_id,
+					       DBUS_TYPE_INVALID);
+}
+
+/**
+ * libmodest_dbus_client_open_default_inbox_no_reply:
+ * @osso_context: a valid #osso_context_t object.
+ *
+ * Like libmodest_dbus_client_open_default_inbox(), but does not wait
+ * for modest to handle the request.
+ *
+ * Return value: Whether or not the request could be queued
+ **/
+gboolean
+libmodest_dbus_client_open_default_inbox_no_reply (osso_context_t *osso_context)
+{
+	return modest_dbus_client_call_simple (modest_dbus_client_get (osso_context),
+					       MODEST_DBUS_CLIENT_METHOD_OPEN_DEFAULT_INBOX, FALSE,
+					       DBUS_TYPE_INVALID);
+}
+
+/**
+ * libmodest_dbus_client_open_edit_accounts_dialog_no_reply:
+ * @osso_context: a valid #osso_context_t object.
+ *
+ * Like libmodest_dbus_client_open_edit_accounts_dialog(), but does not
+ * wait for modest to handle the request.
+ *
+ * Return value: Whether or not the request could be queued
+ **/
+gboolean
+libmodest_dbus_client_open_edit_accounts_dialog_no_reply (osso_context_t *osso_context)
+{
+	return modest_dbus_client_call_simple (modest_dbus_client_get (osso_context),
+					       MODEST_DBUS_CLIENT_METHOD_OPEN_EDIT_ACCOUNTS_DIALOG, FALSE,
+					       DBUS_TYPE_INVALID);
+}
+
+/**
+ * libmodest_dbus_client_flush:
+ * @osso_context: a valid #osso_context_t object.
+ *
+ * Blocks until all the requests queued with the _no_reply() functions,
+ * or held back by the _coalesced() ones, have been written to the bus.
+ **/
+void
+libmodest_dbus_client_flush (osso_context_t *osso_context)
+{
+	ModestDbusClient *client;
+
+	client = modest_dbus_client_get (osso_context);
+
+	if (client != NULL) {
+		modest_dbus_client_flush_coalesced (client);
+	}
+
+	if (client != NULL && client->connection != NULL) {
+		dbus_connection_flush (client->connection);
+	}
+}
+
+/**
+ * libmodest_dbus_client_sync:
+ * @osso_context: a valid #osso_context_t object.
+ *
+ * Blocks until modest has received all the requests sent before, doing
+ * a single round trip. As modest handles requests in order, this also
+ * waits for the _no_reply() requests to be processed.
+ *
+ * Return value: TRUE if modest answered, FALSE otherwise
+ **/
+gboolean
+libmodest_dbus_client_sync (osso_context_t *osso_context)
+{
+	ModestDbusClient *client;
+	DBusMessage *msg;
+	DBusMessage *reply;
+
+	client = modest_dbus_client_get (osso_context);
+
+	if (client == NULL) {
+		return FALSE;
+	}
+
+	msg = dbus_message_new_method_call (MODEST_DBUS_SERVICE,
+					    MODEST_DBUS_OBJECT,
+					    DBUS_INTERFACE_PEER,
+					    "Ping");
+
+	if (msg == NULL) {
+		return FALSE;
+	}
+
+	dbus_message_set_auto_start (msg, !client->only_if_running);
+
+	reply = modest_dbus_client_send_and_block (client, MODEST_DBUS_CLIENT_METHOD_NONE,
+						   msg, NULL);
+
+	if (reply == NULL) {
+		return FALSE;
+	}
+
+	dbus_message_unref (reply);
+
+	return TRUE;
+}
+
+/* The arguments of a modest signal, as passed to the subscribers */
+typedef struct {
+	const gchar *member;
+	const gchar *arg0;
+	const gchar *arg1;
+	gboolean     read;
+} ModestDbusSignalArgs;
+
+/* Quotes @value for a match rule, where a ' can only be written as '\'' */
+static gchar *
+modest_dbus_match_rule_quote (const gchar *value)
+{
+	gchar **parts;
+	gchar *joined;
+	gchar *quoted;
+
+	parts = g_strsplit (value, "'", -1);
+	joined = g_strjoinv ("'\\''", parts);
+	quoted = g_strconcat ("'", joined, "'", NULL);
+	g_strfreev (parts);
+	g_free (joined);
+
+	return quoted;
+}
+
+static gulong
+modest_dbus_client_subscribe (ModestDbusClient *client,
+			      const gchar      *member,
+			      const gchar      *account_id,
+			      GCallback         func,
+			      gpointer          user_data,
+			      GDestroyNotify    destroy)
+{
+	ModestDbusSubscription *sub;
+	gchar *rule;
+
+	rule = g_strdup_printf ("type='signal',sender='%s',interface='%s',member='%s'",
+				MODEST_DBUS_SERVICE, MODEST_DBUS_IFACE, member);
+
+	if (account_id) {
+		gchar *quoted = modest_dbus_match_rule_quote (account_id);
+		gchar *tmp = g_strconcat (rule, ",arg0=", quoted, NULL);
+
+		g_free (quoted);
+		g_free (rule);
+		rule = tmp;
+	}
+
+	sub = (ModestDbusSubscription *) g_hook_alloc (&client->subscriptions);
+	sub->hook.func = (gpointer) func;
+	sub->hook.data = user_data;
+	sub->hook.destroy = destroy;
+	sub->client = client;
+	sub->member = member;
+	sub->account_id = g_strdup (account_id);
+	sub->rule = rule;
+
+	modest_dbus_client_add_match (client, rule);
+	g_hook_append (&client->subscriptions, &sub->hook);
+
+	return sub->hook.hook_id;
+}
+
+static void
+modest_dbus_subscription_notify (GHook *hook, gpointer marshal_data)
+{
+	ModestDbusSubscription *sub = (ModestDbusSubscription *) hook;
+	ModestDbusSignalArgs *args = marshal_data;
+
+	/* Other match rules of this connection may let more signals in */
+	if (strcmp (sub->member, args->member) != 0 ||
+	    (sub->account_id && g_strcmp0 (sub->account_id, args->arg0) != 0)) {
+		return;
+	}
+
+	if (strcmp (sub->member, MODEST_DBUS_SIGNAL_FOLDER_UPDATED) == 0) {
+		((ModestFolderUpdatedFunc) hook->func) (sub->client, args->arg0,
+							args->arg1, hook->data);
+	} else if (strcmp (sub->member, MODEST_DBUS_SIGNAL_MSG_READ_CHANGED) == 0) {
+		((ModestMsgReadChangedFunc) hook->func) (sub->client, args->arg0,
+							 args->read, hook->data);
+	} else {
+		((ModestAccountSignalFunc) hook->func) (sub->client, args->arg0,
+							hook->data);
+	}
+}
+
+/* Passes a signal of modest to the subscribers */
+static void
+modest_dbus_client_dispatch_signal (ModestDbusClient *client, DBusMessage *message)
+{
+	ModestDbusSignalArgs args = { NULL, NULL, NULL, FALSE };
+	dbus_bool_t read_v = FALSE;
+
+	if (client->subscriptions.hooks == NULL) {
+		return;
+	}
+
+	if (dbus_message_is_signal (message, MODEST_DBUS_IFACE,
+				    MODEST_DBUS_SIGNAL_FOLDER_UPDATED)) {
+		args.member = MODEST_DBUS_SIGNAL_FOLDER_UPDATED;
+		if (!dbus_message_get_args (message, NULL,
+					    DBUS_TYPE_STRING, &args.arg0,
+					    DBUS_TYPE_STRING, &args.arg1,
+					    DBUS_TYPE_INVALID)) {
+			return;
+		}
+	} else if (dbus_message_is_signal (message, MODEST_DBUS_IFACE,
+					   MODEST_DBUS_SIGNAL_MSG_READ_CHANGED)) {
+		args.member = MODEST_DBUS_SIGNAL_MSG_READ_CHANGED;
+		if (!dbus_message_get_args (message, NULL,
+					    DBUS_TYPE_STRING, &args.arg0,
+					    DBUS_TYPE_BOOLEAN, &read_v,
+					    DBUS_TYPE_INVALID)) {
+			return;
+		}
+		args.read = read_v ? TRUE : FALSE;
+	} else if (dbus_message_is_signal (message, MODEST_DBUS_IFACE,
+					   MODEST_DBUS_SIGNAL_ACCOUNT_CREATED) ||
+		   dbus_message_is_signal (message, MODEST_DBUS_IFACE,
+					   MODEST_DBUS_SIGNAL_ACCOUNT_REMOVED)) {
+		args.member = dbus_message_get_member (message);
+		if (!dbus_message_get_args (message, NULL,
+					    DBUS_TYPE_STRING, &args.arg0,
+					    DBUS_TYPE_INVALID)) {
+			return;
+		}
+	} else {
+		return;
+	}
+
+	g_hook_list_marshal (&client->subscriptions, FALSE,
+			     modest_dbus_subscription_notify, &args);
+}
+
+/**
+ * libmodest_dbus_client_subscribe_account_created:
+ * @client: a #ModestDbusClient
+ * @func: function called when an account is created
+ * @user_data: data to pass to @func
+ * @destroy: function to free @user_data on unsubscribe, or %NULL
+ *
+ * Return value: the id of the subscription, for
+ * libmodest_dbus_client_unsubscribe().
+ **/
+gulong
+libmodest_dbus_client_subscribe_account_created (ModestDbusClient        *client,
+						 ModestAccountSignalFunc  func,
+						 gpointer                 user_data,
+						 GDestroyNotify           destroy)
+{
+	g_return_val_if_fail (client != NULL, 0);
+	g_return_val_if_fail (func != NULL, 0);
+
+	return modest_dbus_client_subscribe (client, MODEST_DBUS_SIGNAL_ACCOUNT_CREATED, NULL,
+					     G_CALLBACK (func), user_data, destroy);
+}
+
+/**
+ * libmodest_dbus_client_subscribe_account_removed:
+ * @client: a #ModestDbusClient
+ * @account_id: the account to watch, or %NULL for all of them
+ * @func: function called when the account is removed
+ * @user_data: data to pass to @func
+ * @destroy: function to free @user_data on unsubscribe, or %NULL
+ *
+ * Return value: the id of the subscription, for
+ * libmodest_dbus_client_unsubscribe().
+ **/
+gulong
+libmodest_dbus_client_subscribe_account_removed (ModestDbusClient        *client,
+						 const gchar             *account_id,
+						 ModestAccountSignalFunc  func,
+						 gpointer                 user_data,
+						 GDestroyNotify           destroy)
+{
+	g_return_val_if_fail (client != NULL, 0);
+	g_return_val_if_fail (func != NULL, 0);
+
+	return modest_dbus_client_subscribe (client, MODEST_DBUS_SIGNAL_ACCOUNT_REMOVED,
+					     account_id, G_CALLBACK (func), user_data, destroy);
+}
+
+/**
+ * libmodest_dbus_client_subscribe_folder_updated:
+ * @client: a #ModestDbusClient
+ * @account_id: the account to watch, or %NULL for all of them
+ * @func: function called when a folder of the account is updated
+ * @user_data: data to pass to @func
+ * @destroy: function to free @user_data on unsubscribe, or %NULL
+ *
+ * With an @account_id, the bus only wakes us up for the folders of that
+ * account.
+ *
+ * Return value: the id of the subscription, for
+ * libmodest_dbus_client_unsubscribe().
+ **/
+gulong
+libmodest_dbus_client_subscribe_folder_updated (ModestDbusClient        *client,
+						const gchar             *account_id,
+						ModestFolderUpdatedFunc  func,
+						gpointer                 user_data,
+						GDestroyNotify           destroy)
+{
+	g_return_val_if_fail (client != NULL, 0);
+	g_return_val_if_fail (func != NULL, 0);
+
+	return modest_dbus_client_subscribe (client, MODEST_DBUS_SIGNAL_FOLDER_UPDATED,
+					     account_id, G_CALLBACK (func), user_data, destroy);
+}
+
+/**
+ * libmodest_dbus_client_subscribe_msg_read_changed:
+ * @client: a #ModestDbusClient
+ * @func: function called when a message is marked as read or unread
+ * @user_data: data to pass to @func
+ * @destroy: function to free @user_data on unsubscribe, or %NULL
+ *
+ * Return value: the id of the subscription, for
+ * libmodest_dbus_client_unsubscribe().
+ **/
+gulong
+libmodest_dbus_client_subscribe_msg_read_changed (ModestDbusClient         *client,
+						  ModestMsgReadChangedFunc  func,
+						  gpointer                  user_data,
+						  GDestroyNotify            destroy)
+{
+	g_return_val_if_fail (client != NULL, 0);
+	g_return_val_if_fail (func != NULL, 0);
+
+	return modest_dbus_client_subscribe (client, MODEST_DBUS_SIGNAL_MSG_READ_CHANGED, NULL,
+					     G_CALLBACK (func), user_data, destroy);
+}
+
+/**
+ * libmodest_dbus_client_unsubscribe:
+ * @client: a #ModestDbusClient
+ * @subscription_id: the id returned when subscribing
+ *
+ * Removes a subscription and its match rule. This can be done from the
+ * subscriber callback.
+ **/
+void
+libmodest_dbus_client_unsubscribe (ModestDbusClient *client,
+				   gulong            subscription_id)
+{
+	g_return_if_fail (client != NULL);
+
+	g_hook_destroy (&client->subscriptions, subscription_id);
+}
+
+/* Installed once per connection by modest_dbus_client_get() */
+static DBusHandlerResult
+modest_dbus_client_filter (DBusConnection *con, DBusMessage *message, void *user_data)
+{
+	ModestDbusClient *client = user_data;
+
+	if (dbus_message_get_type (message) != DBUS_MESSAGE_TYPE_SIGNAL) {
+		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+	}
+
+	/* Others on this connection may be watching modest too, so the
+	 * owner changes are never consumed */
+	if (modest_dbus_client_owner_changed (client, message)) {
+		/* A new modest: its unread messages may differ */
+		g_list_foreach (client->unread_models,
+				(GFunc) modest_unread_model_schedule_refresh, NULL);
+	}
+
+	if (dbus_message_is_signal (message, MODEST_DBUS_IFACE,
+				    MODEST_DBUS_SIGNAL_FOLDER_UPDATED) ||
+	    dbus_message_is_signal (message, MODEST_DBUS_IFACE,
+				    MODEST_DBUS_SIGNAL_ACCOUNT_CREATED) ||
+	    dbus_message_is_signal (message, MODEST_DBUS_IFACE,
+				    MODEST_DBUS_SIGNAL_ACCOUNT_REMOVED)) {
+		modest_dbus_client_invalidate_folders (client);
+	}
+
+	if (dbus_message_is_signal (message, MODEST_DBUS_IFACE,
+				    MODEST_DBUS_SIGNAL_FOLDER_UPDATED) ||
+	    dbus_message_is_signal (message, MODEST_DBUS_IFACE,
+				    MODEST_DBUS_SIGNAL_MSG_READ_CHANGED)) {
+		g_list_foreach (client->unread_models,
+				(GFunc) modest_unread_model_schedule_refresh, NULL);
+	}
+
+	modest_dbus_client_dispatch_signal (client, message);
+
+	return modest_dbus_search_stream_filter (con, message, user_data);
+}
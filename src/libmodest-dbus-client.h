@@ -32,8 +32,247 @@
 
 #include <libosso.h>
 #include <glib.h>
+#include <gio/gio.h>
 #include <stdio.h>
 
+#define MODEST_DBUS_CLIENT_ERROR libmodest_dbus_client_error_quark ()
+
+typedef enum {
+	MODEST_DBUS_CLIENT_ERROR_FAILED,         /* the call failed or modest replied with an error */
+	MODEST_DBUS_CLIENT_ERROR_INVALID_REPLY,  /* modest replied with something unexpected */
+	MODEST_DBUS_CLIENT_ERROR_UNKNOWN_METHOD, /* this modest does not implement the method */
+	MODEST_DBUS_CLIENT_ERROR_NOT_RUNNING     /* modest is not running and may not be started */
+} ModestDbusClientError;
+
+GQuark libmodest_dbus_client_error_quark (void);
+
+/**
+ * ModestDbusClient:
+ *
+ * a handle caching the state needed to talk to modest over the D-Bus
+ * connection of an osso context; all the functions below use it.
+ */
+typedef struct _ModestDbusClient ModestDbusClient;
+
+/**
+ * libmodest_dbus_client_new:
+ * @osso_context: a valid osso_context instance
+ *
+ * gets the #ModestDbusClient of the D-Bus connection of @osso_context,
+ * creating it the first time.
+ *
+ * Returns: a new reference to the client, or %NULL on error
+ */
+ModestDbusClient *libmodest_dbus_client_new (osso_context_t *osso_context);
+
+ModestDbusClient *libmodest_dbus_client_ref (ModestDbusClient *client);
+
+void libmodest_dbus_client_unref (ModestDbusClient *client);
+
+typedef void (*ModestAccountSignalFunc) (ModestDbusClient *client,
+					 const gchar *account_id,
+					 gpointer user_data);
+
+typedef void (*ModestFolderUpdatedFunc) (ModestDbusClient *client,
+					 const gchar *account_id,
+					 const gchar *folder_id,
+					 gpointer user_data);
+
+typedef void (*ModestMsgReadChangedFunc) (ModestDbusClient *client,
+					  const gchar *msg_id,
+					  gboolean read,
+					  gpointer user_data);
+
+/**
+ * libmodest_dbus_client_subscribe_account_created:
+ * @client: a #ModestDbusClient
+ * @func: function to call for every account_created signal
+ * @user_data: data to pass to @func
+ * @destroy: function to free @user_data, or %NULL
+ *
+ * subscribes to a signal of modest; only the signals asked for are
+ * delivered to this process by the bus.
+ *
+ * Returns: the id of the subscription, for libmodest_dbus_client_unsubscribe()
+ */
+gulong libmodest_dbus_client_subscribe_account_created (ModestDbusClient *client,
+							ModestAccountSignalFunc func,
+							gpointer user_data,
+							GDestroyNotify destroy);
+
+/**
+ * libmodest_dbus_client_subscribe_account_removed:
+ * @account_id: the account to watch, or %NULL for all the accounts
+ *
+ * like libmodest_dbus_client_subscribe_account_created(), for account_removed.
+ */
+gulong libmodest_dbus_client_subscribe_account_removed (ModestDbusClient *client,
+							const gchar *account_id,
+							ModestAccountSignalFunc func,
+							gpointer user_data,
+							GDestroyNotify destroy);
+
+/**
+ * libmodest_dbus_client_subscribe_folder_updated:
+ * @account_id: the account to watch, or %NULL for all the accounts
+ *
+ * like libmodest_dbus_client_subscribe_account_created(), for folder_updated.
+ */
+gulong libmodest_dbus_client_subscribe_folder_updated (ModestDbusClient *client,
+						       const gchar *account_id,
+						       ModestFolderUpdatedFunc func,
+						       gpointer user_data,
+						       GDestroyNotify destroy);
+
+gulong libmodest_dbus_client_subscribe_msg_read_changed (ModestDbusClient *client,
+							 ModestMsgReadChangedFunc func,
+							 gpointer user_data,
+							 GDestroyNotify destroy);
+
+void libmodest_dbus_client_unsubscribe (ModestDbusClient *client,
+					gulong subscription_id);
+
+/**
+ * libmodest_dbus_client_set_timeout:
+ * @client: a #ModestDbusClient
+ * @method: a method name from libmodest-dbus-api.h, or %NULL for all the methods
+ * @timeout_ms: the timeout in milliseconds, or -1 to restore the default one
+ *
+ * sets how long the calls to @method wait for modest to answer.
+ *
+ * Returns: FALSE if @method is unknown
+ */
+gboolean libmodest_dbus_client_set_timeout (ModestDbusClient *client,
+					    const gchar *method,
+					    gint timeout_ms);
+
+/**
+ * libmodest_dbus_client_set_adaptive_timeouts:
+ * @client: a #ModestDbusClient
+ * @adaptive: TRUE to derive the timeouts from the observed latencies
+ *
+ * in adaptive mode, the timeout of each method follows its recent latencies,
+ * bounded by the timeout set with libmodest_dbus_client_set_timeout().
+ */
+void libmodest_dbus_client_set_adaptive_timeouts (ModestDbusClient *client,
+						  gboolean adaptive);
+
+#define MODEST_DBUS_CLIENT_LATENCY_BUCKETS 28
+
+/**
+ * ModestDbusMethodStats:
+ *
+ * the statistics of the calls to a method of modest. result_bytes is the
+ * payload length of the arrays of results of the replies, without their
+ * header and other arguments; replies without such an array count 0.
+ * latency_buckets[i] counts the answered calls that took from 2^i to
+ * 2^(i+1) microseconds (from 0 for the first bucket, and without upper
+ * limit for the last one).
+ */
+typedef struct {
+	const gchar *method;
+	guint64      calls;
+	guint64      failures;
+	guint64      timeouts;
+	guint64      result_bytes;
+	guint64      items_decoded;
+	guint64      latency_buckets[MODEST_DBUS_CLIENT_LATENCY_BUCKETS];
+} ModestDbusMethodStats;
+
+/**
+ * libmodest_dbus_client_get_stats:
+ * @client: a #ModestDbusClient
+ * @n_stats: return location for the number of elements
+ *
+ * takes a snapshot of the per-method statistics; this can be done from
+ * any thread.
+ *
+ * Returns: an array of @n_stats #ModestDbusMethodStats, to free with g_free()
+ */
+ModestDbusMethodStats *libmodest_dbus_client_get_stats (ModestDbusClient *client,
+							guint *n_stats);
+
+/**
+ * libmodest_dbus_method_stats_get_percentile:
+ *
+ * Returns: the upper bound, in microseconds, of the latency of @percentile
+ * percent of the answered calls
+ */
+guint64 libmodest_dbus_method_stats_get_percentile (const ModestDbusMethodStats *stats,
+						    gdouble percentile);
+
+void libmodest_dbus_client_dump_stats (ModestDbusClient *client, FILE *file);
+
+#define MODEST_DBUS_CLIENT_EVENT_LOG_SIZE 256
+
+typedef enum {
+	MODEST_DBUS_EVENT_OK,
+	MODEST_DBUS_EVENT_ERROR,
+	MODEST_DBUS_EVENT_TIMEOUT,
+	MODEST_DBUS_EVENT_SEND_FAILED,
+	MODEST_DBUS_EVENT_NOT_RUNNING
+} ModestDbusEventResult;
+
+/**
+ * ModestDbusEvent:
+ *
+ * a call to modest, as kept in the event log of the client. time is the
+ * wall-clock time at which it ended and duration how long it took, both
+ * in microseconds; calls that do not wait for a reply take no time.
+ */
+typedef struct {
+	gint64                time;
+	gint64                duration;
+	const gchar          *method;
+	ModestDbusEventResult result;
+	guint32               serial;
+} ModestDbusEvent;
+
+/**
+ * libmodest_dbus_client_get_events:
+ * @client: a #ModestDbusClient
+ * @n_events: return location for the number of elements
+ *
+ * takes a snapshot of the last MODEST_DBUS_CLIENT_EVENT_LOG_SIZE calls,
+ * oldest first; this can be done from any thread.
+ *
+ * Returns: an array of @n_events #ModestDbusEvent, to free with g_free()
+ */
+ModestDbusEvent *libmodest_dbus_client_get_events (ModestDbusClient *client,
+						   guint *n_events);
+
+/**
+ * libmodest_dbus_client_dump_events:
+ * @client: a #ModestDbusClient
+ * @fd: where to write the events, such as STDERR_FILENO
+ *
+ * writes the event log, one call per line. this only uses write(), so it
+ * can be called from a handler of SIGSEGV or SIGABRT.
+ */
+void libmodest_dbus_client_dump_events (ModestDbusClient *client, int fd);
+
+/**
+ * libmodest_dbus_client_is_running:
+ * @client: a #ModestDbusClient
+ *
+ * tells whether modest is running, without calling it; the client
+ * follows the owner of the modest service on the bus.
+ *
+ * Returns: TRUE if modest is running, FALSE otherwise
+ */
+gboolean libmodest_dbus_client_is_running (ModestDbusClient *client);
+
+/**
+ * libmodest_dbus_client_set_only_if_running:
+ * @client: a #ModestDbusClient
+ * @only_if_running: TRUE to never start modest
+ *
+ * if @only_if_running is TRUE, calls do not start modest, and fail at once
+ * with %MODEST_DBUS_CLIENT_ERROR_NOT_RUNNING while it is not running.
+ */
+void libmodest_dbus_client_set_only_if_running (ModestDbusClient *client,
+						gboolean only_if_running);
+
 
 /**
  * libmodest_dbus_client_compose_mail:
@@ -131,6 +370,35 @@ gboolean libmodest_dbus_client_send_and_receive_full (osso_context_t *osso_conte
 gboolean libmodest_dbus_client_update_folder_counts (osso_context_t *osso_context,
 						     const gchar *account);
 
+/**
+ * libmodest_dbus_client_set_coalesce_window:
+ * @client: a #ModestDbusClient
+ * @window_ms: the coalescing window in milliseconds, or 0 to disable it
+ *
+ * if @window_ms is not 0, the requests made with the _coalesced() functions
+ * below are queued for @window_ms and merged with the same requests for the
+ * same account made in the meantime; a manual send/receive wins over an
+ * automatic one. The other functions never coalesce.
+ */
+void libmodest_dbus_client_set_coalesce_window (ModestDbusClient *client,
+						guint window_ms);
+
+/**
+ * libmodest_dbus_client_send_and_receive_coalesced:
+ * @client: a #ModestDbusClient
+ *
+ * like libmodest_dbus_client_send_and_receive(), coalesced with the same
+ * requests; returns TRUE once the request is queued.
+ */
+gboolean libmodest_dbus_client_send_and_receive_coalesced (ModestDbusClient *client);
+
+gboolean libmodest_dbus_client_send_and_receive_full_coalesced (ModestDbusClient *client,
+								const gchar      *account,
+								gboolean          manual);
+
+gboolean libmodest_dbus_client_update_folder_counts_coalesced (ModestDbusClient *client,
+							       const gchar      *account);
+
 
 
 /**
@@ -177,6 +445,42 @@ gboolean libmodest_dbus_client_open_default_inbox (osso_context_t *osso_context)
 gboolean libmodest_dbus_client_open_account (osso_context_t *osso_context,
 					     const gchar *account_id);
 
+/*
+ * fire-and-forget versions of the functions above: they return as soon as the
+ * request has been queued, without waiting for modest to answer, so several
+ * of them can be sent back to back without any round trip.
+ */
+gboolean libmodest_dbus_client_mail_to_no_reply (osso_context_t *osso_context,
+						 const gchar *mailto_uri);
+
+gboolean libmodest_dbus_client_open_message_no_reply (osso_context_t *osso_context,
+						      const gchar *mail_uri);
+
+gboolean libmodest_dbus_client_open_account_no_reply (osso_context_t *osso_context,
+						      const gchar *account_id);
+
+gboolean libmodest_dbus_client_open_default_inbox_no_reply (osso_context_t *osso_context);
+
+gboolean libmodest_dbus_client_open_edit_accounts_dialog_no_reply (osso_context_t *osso_context);
+
+/**
+ * libmodest_dbus_client_flush:
+ * @osso_context: a valid osso_context instance
+ *
+ * blocks until the queued requests have been written to the bus
+ */
+void libmodest_dbus_client_flush (osso_context_t *osso_context);
+
+/**
+ * libmodest_dbus_client_sync:
+ * @osso_context: a valid osso_context instance
+ *
+ * blocks until modest has received all the requests sent before
+ *
+ * Returns: TRUE upon success, FALSE otherwise
+ */
+gboolean libmodest_dbus_client_sync (osso_context_t *osso_context);
+
 /*
  * below: functions specific to osso-global-search; not useful for other clients.
  *
@@ -217,6 +521,268 @@ gboolean libmodest_dbus_client_search            (osso_context_t          *osso_
 						  ModestDBusSearchFlags    flags,
 						  GList                  **hits);
 
+/**
+ * libmodest_dbus_client_search_async:
+ *
+ * asynchronous version of libmodest_dbus_client_search(); @callback is
+ * invoked from the main loop once modest has replied, and should call
+ * libmodest_dbus_client_search_finish() to get the hits.
+ */
+void     libmodest_dbus_client_search_async      (osso_context_t          *osso_ctx,
+						  const gchar             *query,
+						  const gchar             *folder,
+						  time_t                   start_date,
+						  time_t                   end_date,
+						  guint32                  min_size,
+						  ModestDBusSearchFlags    flags,
+						  GCancellable            *cancellable,
+						  GAsyncReadyCallback      callback,
+						  gpointer                 user_data);
+
+gboolean libmodest_dbus_client_search_finish     (GAsyncResult            *result,
+						  GList                  **hits,
+						  GError                 **error);
+
+/**
+ * ModestSearchChunkFunc:
+ * @search_id: the id returned by libmodest_dbus_client_search_stream()
+ * @hits: a chunk of #ModestSearchHit; they are freed when the function returns
+ * @finished: %TRUE if this is the last call for this search
+ * @error: the error that ended the search, or %NULL
+ * @user_data: the data passed to libmodest_dbus_client_search_stream()
+ */
+typedef void (*ModestSearchChunkFunc) (guint         search_id,
+				       GList        *hits,
+				       gboolean      finished,
+				       const GError *error,
+				       gpointer      user_data);
+
+/**
+ * libmodest_dbus_client_search_stream:
+ *
+ * starts a search whose hits are delivered to @chunk_func in chunks of
+ * at most @chunk_size hits, as modest finds them.
+ *
+ * Returns: the id of the search, or 0 on error
+ */
+guint    libmodest_dbus_client_search_stream     (osso_context_t          *osso_ctx,
+						  const gchar             *query,
+						  const gchar             *folder,
+						  time_t                   start_date,
+						  time_t                   end_date,
+						  guint32                  min_size,
+						  ModestDBusSearchFlags    flags,
+						  guint                    chunk_size,
+						  ModestSearchChunkFunc    chunk_func,
+						  gpointer                 user_data,
+						  GDestroyNotify           destroy);
+
+void     libmodest_dbus_client_search_stream_cancel (osso_context_t       *osso_ctx,
+						     guint                 search_id);
+
+/**
+ * libmodest_dbus_client_search_array:
+ *
+ * like libmodest_dbus_client_search(), returning the hits in a #GPtrArray,
+ * in the order modest sent them; g_ptr_array_unref() frees them too.
+ */
+gboolean libmodest_dbus_client_search_array      (osso_context_t          *osso_ctx,
+						  const gchar             *query,
+						  const gchar             *folder,
+						  time_t                   start_date,
+						  time_t                   end_date,
+						  guint32                  min_size,
+						  ModestDBusSearchFlags    flags,
+						  GPtrArray              **hits);
+
+/**
+ * ModestSearchHitView:
+ * @hits: the hits, in the order modest sent them
+ * @n_hits: the number of hits
+ *
+ * search hits whose strings are not copied: they point into the reply of
+ * modest, which the view keeps until modest_search_hit_view_free(). The
+ * hits must not be modified, and are only valid until then.
+ */
+typedef struct {
+	const ModestSearchHit *hits;
+	guint                  n_hits;
+} ModestSearchHitView;
+
+void modest_search_hit_view_free (ModestSearchHitView *hits);
+
+/**
+ * libmodest_dbus_client_search_view:
+ *
+ * like libmodest_dbus_client_search(), returning a #ModestSearchHitView,
+ * which is the cheapest to build for short-lived uses of the hits.
+ */
+gboolean libmodest_dbus_client_search_view       (osso_context_t          *osso_ctx,
+						  const gchar             *query,
+						  const gchar             *folder,
+						  time_t                   start_date,
+						  time_t                   end_date,
+						  guint32                  min_size,
+						  ModestDBusSearchFlags    flags,
+						  ModestSearchHitView    **hits);
+
+typedef enum {
+	MODEST_DBUS_SEARCH_SORT_TIMESTAMP,
+	MODEST_DBUS_SEARCH_SORT_SIZE
+} ModestDBusSearchSortKey;
+
+/**
+ * libmodest_dbus_client_search_top:
+ * @sort_key: what to sort the hits on
+ * @descending: TRUE to get the newest or largest messages first
+ * @max_hits: the maximum number of hits
+ * @hits: return location for a #GPtrArray of #ModestSearchHit
+ *
+ * like libmodest_dbus_client_search(), getting only the first @max_hits
+ * hits in the given order, sorted.
+ */
+gboolean libmodest_dbus_client_search_top        (osso_context_t          *osso_ctx,
+						  const gchar             *query,
+						  const gchar             *folder,
+						  time_t                   start_date,
+						  time_t                   end_date,
+						  guint32                  min_size,
+						  ModestDBusSearchFlags    flags,
+						  ModestDBusSearchSortKey  sort_key,
+						  gboolean                 descending,
+						  guint                    max_hits,
+						  GPtrArray              **hits);
+
+/**
+ * ModestSearchCursor:
+ *
+ * the state of a search whose hits are got page by page.
+ */
+typedef struct _ModestSearchCursor ModestSearchCursor;
+
+/**
+ * libmodest_dbus_client_search_paged:
+ * @page_size: the maximum number of hits per page
+ * @hits: return location for the first page, a #GPtrArray of #ModestSearchHit
+ * @cursor: return location for the cursor to the next pages
+ *
+ * like libmodest_dbus_client_search(), getting only the first @page_size
+ * hits; the next ones are got with libmodest_dbus_client_search_next_page().
+ */
+gboolean libmodest_dbus_client_search_paged      (osso_context_t          *osso_ctx,
+						  const gchar             *query,
+						  const gchar             *folder,
+						  time_t                   start_date,
+						  time_t                   end_date,
+						  guint32                  min_size,
+						  ModestDBusSearchFlags    flags,
+						  guint                    page_size,
+						  GPtrArray              **hits,
+						  ModestSearchCursor     **cursor);
+
+gboolean libmodest_dbus_client_search_next_page  (ModestSearchCursor      *cursor,
+						  GPtrArray              **hits);
+
+gboolean libmodest_dbus_client_search_cursor_is_done (ModestSearchCursor  *cursor);
+
+/**
+ * libmodest_dbus_client_search_cursor_close:
+ *
+ * frees @cursor; modest forgets the rest of the search.
+ */
+void     libmodest_dbus_client_search_cursor_close (ModestSearchCursor    *cursor);
+
+/**
+ * ModestDbusInternMode:
+ * @MODEST_DBUS_INTERN_NONE: every string is copied
+ * @MODEST_DBUS_INTERN_RESULT: equal strings share one copy within a set
+ * @MODEST_DBUS_INTERN_PROCESS: equal strings share one copy across the
+ * process, made with g_intern_string() and never freed
+ *
+ * how the strings that repeat across the items of a #ModestSearchHitSet
+ * or #ModestAccountHitsSet are stored: the folder and sender of the hits
+ * and the store protocol of the accounts. When they are shared, equal
+ * strings can be compared by pointer.
+ */
+typedef enum {
+	MODEST_DBUS_INTERN_NONE,
+	MODEST_DBUS_INTERN_RESULT,
+	MODEST_DBUS_INTERN_PROCESS
+} ModestDbusInternMode;
+
+/**
+ * libmodest_dbus_client_set_intern_mode:
+ * @client: a #ModestDbusClient
+ * @intern_mode: how to store the repeated strings of the sets
+ *
+ * sets how the sets returned through @client store their repeated
+ * strings; %MODEST_DBUS_INTERN_NONE by default.
+ */
+void libmodest_dbus_client_set_intern_mode (ModestDbusClient *client,
+					    ModestDbusInternMode intern_mode);
+
+/**
+ * ModestSearchHitSet:
+ * @hits: the hits, in the order modest sent them
+ * @n_hits: the number of hits
+ *
+ * search hits whose structs and strings are allocated in a few large
+ * blocks, all freed at once with modest_search_hit_set_free(); the
+ * hits and strings cannot be freed or reallocated one by one.
+ */
+typedef struct {
+	ModestSearchHit *hits;
+	guint            n_hits;
+} ModestSearchHitSet;
+
+void modest_search_hit_set_free (ModestSearchHitSet *hits);
+
+/**
+ * libmodest_dbus_client_search_set:
+ *
+ * like libmodest_dbus_client_search(), returning the hits as a
+ * #ModestSearchHitSet, which is much cheaper to build and free for
+ * large results.
+ */
+gboolean libmodest_dbus_client_search_set        (osso_context_t          *osso_ctx,
+						  const gchar             *query,
+						  const gchar             *folder,
+						  time_t                   start_date,
+						  time_t                   end_date,
+						  guint32                  min_size,
+						  ModestDBusSearchFlags    flags,
+						  ModestSearchHitSet     **hits);
+
+typedef enum {
+	MODEST_DBUS_SEARCH_FIELD_MSGID          = (1 << 0),
+	MODEST_DBUS_SEARCH_FIELD_SUBJECT        = (1 << 1),
+	MODEST_DBUS_SEARCH_FIELD_FOLDER         = (1 << 2),
+	MODEST_DBUS_SEARCH_FIELD_SENDER         = (1 << 3),
+	MODEST_DBUS_SEARCH_FIELD_SIZE           = (1 << 4),
+	MODEST_DBUS_SEARCH_FIELD_HAS_ATTACHMENT = (1 << 5),
+	MODEST_DBUS_SEARCH_FIELD_IS_UNREAD      = (1 << 6),
+	MODEST_DBUS_SEARCH_FIELD_TIMESTAMP      = (1 << 7),
+	MODEST_DBUS_SEARCH_FIELD_ALL            = 0xff
+} ModestDBusSearchFields;
+
+/**
+ * libmodest_dbus_client_search_fields:
+ * @fields: the fields of the hits to get
+ * @hits: return location for the hits, to free with modest_search_hit_set_free()
+ *
+ * like libmodest_dbus_client_search_set(), getting only @fields of the
+ * hits; the others are %NULL or 0.
+ */
+gboolean libmodest_dbus_client_search_fields     (osso_context_t          *osso_ctx,
+						  const gchar             *query,
+						  const gchar             *folder,
+						  time_t                   start_date,
+						  time_t                   end_date,
+						  guint32                  min_size,
+						  ModestDBusSearchFlags    flags,
+						  ModestDBusSearchFields   fields,
+						  ModestSearchHitSet     **hits);
+
 typedef struct {
 	gchar *subject;
 	time_t timestamp;
@@ -237,9 +803,128 @@ gboolean libmodest_dbus_client_get_unread_messages (osso_context_t *osso_ctx,
 						    gint msgs_per_account,
 						    GList **account_hits_list);
 
+/**
+ * libmodest_dbus_client_get_unread_messages_async:
+ *
+ * asynchronous version of libmodest_dbus_client_get_unread_messages();
+ * @callback should call libmodest_dbus_client_get_unread_messages_finish().
+ */
+void libmodest_dbus_client_get_unread_messages_async (osso_context_t *osso_ctx,
+						      gint msgs_per_account,
+						      GCancellable *cancellable,
+						      GAsyncReadyCallback callback,
+						      gpointer user_data);
+
+gboolean libmodest_dbus_client_get_unread_messages_finish (GAsyncResult *result,
+							   GList **account_hits_list,
+							   GError **error);
+
+/**
+ * libmodest_dbus_client_get_unread_messages_array:
+ *
+ * like libmodest_dbus_client_get_unread_messages(), returning a #GPtrArray
+ * of #ModestAccountHits; the accounts and their hits are in the order
+ * modest sent them.
+ */
+gboolean libmodest_dbus_client_get_unread_messages_array (osso_context_t *osso_ctx,
+							  gint msgs_per_account,
+							  GPtrArray **account_hits);
+
+/**
+ * ModestAccountHitsSet:
+ * @accounts: the accounts, in the order modest sent them
+ * @n_accounts: the number of accounts
+ *
+ * like #ModestSearchHitSet, for unread messages. The hits of each
+ * account, and their list nodes, are in the set too, in the order modest
+ * sent them; the lists must not be modified. Free with
+ * modest_account_hits_set_free().
+ */
+typedef struct {
+	ModestAccountHits *accounts;
+	guint              n_accounts;
+} ModestAccountHitsSet;
+
+void modest_account_hits_set_free (ModestAccountHitsSet *account_hits);
+
+/**
+ * libmodest_dbus_client_get_unread_messages_set:
+ *
+ * like libmodest_dbus_client_get_unread_messages(), returning a
+ * #ModestAccountHitsSet.
+ */
+gboolean libmodest_dbus_client_get_unread_messages_set (osso_context_t *osso_ctx,
+							gint msgs_per_account,
+							ModestAccountHitsSet **account_hits);
+
+/**
+ * ModestUnreadModel:
+ *
+ * the unread messages of every account, kept up to date from the
+ * signals of modest.
+ */
+typedef struct _ModestUnreadModel ModestUnreadModel;
+
+typedef void (*ModestUnreadModelChangedFunc) (ModestUnreadModel *model,
+					      gpointer user_data);
+
+/**
+ * libmodest_dbus_client_unread_model_new:
+ * @client: a #ModestDbusClient
+ * @msgs_per_account: the maximum number of unread messages to keep per account
+ *
+ * creates a model that is filled from modest once and then updated when
+ * modest signals changes, so that reading it does not need any call.
+ *
+ * Returns: the new model, or %NULL on error
+ */
+ModestUnreadModel *libmodest_dbus_client_unread_model_new (ModestDbusClient *client,
+							   gint msgs_per_account);
+
+ModestUnreadModel *libmodest_dbus_client_unread_model_ref (ModestUnreadModel *model);
+
+void libmodest_dbus_client_unread_model_unref (ModestUnreadModel *model);
+
+gboolean libmodest_dbus_client_unread_model_is_ready (ModestUnreadModel *model);
+
+/**
+ * libmodest_dbus_client_unread_model_get_account_hits:
+ * @model: a #ModestUnreadModel
+ *
+ * Returns: the list of #ModestAccountHits, owned by @model and valid until
+ * it changes
+ */
+const GList *libmodest_dbus_client_unread_model_get_account_hits (ModestUnreadModel *model);
+
+gint libmodest_dbus_client_unread_model_get_unread_count (ModestUnreadModel *model,
+							  const gchar *account_id);
+
+gulong libmodest_dbus_client_unread_model_add_watch (ModestUnreadModel *model,
+						     ModestUnreadModelChangedFunc func,
+						     gpointer user_data,
+						     GDestroyNotify destroy);
+
+void libmodest_dbus_client_unread_model_remove_watch (ModestUnreadModel *model,
+						      gulong watch_id);
+
 gboolean libmodest_dbus_client_delete_message   (osso_context_t   *osso_ctx,
 						 const char       *msg_uri);
 
+/**
+ * libmodest_dbus_client_delete_messages:
+ * @osso_ctx: a valid osso_context instance
+ * @msg_uris: a %NULL-terminated array of message URIs
+ * @results: return location for a newly allocated array of one #gboolean per
+ * URI, telling whether that message was deleted, or %NULL. Free with g_free().
+ *
+ * deletes all the messages in @msg_uris with a single call to modest.
+ *
+ * Returns: TRUE if modest processed the request, FALSE otherwise
+ */
+gboolean libmodest_dbus_client_delete_messages  (osso_context_t       *osso_ctx,
+						 const gchar * const  *msg_uris,
+						 gboolean            **results);
+
 
 typedef struct {
 	gchar     *folder_uri;
@@ -248,8 +933,43 @@ typedef struct {
 
 gboolean libmodest_dbus_client_get_folders (osso_context_t *osso_ctx, GList **folders);	
 
+/**
+ * libmodest_dbus_client_get_folders_async:
+ *
+ * asynchronous version of libmodest_dbus_client_get_folders();
+ * @callback should call libmodest_dbus_client_get_folders_finish().
+ */
+void libmodest_dbus_client_get_folders_async (osso_context_t *osso_ctx,
+					      GCancellable *cancellable,
+					      GAsyncReadyCallback callback,
+					      gpointer user_data);
+
+gboolean libmodest_dbus_client_get_folders_finish (GAsyncResult *result,
+						   GList **folders,
+						   GError **error);
+
 void modest_folder_result_list_free (GList *folders);
 
+/**
+ * libmodest_dbus_client_get_folders_array:
+ *
+ * like libmodest_dbus_client_get_folders(), returning a #GPtrArray of
+ * #ModestFolderResult.
+ */
+gboolean libmodest_dbus_client_get_folders_array (osso_context_t *osso_ctx,
+						  GPtrArray **folders);
+
+/**
+ * libmodest_dbus_client_set_folder_cache:
+ * @client: a #ModestDbusClient
+ * @enabled: TRUE to cache the folder list
+ *
+ * if @enabled is TRUE, the folder list is kept in memory and only fetched
+ * again from modest after it signals a change of its folders or accounts.
+ */
+void libmodest_dbus_client_set_folder_cache (ModestDbusClient *client,
+					     gboolean enabled);
+
 						
 							
 #endif /* __LIBMODEST_DBUS_CLIENT_H__ */
@@ -0,0 +1,472 @@
+/* Copyright (c) 2007, Nokia Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the name of the Nokia Corporation nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __LIBMODEST_DBUS_MARSHAL_H__
+#define __LIBMODEST_DBUS_MARSHAL_H__
+
+#include "libmodest-dbus-client.h"
+
+#include <dbus/dbus.h>
+#include <string.h>
+
+/*
+ * Generates, for every type of libmodest-dbus-types.def:
+ *
+ * modest_dbus_NAME_signature            its D-Bus signature
+ * modest_dbus_message_is_NAME_list ()   whether a message is an array of it
+ * modest_dbus_read_NAME_list ()         decodes an array of it, in reverse
+ *                                       order, once the signature is checked
+ * modest_dbus_write_NAME ()             encodes one, within an array
+ * modest_dbus_write_NAME_list ()        encodes a list of them as an array
+ * modest_dbus_free_NAME_list ()         frees a list of them
+ * modest_dbus_read_NAME_ptr_array ()    decodes an array of it, in order,
+ *                                       into a #GPtrArray owning the items
+ * modest_dbus_read_NAME_array_in ()     decodes an array of it, in order,
+ *                                       into a #ModestDbusArena
+ * modest_dbus_read_NAME_list_in ()      the same, as a list whose nodes
+ *                                       are in the arena too
+ *
+ * Only the signature of the whole message is checked, once, so the
+ * decoders read the fields straight through. The list decoders set
+ * their n_items, if not %NULL, to the number of items they read, so
+ * that the list is not walked again to count them.
+ */
+
+/*
+ * ModestDbusArena: where the _in decoders put the items, their strings
+ * and list nodes, in a few large blocks, all freed together by
+ * modest_dbus_arena_clear(). Nothing in it can be freed alone.
+ *
+ * With borrow_strings, the strings are not copied but point into the
+ * message being decoded, which must then outlive the arena.
+ */
+typedef struct {
+	GStringChunk *strings;
+	GSList       *blocks;
+	gchar        *free_space;
+	gsize         free_size;
+	ModestDbusInternMode intern_mode; /* for the SHARED_STRING fields */
+	gboolean      borrow_strings;
+} ModestDbusArena;
+
+#define MODEST_DBUS_ARENA_BLOCK_SIZE 65536
+#define MODEST_DBUS_ARENA_ALIGN      8
+
+static G_GNUC_UNUSED void
+modest_dbus_arena_init (ModestDbusArena *arena, ModestDbusInternMode intern_mode)
+{
+	arena->strings = g_string_chunk_new (MODEST_DBUS_ARENA_BLOCK_SIZE);
+	arena->blocks = NULL;
+	arena->free_space = NULL;
+	arena->free_size = 0;
+	arena->intern_mode = intern_mode;
+	arena->borrow_strings = FALSE;
+}
+
+static G_GNUC_UNUSED gpointer
+modest_dbus_arena_alloc (ModestDbusArena *arena, gsize size)
+{
+	gpointer mem;
+
+	size = (size + MODEST_DBUS_ARENA_ALIGN - 1) & ~(gsize) (MODEST_DBUS_ARENA_ALIGN - 1);
+
+	if (size == 0) {
+		return NULL;
+	}
+
+	/* Large arrays get a block of their own, so that the free space
+	 * left in the current block is not lost */
+	if (size > MODEST_DBUS_ARENA_BLOCK_SIZE / 4) {
+		mem = g_malloc (size);
+		arena->blocks = g_slist_prepend (arena->blocks, mem);
+		return mem;
+	}
+
+	if (size > arena->free_size) {
+		arena->free_space = g_malloc (MODEST_DBUS_ARENA_BLOCK_SIZE);
+		arena->free_size = MODEST_DBUS_ARENA_BLOCK_SIZE;
+		arena->blocks = g_slist_prepend (arena->blocks, arena->free_space);
+	}
+
+	mem = arena->free_space;
+	arena->free_space += size;
+	arena->free_size -= size;
+
+	return mem;
+}
+
+/* Copies @str into @arena, unless it borrows the strings */
+static G_GNUC_UNUSED gchar *
+modest_dbus_arena_insert (ModestDbusArena *arena, const gchar *str)
+{
+	if (arena->borrow_strings) {
+		return (gchar *) str;
+	}
+
+	return g_string_chunk_insert (arena->strings, str);
+}
+
+/* The same, or shares an equal string, as its intern_mode says */
+static G_GNUC_UNUSED gchar *
+modest_dbus_arena_insert_shared (ModestDbusArena *arena, const gchar *str)
+{
+	if (arena->borrow_strings) {
+		return (gchar *) str;
+	}
+
+	switch (arena->intern_mode) {
+	case MODEST_DBUS_INTERN_RESULT:
+		return g_string_chunk_insert_const (arena->strings, str);
+	case MODEST_DBUS_INTERN_PROCESS:
+		return (gchar *) g_intern_string (str);
+	default:
+		return g_string_chunk_insert (arena->strings, str);
+	}
+}
+
+static G_GNUC_UNUSED void
+modest_dbus_arena_clear (ModestDbusArena *arena)
+{
+	g_slist_free_full (arena->blocks, g_free);
+	g_string_chunk_free (arena->strings);
+	arena->blocks = NULL;
+	arena->strings = NULL;
+	arena->free_space = NULL;
+	arena->free_size = 0;
+}
+
+/* The number of structs in the array at @array */
+static G_GNUC_UNUSED guint
+modest_dbus_count_structs (DBusMessageIter *array)
+{
+	DBusMessageIter items;
+	guint n_items = 0;
+
+	dbus_message_iter_recurse (array, &items);
+	while (dbus_message_iter_get_arg_type (&items) == DBUS_TYPE_STRUCT) {
+		n_items++;
+		dbus_message_iter_next (&items);
+	}
+
+	return n_items;
+}
+
+#define MODEST_DBUS_READ_STRING(iter, dest)						\
+	G_STMT_START {								\
+		const char *str_;						\
+		dbus_message_iter_get_basic (iter, &str_);			\
+		dest = *str_ ? g_strdup (str_) : NULL;				\
+	} G_STMT_END
+#define MODEST_DBUS_READ_SHARED_STRING(iter, dest) MODEST_DBUS_READ_STRING (iter, dest)
+#define MODEST_DBUS_READ_BOOLEAN(iter, dest)						\
+	G_STMT_START {								\
+		dbus_bool_t bool_;						\
+		dbus_message_iter_get_basic (iter, &bool_);			\
+		dest = bool_ != FALSE;						\
+	} G_STMT_END
+#define MODEST_DBUS_READ_INT64(iter, dest)						\
+	G_STMT_START {								\
+		dbus_int64_t int64_;						\
+		dbus_message_iter_get_basic (iter, &int64_);			\
+		dest = int64_;							\
+	} G_STMT_END
+#define MODEST_DBUS_READ_UINT64(iter, dest)						\
+	G_STMT_START {								\
+		dbus_uint64_t uint64_;						\
+		dbus_message_iter_get_basic (iter, &uint64_);			\
+		dest = uint64_;							\
+	} G_STMT_END
+
+/* The same, with the strings in an arena, or borrowed from the message */
+#define MODEST_DBUS_READ_IN_STRING(iter, dest, arena)					\
+	G_STMT_START {								\
+		const char *str_;						\
+		dbus_message_iter_get_basic (iter, &str_);			\
+		dest = *str_ ? modest_dbus_arena_insert (arena, str_) : NULL;	\
+	} G_STMT_END
+#define MODEST_DBUS_READ_IN_SHARED_STRING(iter, dest, arena)				\
+	G_STMT_START {								\
+		const char *str_;						\
+		dbus_message_iter_get_basic (iter, &str_);			\
+		dest = *str_ ? modest_dbus_arena_insert_shared (arena, str_) : NULL; \
+	} G_STMT_END
+#define MODEST_DBUS_READ_IN_BOOLEAN(iter, dest, arena) MODEST_DBUS_READ_BOOLEAN (iter, dest)
+#define MODEST_DBUS_READ_IN_INT64(iter, dest, arena)   MODEST_DBUS_READ_INT64 (iter, dest)
+#define MODEST_DBUS_READ_IN_UINT64(iter, dest, arena)  MODEST_DBUS_READ_UINT64 (iter, dest)
+
+#define MODEST_DBUS_WRITE_STRING(iter, src)						\
+	G_STMT_START {								\
+		const char *str_ = (src) ? (src) : "";				\
+		dbus_message_iter_append_basic (iter, DBUS_TYPE_STRING, &str_);	\
+	} G_STMT_END
+#define MODEST_DBUS_WRITE_SHARED_STRING(iter, src) MODEST_DBUS_WRITE_STRING (iter, src)
+#define MODEST_DBUS_WRITE_BOOLEAN(iter, src)						\
+	G_STMT_START {								\
+		dbus_bool_t bool_ = (src) != FALSE;				\
+		dbus_message_iter_append_basic (iter, DBUS_TYPE_BOOLEAN, &bool_); \
+	} G_STMT_END
+#define MODEST_DBUS_WRITE_INT64(iter, src)						\
+	G_STMT_START {								\
+		dbus_int64_t int64_ = (src);					\
+		dbus_message_iter_append_basic (iter, DBUS_TYPE_INT64, &int64_);	\
+	} G_STMT_END
+#define MODEST_DBUS_WRITE_UINT64(iter, src)						\
+	G_STMT_START {								\
+		dbus_uint64_t uint64_ = (src);					\
+		dbus_message_iter_append_basic (iter, DBUS_TYPE_UINT64, &uint64_); \
+	} G_STMT_END
+
+#define MODEST_DBUS_FREE_STRING(field)  g_free (field)
+#define MODEST_DBUS_FREE_SHARED_STRING(field)  g_free (field)
+#define MODEST_DBUS_FREE_BOOLEAN(field)
+#define MODEST_DBUS_FREE_INT64(field)
+#define MODEST_DBUS_FREE_UINT64(field)
+
+/* The signatures */
+#define MODEST_DBUS_STRUCT(name, CType, signature)					\
+	static const char modest_dbus_##name##_signature[] = signature;
+#define MODEST_DBUS_FIELD(field, kind)
+#define MODEST_DBUS_FIELD_LIST(field, item)
+#define MODEST_DBUS_STRUCT_END(name, CType)					\
+	static G_GNUC_UNUSED gboolean						\
+	modest_dbus_message_is_##name##_list (DBusMessage *msg)			\
+	{									\
+		const char *signature = dbus_message_get_signature (msg);	\
+										\
+		return signature[0] == DBUS_TYPE_ARRAY &&			\
+			strcmp (signature + 1, modest_dbus_##name##_signature) == 0; \
+	}
+#include "libmodest-dbus-types.def"
+#undef MODEST_DBUS_STRUCT
+#undef MODEST_DBUS_FIELD
+#undef MODEST_DBUS_FIELD_LIST
+#undef MODEST_DBUS_STRUCT_END
+
+/* The decoders */
+#define MODEST_DBUS_STRUCT(name, CType, signature)					\
+	static void								\
+	modest_dbus_read_##name (DBusMessageIter *parent, CType *item)		\
+	{									\
+		DBusMessageIter fields;						\
+										\
+		dbus_message_iter_recurse (parent, &fields);
+#define MODEST_DBUS_FIELD(field, kind)							\
+		MODEST_DBUS_READ_##kind (&fields, item->field);			\
+		dbus_message_iter_next (&fields);
+#define MODEST_DBUS_FIELD_LIST(field, item_name)					\
+		item->field = modest_dbus_read_##item_name##_list (&fields, NULL); \
+		dbus_message_iter_next (&fields);
+#define MODEST_DBUS_STRUCT_END(name, CType)					\
+	}									\
+										\
+	static G_GNUC_UNUSED GList *						\
+	modest_dbus_read_##name##_list (DBusMessageIter *array, guint *n_items) \
+	{									\
+		DBusMessageIter items;						\
+		GList *list = NULL;						\
+		guint n = 0;							\
+										\
+		dbus_message_iter_recurse (array, &items);			\
+		while (dbus_message_iter_get_arg_type (&items) == DBUS_TYPE_STRUCT) { \
+			CType *item = g_slice_new (CType);			\
+										\
+			modest_dbus_read_##name (&items, item);			\
+			list = g_list_prepend (list, item);			\
+			dbus_message_iter_next (&items);			\
+			n++;							\
+		}								\
+										\
+		if (n_items) {							\
+			*n_items = n;						\
+		}								\
+		return list;							\
+	}
+#include "libmodest-dbus-types.def"
+#undef MODEST_DBUS_STRUCT
+#undef MODEST_DBUS_FIELD
+#undef MODEST_DBUS_FIELD_LIST
+#undef MODEST_DBUS_STRUCT_END
+
+/* The encoders */
+#define MODEST_DBUS_STRUCT(name, CType, signature)					\
+	static G_GNUC_UNUSED void						\
+	modest_dbus_write_##name (DBusMessageIter *array, const CType *item)	\
+	{									\
+		DBusMessageIter fields;						\
+										\
+		dbus_message_iter_open_container (array, DBUS_TYPE_STRUCT, NULL, &fields);
+#define MODEST_DBUS_FIELD(field, kind)							\
+		MODEST_DBUS_WRITE_##kind (&fields, item->field);
+#define MODEST_DBUS_FIELD_LIST(field, item_name)					\
+		modest_dbus_write_##item_name##_list (&fields, item->field);
+#define MODEST_DBUS_STRUCT_END(name, CType)					\
+		dbus_message_iter_close_container (array, &fields);		\
+	}									\
+										\
+	static G_GNUC_UNUSED void						\
+	modest_dbus_write_##name##_list (DBusMessageIter *iter, GList *list)	\
+	{									\
+		DBusMessageIter array;						\
+										\
+		dbus_message_iter_open_container (iter, DBUS_TYPE_ARRAY,	\
+						  modest_dbus_##name##_signature, &array); \
+		for (; list; list = list->next) {				\
+			modest_dbus_write_##name (&array, list->data);		\
+		}								\
+		dbus_message_iter_close_container (iter, &array);		\
+	}
+#include "libmodest-dbus-types.def"
+#undef MODEST_DBUS_STRUCT
+#undef MODEST_DBUS_FIELD
+#undef MODEST_DBUS_FIELD_LIST
+#undef MODEST_DBUS_STRUCT_END
+
+/* The free functions */
+#define MODEST_DBUS_STRUCT(name, CType, signature)					\
+	static void								\
+	modest_dbus_free_##name (CType *item)					\
+	{
+#define MODEST_DBUS_FIELD(field, kind)							\
+		MODEST_DBUS_FREE_##kind (item->field);
+#define MODEST_DBUS_FIELD_LIST(field, item_name)					\
+		modest_dbus_free_##item_name##_list (item->field);
+#define MODEST_DBUS_STRUCT_END(name, CType)					\
+		g_slice_free (CType, item);					\
+	}									\
+										\
+	static G_GNUC_UNUSED void						\
+	modest_dbus_free_##name##_list (GList *list)				\
+	{									\
+		g_list_free_full (list, (GDestroyNotify) modest_dbus_free_##name); \
+	}
+#include "libmodest-dbus-types.def"
+#undef MODEST_DBUS_STRUCT
+#undef MODEST_DBUS_FIELD
+#undef MODEST_DBUS_FIELD_LIST
+#undef MODEST_DBUS_STRUCT_END
+
+/* The pointer array decoders */
+#define MODEST_DBUS_STRUCT(name, CType, signature)
+#define MODEST_DBUS_FIELD(field, kind)
+#define MODEST_DBUS_FIELD_LIST(field, item_name)
+#define MODEST_DBUS_STRUCT_END(name, CType)					\
+	static G_GNUC_UNUSED GPtrArray *					\
+	modest_dbus_read_##name##_ptr_array (DBusMessageIter *array)		\
+	{									\
+		DBusMessageIter items;						\
+		GPtrArray *ptr_array;						\
+										\
+		ptr_array = g_ptr_array_new_with_free_func ((GDestroyNotify) modest_dbus_free_##name); \
+										\
+		dbus_message_iter_recurse (array, &items);			\
+		while (dbus_message_iter_get_arg_type (&items) == DBUS_TYPE_STRUCT) { \
+			CType *item = g_slice_new (CType);			\
+										\
+			modest_dbus_read_##name (&items, item);			\
+			g_ptr_array_add (ptr_array, item);			\
+			dbus_message_iter_next (&items);			\
+		}								\
+										\
+		return ptr_array;						\
+	}
+#include "libmodest-dbus-types.def"
+#undef MODEST_DBUS_STRUCT
+#undef MODEST_DBUS_FIELD
+#undef MODEST_DBUS_FIELD_LIST
+#undef MODEST_DBUS_STRUCT_END
+
+/* The arena decoders */
+#define MODEST_DBUS_STRUCT(name, CType, signature)					\
+	static void								\
+	modest_dbus_read_##name##_in (DBusMessageIter *parent, CType *item,	\
+				     ModestDbusArena *arena)			\
+	{									\
+		DBusMessageIter fields;						\
+										\
+		dbus_message_iter_recurse (parent, &fields);
+#define MODEST_DBUS_FIELD(field, kind)							\
+		MODEST_DBUS_READ_IN_##kind (&fields, item->field, arena);	\
+		dbus_message_iter_next (&fields);
+#define MODEST_DBUS_FIELD_LIST(field, item_name)					\
+		item->field = modest_dbus_read_##item_name##_list_in (&fields, arena, NULL); \
+		dbus_message_iter_next (&fields);
+#define MODEST_DBUS_STRUCT_END(name, CType)					\
+	}									\
+										\
+	static G_GNUC_UNUSED CType *						\
+	modest_dbus_read_##name##_array_in (DBusMessageIter *array,		\
+					    ModestDbusArena *arena,		\
+					    guint *n_items)			\
+	{									\
+		DBusMessageIter items;						\
+		CType *item_array;						\
+		guint i;							\
+										\
+		*n_items = modest_dbus_count_structs (array);			\
+		item_array = modest_dbus_arena_alloc (arena, *n_items * sizeof (CType)); \
+										\
+		dbus_message_iter_recurse (array, &items);			\
+		for (i = 0; i < *n_items; i++) {				\
+			modest_dbus_read_##name##_in (&items, &item_array[i], arena); \
+			dbus_message_iter_next (&items);			\
+		}								\
+										\
+		return item_array;						\
+	}									\
+										\
+	static G_GNUC_UNUSED GList *						\
+	modest_dbus_read_##name##_list_in (DBusMessageIter *array,		\
+					   ModestDbusArena *arena,		\
+					   guint *n_items)			\
+	{									\
+		CType *item_array;						\
+		GList *nodes;							\
+		guint n, i;							\
+										\
+		item_array = modest_dbus_read_##name##_array_in (array, arena, &n); \
+		nodes = modest_dbus_arena_alloc (arena, n * sizeof (GList));	\
+										\
+		for (i = 0; i < n; i++) {					\
+			nodes[i].data = &item_array[i];				\
+			nodes[i].prev = i > 0 ? &nodes[i - 1] : NULL;		\
+			nodes[i].next = i + 1 < n ? &nodes[i + 1] : NULL;	\
+		}								\
+										\
+		if (n_items) {							\
+			*n_items = n;						\
+		}								\
+		return nodes;							\
+	}
+#include "libmodest-dbus-types.def"
+#undef MODEST_DBUS_STRUCT
+#undef MODEST_DBUS_FIELD
+#undef MODEST_DBUS_FIELD_LIST
+#undef MODEST_DBUS_STRUCT_END
+
+#endif /* __LIBMODEST_DBUS_MARSHAL_H__ */
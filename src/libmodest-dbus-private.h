@@ -0,0 +1,83 @@
+/* Copyright (c) 2007, Nokia Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the name of the Nokia Corporation nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __LIBMODEST_DBUS_PRIVATE_H__
+#define __LIBMODEST_DBUS_PRIVATE_H__
+
+#include "libmodest-dbus-client.h"
+
+#include <glib.h>
+#include <dbus/dbus.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Functions shared with the tests and benchmarks, which link the
+ * uninstalled libmodest-dbus-client-private.la. They are not exported
+ * by the installed library.
+ */
+
+/* The decoders of the replies; the lists are freed with
+ * modest_search_hit_list_free(), modest_account_hits_list_free() and
+ * modest_folder_result_list_free(). @n_items, if not %NULL, is set to
+ * the length of the list. */
+G_GNUC_INTERNAL GList *modest_dbus_message_get_search_hits (DBusMessage *reply, guint *n_items);
+
+G_GNUC_INTERNAL GList *modest_dbus_message_get_account_hits_list (DBusMessage *reply, guint *n_items);
+
+G_GNUC_INTERNAL GList *modest_dbus_message_get_folders (DBusMessage *reply, guint *n_items);
+
+/* The same, in the order of modest, into arrays freeing their items */
+G_GNUC_INTERNAL GPtrArray *modest_dbus_message_get_search_hit_array (DBusMessage *reply);
+
+G_GNUC_INTERNAL GPtrArray *modest_dbus_message_get_account_hits_array (DBusMessage *reply);
+
+G_GNUC_INTERNAL GPtrArray *modest_dbus_message_get_folder_array (DBusMessage *reply);
+
+/* The same, into sets freed with modest_search_hit_set_free() and
+ * modest_account_hits_set_free() */
+G_GNUC_INTERNAL ModestSearchHitSet *modest_dbus_message_get_search_hit_set (DBusMessage *reply,
+									    ModestDbusInternMode intern_mode);
+
+G_GNUC_INTERNAL ModestAccountHitsSet *modest_dbus_message_get_account_hits_set (DBusMessage *reply,
+										ModestDbusInternMode intern_mode);
+
+/* The hits of a SearchFields reply with @fields, into a set where the
+ * other fields are NULL or 0 */
+G_GNUC_INTERNAL ModestSearchHitSet *modest_dbus_message_get_search_hit_columns (DBusMessage *reply,
+										ModestDBusSearchFields fields,
+										ModestDbusInternMode intern_mode);
+
+/* The search hits as a view on @reply, which it references; freed with
+ * modest_search_hit_view_free() */
+G_GNUC_INTERNAL ModestSearchHitView *modest_dbus_message_get_search_hit_view (DBusMessage *reply);
+
+G_END_DECLS
+
+#endif /* __LIBMODEST_DBUS_PRIVATE_H__ */
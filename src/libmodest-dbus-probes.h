@@ -0,0 +1,75 @@
+/* Copyright (c) 2007, Nokia Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the name of the Nokia Corporation nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __LIBMODEST_DBUS_PROBES_H__
+#define __LIBMODEST_DBUS_PROBES_H__
+
+/*
+ * Statically defined tracepoints, for perf, bpftrace or systemtap, in
+ * the libmodest_dbus_client provider. Each probe is a single nop until
+ * a tracer attaches to it. They are only built in if sys/sdt.h was
+ * found, unless MODEST_DBUS_DISABLE_PROBES is defined.
+ *
+ * call_build (method)                    a method call was created
+ * call_send (method, serial)             it was queued for sending
+ * call_reply (method, serial, type)      its reply was received; type is
+ *                                        the DBUS_MESSAGE_TYPE_* of the reply
+ * decode_start (method, serial)          unmarshalling of the reply begins
+ * decode_end (method, serial, n_items)   and ends, with n_items results
+ *
+ * e.g.: bpftrace -e 'usdt:/usr/lib/libmodest-dbus-client-1.0.so.0:
+ *                    libmodest_dbus_client:call_send { ... }'
+ */
+
+#if defined (HAVE_SYS_SDT_H) && !defined (MODEST_DBUS_DISABLE_PROBES)
+
+#include <sys/sdt.h>
+
+#define MODEST_DBUS_PROBE_CALL_BUILD(method) \
+	DTRACE_PROBE1 (libmodest_dbus_client, call_build, method)
+#define MODEST_DBUS_PROBE_CALL_SEND(method, serial) \
+	DTRACE_PROBE2 (libmodest_dbus_client, call_send, method, serial)
+#define MODEST_DBUS_PROBE_CALL_REPLY(method, serial, type) \
+	DTRACE_PROBE3 (libmodest_dbus_client, call_reply, method, serial, type)
+#define MODEST_DBUS_PROBE_DECODE_START(method, serial) \
+	DTRACE_PROBE2 (libmodest_dbus_client, decode_start, method, serial)
+#define MODEST_DBUS_PROBE_DECODE_END(method, serial, n_items) \
+	DTRACE_PROBE3 (libmodest_dbus_client, decode_end, method, serial, n_items)
+
+#else
+
+#define MODEST_DBUS_PROBE_CALL_BUILD(method) G_STMT_START { } G_STMT_END
+#define MODEST_DBUS_PROBE_CALL_SEND(method, serial) G_STMT_START { } G_STMT_END
+#define MODEST_DBUS_PROBE_CALL_REPLY(method, serial, type) G_STMT_START { } G_STMT_END
+#define MODEST_DBUS_PROBE_DECODE_START(method, serial) G_STMT_START { } G_STMT_END
+#define MODEST_DBUS_PROBE_DECODE_END(method, serial, n_items) G_STMT_START { } G_STMT_END
+
+#endif
+
+#endif /* __LIBMODEST_DBUS_PROBES_H__ */
@@ -0,0 +1,800 @@
+/* Copyright (c) 2007, Nokia Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the name of the Nokia Corporation nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* A stand-in for modest, implementing its D-Bus API with generated
+ * data, for the tests and benchmarks of the client library. */
+
+#include "libmodest-dbus-api.h"
+#include "modest-mock.h"
+
+#include <dbus/dbus.h>
+#include <dbus/dbus-glib-lowlevel.h>
+#include <string.h>
+#include <stdlib.h>
+
+#define MOCK_DEFAULT_CHUNK_SIZE 100
+
+static guint mock_hits = 10;
+static guint mock_accounts = 2;
+static guint mock_folders = 10;
+static guint mock_latency = 0;
+static gboolean mock_legacy = FALSE;
+
+/* The methods that a legacy modest does not know */
+static const gchar *mock_legacy_unknown[] = {
+	MODEST_DBUS_METHOD_SEARCH_STREAM,
+	MODEST_DBUS_METHOD_SEARCH_PAGED,
+	MODEST_DBUS_METHOD_SEARCH_NEXT_PAGE,
+	MODEST_DBUS_METHOD_CLOSE_SEARCH_CURSOR,
+	MODEST_DBUS_METHOD_SEARCH_TOP,
+	MODEST_DBUS_METHOD_SEARCH_FIELDS,
+	MODEST_DBUS_METHOD_DELETE_MESSAGES,
+	MODEST_DBUS_METHOD_CANCEL_REQUEST,
+	MODEST_DBUS_METHOD_CANCEL_SEARCH_STREAM,
+	NULL
+};
+
+static gboolean
+mock_is_legacy_unknown (const char *member)
+{
+	guint i;
+
+	for (i = 0; mock_legacy_unknown[i]; i++) {
+		if (strcmp (member, mock_legacy_unknown[i]) == 0) {
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+/* Method or signal name -> number of calls or emissions */
+static GHashTable *call_counts = NULL;
+
+/* A reply waiting for the configured latency, as modest works on the
+ * call until then */
+typedef struct {
+	DBusConnection *connection;
+	DBusMessage    *reply;
+	guint           source_id;
+} MockDelayedReply;
+
+static GList *delayed_replies = NULL;
+
+/* A SearchStream sending its hits */
+typedef struct {
+	DBusConnection *connection;
+	gchar          *caller;
+	dbus_uint32_t   search_id;
+	guint           next_hit;
+	guint           n_hits;
+	guint           chunk_size;
+} MockStream;
+
+static GList *streams = NULL;
+
+/* Where the SearchPaged searches are: cursor -> next hit */
+static GHashTable *cursors = NULL;
+static guint last_cursor = 0;
+
+static void
+mock_count (const char *name)
+{
+	guint count;
+
+	count = GPOINTER_TO_UINT (g_hash_table_lookup (call_counts, name));
+	g_hash_table_insert (call_counts, g_strdup (name), GUINT_TO_POINTER (count + 1));
+}
+
+static void
+mock_delayed_reply_free (MockDelayedReply *delayed)
+{
+	delayed_replies = g_list_remove (delayed_replies, delayed);
+	dbus_message_unref (delayed->reply);
+	dbus_connection_unref (delayed->connection);
+	g_slice_free (MockDelayedReply, delayed);
+}
+
+static gboolean
+on_delayed_reply (gpointer user_data)
+{
+	MockDelayedReply *delayed = user_data;
+
+	dbus_connection_send (delayed->connection, delayed->reply, NULL);
+	mock_delayed_reply_free (delayed);
+
+	return FALSE;
+}
+
+/* Sends @reply, consuming the reference, once the latency has passed */
+static void
+mock_send_reply (DBusConnection *connection, DBusMessage *reply)
+{
+	MockDelayedReply *delayed;
+
+	if (mock_latency == 0) {
+		dbus_connection_send (connection, reply, NULL);
+		dbus_message_unref (reply);
+		return;
+	}
+
+	delayed = g_slice_new (MockDelayedReply);
+	delayed->connection = dbus_connection_ref (connection);
+	delayed->reply = reply;
+	delayed->source_id = g_timeout_add (mock_latency, on_delayed_reply, delayed);
+	delayed_replies = g_list_prepend (delayed_replies, delayed);
+}
+
+static DBusMessage *
+mock_search (DBusMessage *msg)
+{
+	DBusMessage *reply;
+
+	if (!dbus_message_has_signature (msg, "ssxxiu")) {
+		return dbus_message_new_error (msg, DBUS_ERROR_INVALID_ARGS, "Search: ssxxiu");
+	}
+
+	reply = dbus_message_new_method_return (msg);
+	modest_mock_append_search_hits (reply, 0, mock_hits);
+
+	return reply;
+}
+
+/* Replies with the page of at most @page_size hits from @first, and a
+ * cursor to the next one if there are more hits */
+static DBusMessage *
+mock_search_page (DBusMessage *msg, guint first, guint page_size)
+{
+	DBusMessage *reply;
+	guint last = MIN (first + MAX (page_size, 1), mock_hits);
+	gchar *cursor;
+
+	if (last < mock_hits) {
+		cursor = g_strdup_printf ("cursor%u", ++last_cursor);
+		g_hash_table_insert (cursors, g_strdup (cursor), GUINT_TO_POINTER (last));
+	} else {
+		cursor = g_strdup ("");
+	}
+
+	reply = dbus_message_new_method_return (msg);
+	modest_mock_append_search_hits (reply, first, last);
+	dbus_message_append_args (reply, DBUS_TYPE_STRING, &cursor, DBUS_TYPE_INVALID);
+	g_free (cursor);
+
+	return reply;
+}
+
+static DBusMessage *
+mock_search_paged (DBusMessage *msg)
+{
+	dbus_uint32_t page_size;
+	DBusMessageIter iter;
+	guint i;
+
+	if (!dbus_message_has_signature (msg, "ssxxiuu")) {
+		return dbus_message_new_error (msg, DBUS_ERROR_INVALID_ARGS, "SearchPaged: ssxxiuu");
+	}
+
+	dbus_message_iter_init (msg, &iter);
+	for (i = 0; i < MODEST_DBUS_SEARCH_PAGED_ARG_PAGE_SIZE; i++) {
+		dbus_message_iter_next (&iter);
+	}
+	dbus_message_iter_get_basic (&iter, &page_size);
+
+	return mock_search_page (msg, 0, page_size);
+}
+
+static DBusMessage *
+mock_search_next_page (DBusMessage *msg)
+{
+	const char *cursor;
+	dbus_uint32_t page_size;
+	gpointer next_hit;
+
+	if (!dbus_message_get_args (msg, NULL,
+				    DBUS_TYPE_STRING, &cursor,
+				    DBUS_TYPE_UINT32, &page_size,
+				    DBUS_TYPE_INVALID)) {
+		return dbus_message_new_error (msg, DBUS_ERROR_INVALID_ARGS, "SearchNextPage: su");
+	}
+
+	if (!g_hash_table_lookup_extended (cursors, cursor, NULL, &next_hit)) {
+		return dbus_message_new_error (msg, DBUS_ERROR_INVALID_ARGS, "Unknown cursor");
+	}
+
+	g_hash_table_remove (cursors, cursor);
+
+	return mock_search_page (msg, GPOINTER_TO_UINT (next_hit), page_size);
+}
+
+/* The hits of the mock are in the order of both sort keys, so the first
+ * ones are at either end of them */
+static DBusMessage *
+mock_search_top (DBusMessage *msg)
+{
+	DBusMessage *reply;
+	DBusMessageIter iter;
+	dbus_bool_t descending;
+	dbus_uint32_t max_hits;
+	guint n_hits;
+	guint i;
+
+	if (!dbus_message_has_signature (msg, "ssxxiuubu")) {
+		return dbus_message_new_error (msg, DBUS_ERROR_INVALID_ARGS, "SearchTop: ssxxiuubu");
+	}
+
+	dbus_message_iter_init (msg, &iter);
+	for (i = 0; i < MODEST_DBUS_SEARCH_TOP_ARG_DESCENDING; i++) {
+		dbus_message_iter_next (&iter);
+	}
+	dbus_message_iter_get_basic (&iter, &descending);
+	dbus_message_iter_next (&iter);
+	dbus_message_iter_get_basic (&iter, &max_hits);
+
+	n_hits = MIN (max_hits, mock_hits);
+
+	reply = dbus_message_new_method_return (msg);
+	if (descending) {
+		modest_mock_append_search_hits_reversed (reply, mock_hits - n_hits, mock_hits);
+	} else {
+		modest_mock_append_search_hits (reply, 0, n_hits);
+	}
+
+	return reply;
+}
+
+static DBusMessage *
+mock_search_fields (DBusMessage *msg)
+{
+	DBusMessage *reply;
+	DBusMessageIter iter;
+	dbus_uint32_t fields;
+	guint i;
+
+	if (!dbus_message_has_signature (msg, "ssxxiuu")) {
+		return dbus_message_new_error (msg, DBUS_ERROR_INVALID_ARGS, "SearchFields: ssxxiuu");
+	}
+
+	dbus_message_iter_init (msg, &iter);
+	for (i = 0; i < MODEST_DBUS_SEARCH_FIELDS_ARG_FIELDS; i++) {
+		dbus_message_iter_next (&iter);
+	}
+	dbus_message_iter_get_basic (&iter, &fields);
+
+	reply = dbus_message_new_method_return (msg);
+	modest_mock_append_search_hit_columns (reply, 0, mock_hits, fields);
+
+	return reply;
+}
+
+static void
+mock_close_search_cursor (DBusMessage *msg)
+{
+	const char *cursor;
+
+	if (dbus_message_get_args (msg, NULL, DBUS_TYPE_STRING, &cursor, DBUS_TYPE_INVALID)) {
+		g_hash_table_remove (cursors, cursor);
+	}
+}
+
+static DBusMessage *
+mock_get_unread_messages (DBusMessage *msg)
+{
+	DBusMessage *reply;
+	dbus_int32_t msgs_per_account;
+
+	if (!dbus_message_get_args (msg, NULL, DBUS_TYPE_INT32, &msgs_per_account,
+				    DBUS_TYPE_INVALID) || msgs_per_account < 0) {
+		return dbus_message_new_error (msg, DBUS_ERROR_INVALID_ARGS, "GetUnreadMessages: i");
+	}
+
+	reply = dbus_message_new_method_return (msg);
+	modest_mock_append_account_hits (reply, mock_accounts, msgs_per_account);
+
+	return reply;
+}
+
+static DBusMessage *
+mock_get_folders (DBusMessage *msg)
+{
+	DBusMessage *reply;
+
+	reply = dbus_message_new_method_return (msg);
+	modest_mock_append_folders (reply, mock_folders);
+
+	return reply;
+}
+
+static DBusMessage *
+mock_delete_messages (DBusMessage *msg)
+{
+	DBusMessage *reply;
+	char **uris;
+	int n_uris, i;
+	dbus_bool_t *deleted;
+
+	if (!dbus_message_get_args (msg, NULL,
+				    DBUS_TYPE_ARRAY, DBUS_TYPE_STRING, &uris, &n_uris,
+				    DBUS_TYPE_INVALID)) {
+		return dbus_message_new_error (msg, DBUS_ERROR_INVALID_ARGS, "DeleteMessages: as");
+	}
+
+	deleted = g_new (dbus_bool_t, MAX (n_uris, 1));
+	for (i = 0; i < n_uris; i++) {
+		deleted[i] = strstr (uris[i], MODEST_MOCK_MISSING_MSG) == NULL;
+	}
+
+	reply = dbus_message_new_method_return (msg);
+	dbus_message_append_args (reply, DBUS_TYPE_ARRAY, DBUS_TYPE_BOOLEAN, &deleted, n_uris,
+				  DBUS_TYPE_INVALID);
+
+	g_free (deleted);
+	dbus_free_string_array (uris);
+
+	return reply;
+}
+
+static void
+mock_stream_free (MockStream *stream)
+{
+	streams = g_list_remove (streams, stream);
+	dbus_connection_unref (stream->connection);
+	g_free (stream->caller);
+	g_slice_free (MockStream, stream);
+}
+
+/* Sends the next chunk of @stream, as modest would while searching */
+static gboolean
+on_stream_chunk (gpointer user_data)
+{
+	MockStream *stream = user_data;
+	DBusMessage *signal;
+	dbus_bool_t finished;
+	guint last;
+
+	if (g_list_find (streams, stream) == NULL) {
+		/* Cancelled */
+		return FALSE;
+	}
+
+	last = MIN (stream->next_hit + stream->chunk_size, stream->n_hits);
+	finished = last == stream->n_hits;
+
+	signal = dbus_message_new_signal (MODEST_DBUS_OBJECT, MODEST_DBUS_IFACE,
+					  MODEST_DBUS_SIGNAL_SEARCH_HITS);
+	dbus_message_set_destination (signal, stream->caller);
+	dbus_message_append_args (signal, DBUS_TYPE_UINT32, &stream->search_id,
+				  DBUS_TYPE_INVALID);
+	modest_mock_append_search_hits (signal, stream->next_hit, last);
+	dbus_message_append_args (signal, DBUS_TYPE_BOOLEAN, &finished, DBUS_TYPE_INVALID);
+
+	dbus_connection_send (stream->connection, signal, NULL);
+	dbus_message_unref (signal);
+	mock_count (MODEST_DBUS_SIGNAL_SEARCH_HITS);
+
+	stream->next_hit = last;
+
+	if (finished) {
+		mock_stream_free (stream);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static DBusMessage *
+mock_search_stream (DBusConnection *connection, DBusMessage *msg)
+{
+	MockStream *stream;
+	const char *query, *folder;
+	dbus_int64_t start_date, end_date;
+	dbus_int32_t flags;
+	dbus_uint32_t min_size, search_id, chunk_size;
+
+	if (!dbus_message_get_args (msg, NULL,
+				    DBUS_TYPE_STRING, &query,
+				    DBUS_TYPE_STRING, &folder,
+				    DBUS_TYPE_INT64, &start_date,
+				    DBUS_TYPE_INT64, &end_date,
+				    DBUS_TYPE_INT32, &flags,
+				    DBUS_TYPE_UINT32, &min_size,
+				    DBUS_TYPE_UINT32, &search_id,
+				    DBUS_TYPE_UINT32, &chunk_size,
+				    DBUS_TYPE_INVALID)) {
+		return dbus_message_new_error (msg, DBUS_ERROR_INVALID_ARGS, "SearchStream: ssxxiuuu");
+	}
+
+	stream = g_slice_new0 (MockStream);
+	stream->connection = dbus_connection_ref (connection);
+	stream->caller = g_strdup (dbus_message_get_sender (msg));
+	stream->search_id = search_id;
+	stream->n_hits = mock_hits;
+	stream->chunk_size = chunk_size ? chunk_size : MOCK_DEFAULT_CHUNK_SIZE;
+	streams = g_list_prepend (streams, stream);
+
+	g_timeout_add (mock_latency, on_stream_chunk, stream);
+
+	return dbus_message_new_method_return (msg);
+}
+
+/* Stops working on a call not answered yet: drops its reply */
+static void
+mock_cancel_request (DBusMessage *msg)
+{
+	dbus_uint32_t serial;
+	GList *iter;
+
+	if (!dbus_message_get_args (msg, NULL, DBUS_TYPE_UINT32, &serial, DBUS_TYPE_INVALID)) {
+		return;
+	}
+
+	for (iter = delayed_replies; iter; iter = iter->next) {
+		MockDelayedReply *delayed = iter->data;
+
+		if (dbus_message_get_reply_serial (delayed->reply) == serial &&
+		    g_strcmp0 (dbus_message_get_destination (delayed->reply),
+			       dbus_message_get_sender (msg)) == 0) {
+			g_source_remove (delayed->source_id);
+			mock_delayed_reply_free (delayed);
+			return;
+		}
+	}
+}
+
+static void
+mock_cancel_search_stream (DBusMessage *msg)
+{
+	dbus_uint32_t search_id;
+	GList *iter;
+
+	if (!dbus_message_get_args (msg, NULL, DBUS_TYPE_UINT32, &search_id,
+				    DBUS_TYPE_INVALID)) {
+		return;
+	}
+
+	for (iter = streams; iter; iter = iter->next) {
+		MockStream *stream = iter->data;
+
+		if (stream->search_id == search_id &&
+		    g_strcmp0 (stream->caller, dbus_message_get_sender (msg)) == 0) {
+			mock_stream_free (stream);
+			return;
+		}
+	}
+}
+
+/* Answers the methods of modest */
+static DBusMessage *
+mock_handle_modest (DBusConnection *connection, DBusMessage *msg)
+{
+	const char *member = dbus_message_get_member (msg);
+	dbus_bool_t res = TRUE;
+
+	mock_count (member);
+
+	/* Counted all the same, to tell that the client tried them */
+	if (mock_legacy && mock_is_legacy_unknown (member)) {
+		return dbus_message_new_error (msg, DBUS_ERROR_UNKNOWN_METHOD, member);
+	}
+
+	if (strcmp (member, MODEST_DBUS_METHOD_SEARCH) == 0) {
+		return mock_search (msg);
+	} else if (strcmp (member, MODEST_DBUS_METHOD_SEARCH_STREAM) == 0) {
+		return mock_search_stream (connection, msg);
+	} else if (strcmp (member, MODEST_DBUS_METHOD_SEARCH_PAGED) == 0) {
+		return mock_search_paged (msg);
+	} else if (strcmp (member, MODEST_DBUS_METHOD_SEARCH_NEXT_PAGE) == 0) {
+		return mock_search_next_page (msg);
+	} else if (strcmp (member, MODEST_DBUS_METHOD_SEARCH_TOP) == 0) {
+		return mock_search_top (msg);
+	} else if (strcmp (member, MODEST_DBUS_METHOD_SEARCH_FIELDS) == 0) {
+		return mock_search_fields (msg);
+	} else if (strcmp (member, MODEST_DBUS_METHOD_CLOSE_SEARCH_CURSOR) == 0) {
+		mock_close_search_cursor (msg);
+		return NULL;
+	} else if (strcmp (member, MODEST_DBUS_METHOD_GET_UNREAD_MESSAGES) == 0) {
+		return mock_get_unread_messages (msg);
+	} else if (strcmp (member, MODEST_DBUS_METHOD_GET_FOLDERS) == 0) {
+		return mock_get_folders (msg);
+	} else if (strcmp (member, MODEST_DBUS_METHOD_DELETE_MESSAGES) == 0) {
+		return mock_delete_messages (msg);
+	} else if (strcmp (member, MODEST_DBUS_METHOD_CANCEL_REQUEST) == 0) {
+		mock_cancel_request (msg);
+		return NULL;
+	} else if (strcmp (member, MODEST_DBUS_METHOD_CANCEL_SEARCH_STREAM) == 0) {
+		mock_cancel_search_stream (msg);
+		return NULL;
+	} else if (strcmp (member, MODEST_DBUS_METHOD_DELETE_MESSAGE) == 0) {
+		DBusMessage *reply = dbus_message_new_method_return (msg);
+
+		dbus_message_append_args (reply, DBUS_TYPE_BOOLEAN, &res, DBUS_TYPE_INVALID);
+		return reply;
+	} else if (strcmp (member, MODEST_DBUS_METHOD_MAIL_TO) == 0 ||
+		   strcmp (member, MODEST_DBUS_METHOD_OPEN_MESSAGE) == 0 ||
+		   strcmp (member, MODEST_DBUS_METHOD_OPEN_ACCOUNT) == 0 ||
+		   strcmp (member, MODEST_DBUS_METHOD_SEND_RECEIVE) == 0 ||
+		   strcmp (member, MODEST_DBUS_METHOD_SEND_RECEIVE_FULL) == 0 ||
+		   strcmp (member, MODEST_DBUS_METHOD_COMPOSE_MAIL) == 0 ||
+		   strcmp (member, MODEST_DBUS_METHOD_OPEN_DEFAULT_INBOX) == 0 ||
+		   strcmp (member, MODEST_DBUS_METHOD_OPEN_EDIT_ACCOUNTS_DIALOG) == 0 ||
+		   strcmp (member, MODEST_DBUS_METHOD_DUMP_OPERATION_QUEUE) == 0 ||
+		   strcmp (member, MODEST_DBUS_METHOD_DUMP_ACCOUNTS) == 0 ||
+		   strcmp (member, MODEST_DBUS_METHOD_DUMP_SEND_QUEUES) == 0 ||
+		   strcmp (member, MODEST_DBUS_METHOD_TOP_APPLICATION) == 0 ||
+		   strcmp (member, MODEST_DBUS_METHOD_UPDATE_FOLDER_COUNTS) == 0) {
+		return dbus_message_new_method_return (msg);
+	}
+
+	return dbus_message_new_error (msg, DBUS_ERROR_UNKNOWN_METHOD, member);
+}
+
+static DBusHandlerResult mock_filter (DBusConnection *connection, DBusMessage *msg,
+				      void *user_data);
+
+/* Connects to the bus and owns the name of modest, as modest does when
+ * it starts. Returns the connection, or %NULL on error. */
+static DBusConnection *
+mock_connect (void)
+{
+	DBusConnection *connection;
+	DBusError error;
+
+	dbus_error_init (&error);
+	connection = dbus_bus_get_private (DBUS_BUS_SESSION, &error);
+
+	if (connection == NULL) {
+		g_printerr ("Could not connect to the session bus: %s\n", error.message);
+		dbus_error_free (&error);
+		return NULL;
+	}
+
+	/* Replies to a million hits are large */
+	dbus_connection_set_max_message_size (connection, DBUS_MAXIMUM_MESSAGE_LENGTH);
+	dbus_connection_setup_with_g_main (connection, NULL);
+	dbus_connection_add_filter (connection, mock_filter, NULL, NULL);
+
+	if (dbus_bus_request_name (connection, MODEST_DBUS_SERVICE,
+				   DBUS_NAME_FLAG_DO_NOT_QUEUE, &error) !=
+	    DBUS_REQUEST_NAME_REPLY_PRIMARY_OWNER) {
+		g_printerr ("Could not own %s: %s\n", MODEST_DBUS_SERVICE,
+			    dbus_error_is_set (&error) ? error.message : "already owned");
+		dbus_error_free (&error);
+		dbus_connection_close (connection);
+		dbus_connection_unref (connection);
+		return NULL;
+	}
+
+	return connection;
+}
+
+static gboolean
+on_absence_end (gpointer user_data)
+{
+	DBusConnection *old_connection = user_data;
+
+	if (mock_connect () == NULL) {
+		exit (1);
+	}
+
+	dbus_connection_unref (old_connection);
+
+	return FALSE;
+}
+
+/* Acts as if modest exited, and was started again @absence ms later,
+ * with a new unique name. Answers @msg before going away. */
+static void
+mock_exit (DBusConnection *connection, DBusMessage *msg, guint absence)
+{
+	DBusMessage *reply;
+
+	/* A new modest knows nothing of the searches of the old one */
+	while (streams) {
+		mock_stream_free (streams->data);
+	}
+	g_hash_table_remove_all (cursors);
+
+	reply = dbus_message_new_method_return (msg);
+	dbus_connection_send (connection, reply, NULL);
+	dbus_message_unref (reply);
+	dbus_connection_flush (connection);
+
+	/* Closing gives up the name and the unique name at once */
+	dbus_connection_set_exit_on_disconnect (connection, FALSE);
+	dbus_connection_close (connection);
+
+	g_timeout_add (absence, on_absence_end, connection);
+}
+
+/* Answers the methods driving the mock */
+static DBusMessage *
+mock_handle_mock (DBusConnection *connection, DBusMessage *msg)
+{
+	DBusMessage *reply;
+
+	if (dbus_message_is_method_call (msg, MODEST_MOCK_IFACE, MODEST_MOCK_METHOD_CONFIGURE)) {
+		dbus_uint32_t hits, accounts, folders, latency;
+		dbus_bool_t legacy;
+
+		if (!dbus_message_get_args (msg, NULL,
+					    DBUS_TYPE_UINT32, &hits,
+					    DBUS_TYPE_UINT32, &accounts,
+					    DBUS_TYPE_UINT32, &folders,
+					    DBUS_TYPE_UINT32, &latency,
+					    DBUS_TYPE_BOOLEAN, &legacy,
+					    DBUS_TYPE_INVALID)) {
+			return dbus_message_new_error (msg, DBUS_ERROR_INVALID_ARGS, "Configure: uuuub");
+		}
+
+		mock_hits = hits;
+		mock_accounts = accounts;
+		mock_folders = folders;
+		mock_latency = latency;
+		mock_legacy = legacy;
+
+		return dbus_message_new_method_return (msg);
+	}
+
+	if (dbus_message_is_method_call (msg, MODEST_MOCK_IFACE,
+					 MODEST_MOCK_METHOD_GET_CALL_COUNT)) {
+		const char *method;
+		dbus_uint32_t count;
+
+		if (!dbus_message_get_args (msg, NULL, DBUS_TYPE_STRING, &method,
+					    DBUS_TYPE_INVALID)) {
+			return dbus_message_new_error (msg, DBUS_ERROR_INVALID_ARGS, "GetCallCount: s");
+		}
+
+		count = GPOINTER_TO_UINT (g_hash_table_lookup (call_counts, method));
+		reply = dbus_message_new_method_return (msg);
+		dbus_message_append_args (reply, DBUS_TYPE_UINT32, &count, DBUS_TYPE_INVALID);
+
+		return reply;
+	}
+
+	if (dbus_message_is_method_call (msg, MODEST_MOCK_IFACE,
+					 MODEST_MOCK_METHOD_EMIT_FOLDER_UPDATED)) {
+		const char *account_id, *folder_id;
+		DBusMessage *signal;
+
+		if (!dbus_message_get_args (msg, NULL,
+					    DBUS_TYPE_STRING, &account_id,
+					    DBUS_TYPE_STRING, &folder_id,
+					    DBUS_TYPE_INVALID)) {
+			return dbus_message_new_error (msg, DBUS_ERROR_INVALID_ARGS,
+						       "EmitFolderUpdated: ss");
+		}
+
+		signal = dbus_message_new_signal (MODEST_DBUS_OBJECT, MODEST_DBUS_IFACE,
+						  MODEST_DBUS_SIGNAL_FOLDER_UPDATED);
+		dbus_message_append_args (signal,
+					  DBUS_TYPE_STRING, &account_id,
+					  DBUS_TYPE_STRING, &folder_id,
+					  DBUS_TYPE_INVALID);
+		dbus_connection_send (connection, signal, NULL);
+		dbus_message_unref (signal);
+
+		return dbus_message_new_method_return (msg);
+	}
+
+	if (dbus_message_is_method_call (msg, MODEST_MOCK_IFACE,
+					 MODEST_MOCK_METHOD_RELEASE_NAME)) {
+		dbus_uint32_t absence;
+
+		if (!dbus_message_get_args (msg, NULL, DBUS_TYPE_UINT32, &absence,
+					    DBUS_TYPE_INVALID)) {
+			return dbus_message_new_error (msg, DBUS_ERROR_INVALID_ARGS, "ReleaseName: u");
+		}
+
+		mock_exit (connection, msg, absence);
+
+		return NULL;
+	}
+
+	return dbus_message_new_error (msg, DBUS_ERROR_UNKNOWN_METHOD,
+				       dbus_message_get_member (msg));
+}
+
+static DBusHandlerResult
+mock_filter (DBusConnection *connection, DBusMessage *msg, void *user_data)
+{
+	DBusMessage *reply;
+
+	if (dbus_message_get_type (msg) != DBUS_MESSAGE_TYPE_METHOD_CALL ||
+	    g_strcmp0 (dbus_message_get_path (msg), MODEST_DBUS_OBJECT) != 0) {
+		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+	}
+
+	if (g_strcmp0 (dbus_message_get_interface (msg), MODEST_DBUS_IFACE) == 0) {
+		reply = mock_handle_modest (connection, msg);
+	} else if (g_strcmp0 (dbus_message_get_interface (msg), MODEST_MOCK_IFACE) == 0) {
+		reply = mock_handle_mock (connection, msg);
+	} else {
+		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+	}
+
+	if (reply == NULL) {
+		return DBUS_HANDLER_RESULT_HANDLED;
+	}
+
+	if (dbus_message_get_no_reply (msg)) {
+		dbus_message_unref (reply);
+	} else if (dbus_message_get_type (reply) == DBUS_MESSAGE_TYPE_ERROR) {
+		dbus_connection_send (connection, reply, NULL);
+		dbus_message_unref (reply);
+	} else {
+		mock_send_reply (connection, reply);
+	}
+
+	return DBUS_HANDLER_RESULT_HANDLED;
+}
+
+int
+main (int argc, char *argv[])
+{
+	GOptionEntry entries[] = {
+		{ "hits", 0, 0, G_OPTION_ARG_INT, &mock_hits,
+		  "Number of search hits", "N" },
+		{ "accounts", 0, 0, G_OPTION_ARG_INT, &mock_accounts,
+		  "Number of accounts with unread messages", "N" },
+		{ "folders", 0, 0, G_OPTION_ARG_INT, &mock_folders,
+		  "Number of folders", "N" },
+		{ "latency", 0, 0, G_OPTION_ARG_INT, &mock_latency,
+		  "Milliseconds to wait before replying", "MS" },
+		{ "legacy", 0, 0, G_OPTION_ARG_NONE, &mock_legacy,
+		  "Fail the methods a legacy modest does not know", NULL },
+		{ NULL }
+	};
+	GOptionContext *context;
+	GMainLoop *loop;
+	GError *gerror = NULL;
+
+	context = g_option_context_new ("- a mock modest D-Bus service");
+	g_option_context_add_main_entries (context, entries, NULL);
+
+	if (!g_option_context_parse (context, &argc, &argv, &gerror)) {
+		g_printerr ("%s\n", gerror->message);
+		return 1;
+	}
+
+	g_option_context_free (context);
+
+	call_counts = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	cursors = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+	if (mock_connect () == NULL) {
+		return 1;
+	}
+
+	/* Exits when the bus goes away */
+	loop = g_main_loop_new (NULL, FALSE);
+	g_main_loop_run (loop);
+
+	return 0;
+}
@@ -0,0 +1,349 @@
+/* Copyright (c) 2007, Nokia Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the name of the Nokia Corporation nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* End to end benchmarks of the client library against the mock modest
+ * service: calls per second, latency percentiles and memory use, for
+ * replies from 10 to a million items. Run with "make bench". */
+
+#include "libmodest-dbus-client.h"
+#include "libmodest-dbus-api.h"
+#include "modest-mock.h"
+
+#include <dbus/dbus.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Fewer calls for larger replies, to keep every run short */
+#define BENCH_ITEMS_PER_SIZE 200000
+#define BENCH_MIN_CALLS      3
+#define BENCH_MAX_CALLS      2000
+
+typedef gboolean (*BenchFunc) (guint size);
+
+static osso_context_t *osso_ctx = NULL;
+static GMainLoop *loop = NULL;
+
+static gint max_size = 1000000;
+static gint latency = 0;
+
+static gboolean
+bench_search (guint size)
+{
+	GList *hits = NULL;
+
+	if (!libmodest_dbus_client_search (osso_ctx, "query", NULL, 0, 0, 0,
+					   MODEST_DBUS_SEARCH_SUBJECT, &hits)) {
+		return FALSE;
+	}
+
+	modest_search_hit_list_free (hits);
+
+	return TRUE;
+}
+
+static void
+on_search_ready (GObject *source, GAsyncResult *result, gpointer user_data)
+{
+	GList *hits = NULL;
+
+	*(gboolean *) user_data = libmodest_dbus_client_search_finish (result, &hits, NULL);
+	modest_search_hit_list_free (hits);
+	g_main_loop_quit (loop);
+}
+
+static gboolean
+bench_search_async (guint size)
+{
+	gboolean res = FALSE;
+
+	libmodest_dbus_client_search_async (osso_ctx, "query", NULL, 0, 0, 0,
+					    MODEST_DBUS_SEARCH_SUBJECT, NULL,
+					    on_search_ready, &res);
+	g_main_loop_run (loop);
+
+	return res;
+}
+
+static void
+on_search_chunk (guint search_id, GList *hits, gboolean finished,
+		 const GError *error, gpointer user_data)
+{
+	if (finished) {
+		*(gboolean *) user_data = error == NULL;
+		g_main_loop_quit (loop);
+	}
+}
+
+static gboolean
+bench_search_stream (guint size)
+{
+	gboolean res = FALSE;
+
+	if (!libmodest_dbus_client_search_stream (osso_ctx, "query", NULL, 0, 0, 0,
+						  MODEST_DBUS_SEARCH_SUBJECT, 1000,
+						  on_search_chunk, &res, NULL)) {
+		return FALSE;
+	}
+
+	g_main_loop_run (loop);
+
+	return res;
+}
+
+static gboolean
+bench_get_unread_messages (guint size)
+{
+	GList *accounts = NULL;
+
+	/* 10 accounts, as configured in bench_run() */
+	if (!libmodest_dbus_client_get_unread_messages (osso_ctx, MAX (size / 10, 1),
+							&accounts)) {
+		return FALSE;
+	}
+
+	modest_account_hits_list_free (accounts);
+
+	return TRUE;
+}
+
+static gboolean
+bench_get_folders (guint size)
+{
+	GList *folders = NULL;
+
+	if (!libmodest_dbus_client_get_folders (osso_ctx, &folders)) {
+		return FALSE;
+	}
+
+	modest_folder_result_list_free (folders);
+
+	return TRUE;
+}
+
+static gchar **delete_uris = NULL;
+
+static gboolean
+bench_delete_messages (guint size)
+{
+	gboolean *deleted = NULL;
+
+	if (delete_uris == NULL || g_strv_length (delete_uris) != size) {
+		guint i;
+
+		g_strfreev (delete_uris);
+		delete_uris = g_new (gchar *, size + 1);
+		for (i = 0; i < size; i++) {
+			delete_uris[i] = g_strdup_printf (MODEST_MOCK_HIT_MSGID_FORMAT, i);
+		}
+		delete_uris[size] = NULL;
+	}
+
+	if (!libmodest_dbus_client_delete_messages (osso_ctx,
+						    (const gchar * const *) delete_uris,
+						    &deleted)) {
+		return FALSE;
+	}
+
+	g_free (deleted);
+
+	return TRUE;
+}
+
+static gboolean
+bench_open_message (guint size)
+{
+	return libmodest_dbus_client_open_message (osso_ctx, "local://inbox/1");
+}
+
+static gboolean
+bench_open_message_no_reply (guint size)
+{
+	return libmodest_dbus_client_open_message_no_reply (osso_ctx, "local://inbox/1");
+}
+
+static gboolean
+bench_send_and_receive_full (guint size)
+{
+	return libmodest_dbus_client_send_and_receive_full (osso_ctx, "account0", FALSE);
+}
+
+static const struct {
+	const gchar *name;
+	BenchFunc    func;
+	gboolean     sized;	/* whether the reply grows with the size */
+} benchmarks[] = {
+	{ "search",                 bench_search,                 TRUE },
+	{ "search_async",           bench_search_async,           TRUE },
+	{ "search_stream",          bench_search_stream,          TRUE },
+	{ "get_unread_messages",    bench_get_unread_messages,    TRUE },
+	{ "get_folders",            bench_get_folders,            TRUE },
+	{ "delete_messages",        bench_delete_messages,        TRUE },
+	{ "open_message",           bench_open_message,           FALSE },
+	{ "open_message_no_reply",  bench_open_message_no_reply,  FALSE },
+	{ "send_and_receive_full",  bench_send_and_receive_full,  FALSE },
+};
+
+/* Reads a field of /proc/self/status, in kilobytes */
+static guint64
+bench_get_memory (const gchar *field)
+{
+	gchar *status = NULL;
+	gchar *line;
+	guint64 kb = 0;
+
+	if (!g_file_get_contents ("/proc/self/status", &status, NULL, NULL)) {
+		return 0;
+	}
+
+	line = strstr (status, field);
+	if (line) {
+		kb = g_ascii_strtoull (line + strlen (field) + 1, NULL, 10);
+	}
+
+	g_free (status);
+
+	return kb;
+}
+
+static gint
+compare_latencies (gconstpointer a, gconstpointer b)
+{
+	gint64 la = *(const gint64 *) a;
+	gint64 lb = *(const gint64 *) b;
+
+	return la < lb ? -1 : la > lb;
+}
+
+static void
+bench_run (guint index, guint size)
+{
+	gint64 *latencies;
+	gint64 start, total;
+	guint n_calls, i;
+
+	n_calls = CLAMP (BENCH_ITEMS_PER_SIZE / size, BENCH_MIN_CALLS, BENCH_MAX_CALLS);
+	latencies = g_new (gint64, n_calls);
+
+	if (!modest_mock_configure (size, 10, size, latency, FALSE)) {
+		exit (1);
+	}
+
+	/* Once before measuring, so that connecting is not measured */
+	if (!benchmarks[index].func (size)) {
+		g_printerr ("%s: call failed\n", benchmarks[index].name);
+		g_free (latencies);
+		return;
+	}
+
+	total = g_get_monotonic_time ();
+
+	for (i = 0; i < n_calls; i++) {
+		start = g_get_monotonic_time ();
+		benchmarks[index].func (size);
+		latencies[i] = g_get_monotonic_time () - start;
+	}
+
+	total = MAX (g_get_monotonic_time () - total, 1);
+	qsort (latencies, n_calls, sizeof (gint64), compare_latencies);
+
+	g_print ("%-22s %8u %6u %10.1f %9.2f %9.2f %9.2f %9.1f %9.1f\n",
+		 benchmarks[index].name, size, n_calls,
+		 n_calls * (gdouble) G_USEC_PER_SEC / total,
+		 latencies[n_calls / 2] / 1000.0,
+		 latencies[n_calls * 90 / 100] / 1000.0,
+		 latencies[n_calls * 99 / 100] / 1000.0,
+		 bench_get_memory ("VmRSS:") / 1024.0,
+		 bench_get_memory ("VmHWM:") / 1024.0);
+
+	g_free (latencies);
+}
+
+int
+main (int argc, char *argv[])
+{
+	GOptionEntry entries[] = {
+		{ "max-size", 0, 0, G_OPTION_ARG_INT, &max_size,
+		  "Largest number of items per reply", "N" },
+		{ "latency", 0, 0, G_OPTION_ARG_INT, &latency,
+		  "Milliseconds the mock waits before replying", "MS" },
+		{ NULL }
+	};
+	GOptionContext *context;
+	ModestDbusClient *client;
+	GError *error = NULL;
+	guint i, size;
+
+	context = g_option_context_new ("- benchmark the modest D-Bus client");
+	g_option_context_add_main_entries (context, entries, NULL);
+
+	if (!g_option_context_parse (context, &argc, &argv, &error)) {
+		g_printerr ("%s\n", error->message);
+		return 1;
+	}
+
+	g_option_context_free (context);
+
+	osso_ctx = osso_initialize ("modest_bench", "1.0", FALSE, NULL);
+	if (osso_ctx == NULL) {
+		g_printerr ("Could not initialize libosso\n");
+		return 1;
+	}
+
+	/* A million hits come close to the largest message D-Bus allows */
+	dbus_connection_set_max_message_size ((DBusConnection *) osso_get_dbus_connection (osso_ctx),
+					      DBUS_MAXIMUM_MESSAGE_LENGTH);
+
+	client = libmodest_dbus_client_new (osso_ctx);
+	loop = g_main_loop_new (NULL, FALSE);
+
+	g_print ("%-22s %8s %6s %10s %9s %9s %9s %9s %9s\n",
+		 "function", "size", "calls", "calls/s", "p50 (ms)", "p90 (ms)",
+		 "p99 (ms)", "rss (MB)", "peak (MB)");
+
+	for (i = 0; i < G_N_ELEMENTS (benchmarks); i++) {
+		if (!benchmarks[i].sized) {
+			bench_run (i, 10);
+			continue;
+		}
+
+		for (size = 10; size <= (guint) max_size; size *= 10) {
+			bench_run (i, size);
+		}
+	}
+
+	g_print ("\n");
+	libmodest_dbus_client_dump_stats (client, stdout);
+
+	g_strfreev (delete_uris);
+	g_main_loop_unref (loop);
+	libmodest_dbus_client_unref (client);
+	osso_deinitialize (osso_ctx);
+
+	return 0;
+}
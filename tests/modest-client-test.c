@@ -0,0 +1,1383 @@
+/* Copyright (c) 2007, Nokia Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the name of the Nokia Corporation nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Tests of the client library against the mock modest service; run
+ * with run-with-mock.sh */
+
+#include "libmodest-dbus-client.h"
+#include "libmodest-dbus-api.h"
+#include "modest-mock.h"
+
+#include <string.h>
+#include <unistd.h>
+
+static osso_context_t *osso_ctx = NULL;
+static ModestDbusClient *client = NULL;
+
+static void
+reset_mock (guint hits, guint accounts, guint folders, guint latency)
+{
+	g_assert (modest_mock_configure (hits, accounts, folders, latency, FALSE));
+}
+
+/* Makes the mock a modest without the methods the client falls back from */
+static void
+reset_legacy_mock (guint hits, guint accounts, guint folders)
+{
+	g_assert (modest_mock_configure (hits, accounts, folders, 0, TRUE));
+}
+
+static gboolean
+on_timeout_quit (gpointer user_data)
+{
+	g_main_loop_quit (user_data);
+
+	return FALSE;
+}
+
+/* Lets the main loop run for @ms milliseconds */
+static void
+run_main_loop_for (guint ms)
+{
+	GMainLoop *loop = g_main_loop_new (NULL, FALSE);
+
+	g_timeout_add (ms, on_timeout_quit, loop);
+	g_main_loop_run (loop);
+	g_main_loop_unref (loop);
+}
+
+/* Waits until the client sees modest come or go */
+static void
+wait_for_running (gboolean running)
+{
+	while (libmodest_dbus_client_is_running (client) != running) {
+		g_main_context_iteration (NULL, TRUE);
+	}
+}
+
+/* Checks that @hit is the hit number @i of the mock */
+static void
+check_search_hit (const ModestSearchHit *hit, guint i)
+{
+	gchar *str;
+
+	str = g_strdup_printf (MODEST_MOCK_HIT_MSGID_FORMAT, i);
+	g_assert_cmpstr (hit->msgid, ==, str);
+	g_free (str);
+
+	str = g_strdup_printf (MODEST_MOCK_HIT_SUBJECT_FORMAT, i);
+	g_assert_cmpstr (hit->subject, ==, str);
+	g_free (str);
+
+	g_assert_cmpstr (hit->folder, ==, MODEST_MOCK_HIT_FOLDER);
+	g_assert_cmpuint (hit->msize, ==, MODEST_MOCK_HIT_SIZE + i);
+	g_assert_cmpint (hit->has_attachment, ==, (i % 2) == 0);
+	g_assert_cmpint (hit->is_unread, ==, (i % 3) == 0);
+	g_assert_cmpint (hit->timestamp, ==, MODEST_MOCK_HIT_TIMESTAMP + i);
+}
+
+static void
+check_search_hits (GList *hits, guint n_hits)
+{
+	gboolean *seen = g_new0 (gboolean, n_hits);
+	GList *iter;
+
+	g_assert_cmpuint (g_list_length (hits), ==, n_hits);
+
+	for (iter = hits; iter; iter = iter->next) {
+		ModestSearchHit *hit = iter->data;
+		guint i;
+
+		g_assert (sscanf (hit->msgid, MODEST_MOCK_HIT_MSGID_FORMAT, &i) == 1);
+		g_assert_cmpuint (i, <, n_hits);
+		g_assert (!seen[i]);
+		seen[i] = TRUE;
+
+		check_search_hit (hit, i);
+	}
+
+	g_free (seen);
+}
+
+static void
+test_search (void)
+{
+	GList *hits = NULL;
+
+	reset_mock (50, 0, 0, 0);
+
+	g_assert (libmodest_dbus_client_search (osso_ctx, "query", NULL, 0, 0, 0,
+						MODEST_DBUS_SEARCH_SUBJECT, &hits));
+	check_search_hits (hits, 50);
+	modest_search_hit_list_free (hits);
+}
+
+static void
+test_search_array (void)
+{
+	GPtrArray *hits = NULL;
+	guint i;
+
+	reset_mock (300, 0, 0, 0);
+
+	g_assert (libmodest_dbus_client_search_array (osso_ctx, "query", NULL, 0, 0, 0,
+						      MODEST_DBUS_SEARCH_SUBJECT, &hits));
+	g_assert_cmpuint (hits->len, ==, 300);
+
+	/* In the order of modest */
+	for (i = 0; i < hits->len; i++) {
+		check_search_hit (g_ptr_array_index (hits, i), i);
+	}
+
+	g_ptr_array_unref (hits);
+}
+
+static void
+test_search_set (void)
+{
+	ModestSearchHitSet *hits = NULL;
+	guint i;
+
+	reset_mock (300, 0, 0, 0);
+
+	g_assert (libmodest_dbus_client_search_set (osso_ctx, "query", NULL, 0, 0, 0,
+						    MODEST_DBUS_SEARCH_SUBJECT, &hits));
+	g_assert_cmpuint (hits->n_hits, ==, 300);
+
+	/* In the order of modest */
+	for (i = 0; i < hits->n_hits; i++) {
+		check_search_hit (&hits->hits[i], i);
+	}
+
+	modest_search_hit_set_free (hits);
+}
+
+static void
+test_search_fields (void)
+{
+	ModestSearchHitSet *hits = NULL;
+	gchar *msgid;
+	guint n_searches;
+	guint i;
+
+	reset_mock (100, 0, 0, 0);
+	n_searches = modest_mock_get_call_count (MODEST_DBUS_METHOD_SEARCH);
+
+	g_assert (libmodest_dbus_client_search_fields (osso_ctx, "query", NULL, 0, 0, 0,
+						       MODEST_DBUS_SEARCH_SUBJECT,
+						       MODEST_DBUS_SEARCH_FIELD_MSGID |
+						       MODEST_DBUS_SEARCH_FIELD_TIMESTAMP,
+						       &hits));
+	g_assert_cmpuint (hits->n_hits, ==, 100);
+
+	for (i = 0; i < hits->n_hits; i++) {
+		const ModestSearchHit *hit = &hits->hits[i];
+
+		msgid = g_strdup_printf (MODEST_MOCK_HIT_MSGID_FORMAT, i);
+		g_assert_cmpstr (hit->msgid, ==, msgid);
+		g_free (msgid);
+		g_assert_cmpint (hit->timestamp, ==, MODEST_MOCK_HIT_TIMESTAMP + i);
+
+		/* Left out */
+		g_assert (hit->subject == NULL);
+		g_assert (hit->folder == NULL);
+		g_assert (hit->sender == NULL);
+		g_assert_cmpuint (hit->msize, ==, 0);
+		g_assert (!hit->has_attachment);
+		g_assert (!hit->is_unread);
+	}
+	modest_search_hit_set_free (hits);
+
+	/* All of them give the same hits as a full search */
+	g_assert (libmodest_dbus_client_search_fields (osso_ctx, "query", NULL, 0, 0, 0,
+						       MODEST_DBUS_SEARCH_SUBJECT,
+						       MODEST_DBUS_SEARCH_FIELD_ALL, &hits));
+	g_assert_cmpuint (hits->n_hits, ==, 100);
+	for (i = 0; i < hits->n_hits; i++) {
+		check_search_hit (&hits->hits[i], i);
+	}
+	modest_search_hit_set_free (hits);
+
+	g_assert (!libmodest_dbus_client_search_fields (osso_ctx, "query", NULL, 0, 0, 0,
+							MODEST_DBUS_SEARCH_SUBJECT, 0, &hits));
+	g_assert_cmpuint (modest_mock_get_call_count (MODEST_DBUS_METHOD_SEARCH), ==, n_searches);
+}
+
+static void
+test_search_fields_legacy (void)
+{
+	ModestSearchHitSet *hits = NULL;
+	guint n_searches;
+	guint i;
+
+	reset_legacy_mock (100, 0, 0);
+	n_searches = modest_mock_get_call_count (MODEST_DBUS_METHOD_SEARCH);
+
+	/* This modest sends all the fields */
+	g_assert (libmodest_dbus_client_search_fields (osso_ctx, "query", NULL, 0, 0, 0,
+						       MODEST_DBUS_SEARCH_SUBJECT,
+						       MODEST_DBUS_SEARCH_FIELD_MSGID |
+						       MODEST_DBUS_SEARCH_FIELD_TIMESTAMP,
+						       &hits));
+	g_assert_cmpuint (hits->n_hits, ==, 100);
+	for (i = 0; i < hits->n_hits; i++) {
+		check_search_hit (&hits->hits[i], i);
+	}
+	modest_search_hit_set_free (hits);
+
+	g_assert_cmpuint (modest_mock_get_call_count (MODEST_DBUS_METHOD_SEARCH), ==,
+			  n_searches + 1);
+	reset_mock (0, 0, 0, 0);
+}
+
+static void
+test_search_view (void)
+{
+	ModestSearchHitView *hits = NULL;
+	guint i;
+
+	reset_mock (300, 0, 0, 0);
+
+	g_assert (libmodest_dbus_client_search_view (osso_ctx, "query", NULL, 0, 0, 0,
+						     MODEST_DBUS_SEARCH_SUBJECT, &hits));
+	g_assert_cmpuint (hits->n_hits, ==, 300);
+
+	for (i = 0; i < hits->n_hits; i++) {
+		check_search_hit (&hits->hits[i], i);
+	}
+
+	modest_search_hit_view_free (hits);
+}
+
+static void
+test_search_set_interned (void)
+{
+	ModestSearchHitSet *hits = NULL;
+	guint i;
+
+	reset_mock (30, 0, 0, 0);
+
+	/* Within the set */
+	libmodest_dbus_client_set_intern_mode (client, MODEST_DBUS_INTERN_RESULT);
+	g_assert (libmodest_dbus_client_search_set (osso_ctx, "query", NULL, 0, 0, 0,
+						    MODEST_DBUS_SEARCH_SUBJECT, &hits));
+	for (i = 0; i < hits->n_hits; i++) {
+		check_search_hit (&hits->hits[i], i);
+		g_assert (hits->hits[i].folder == hits->hits[0].folder);
+	}
+	modest_search_hit_set_free (hits);
+
+	/* Across the process */
+	libmodest_dbus_client_set_intern_mode (client, MODEST_DBUS_INTERN_PROCESS);
+	g_assert (libmodest_dbus_client_search_set (osso_ctx, "query", NULL, 0, 0, 0,
+						    MODEST_DBUS_SEARCH_SUBJECT, &hits));
+	for (i = 0; i < hits->n_hits; i++) {
+		check_search_hit (&hits->hits[i], i);
+		g_assert (hits->hits[i].folder == g_intern_string (MODEST_MOCK_HIT_FOLDER));
+	}
+	modest_search_hit_set_free (hits);
+
+	libmodest_dbus_client_set_intern_mode (client, MODEST_DBUS_INTERN_NONE);
+}
+
+/* Pages through the 250 hits of a mock modest, without or with the
+ * methods the client falls back from, and checks how many calls of
+ * each kind it got */
+static void
+check_search_paged (gboolean legacy, guint n_searches, guint n_paged_searches,
+		    guint n_next_pages)
+{
+	ModestSearchCursor *cursor = NULL;
+	GPtrArray *hits = NULL;
+	guint n_hits = 0, n_pages = 0;
+	guint searches, paged_searches, next_pages;
+	guint i;
+
+	g_assert (modest_mock_configure (250, 0, 0, 0, legacy));
+	searches = modest_mock_get_call_count (MODEST_DBUS_METHOD_SEARCH);
+	paged_searches = modest_mock_get_call_count (MODEST_DBUS_METHOD_SEARCH_PAGED);
+	next_pages = modest_mock_get_call_count (MODEST_DBUS_METHOD_SEARCH_NEXT_PAGE);
+
+	g_assert (libmodest_dbus_client_search_paged (osso_ctx, "query", NULL, 0, 0, 0,
+						      MODEST_DBUS_SEARCH_SUBJECT, 100,
+						      &hits, &cursor));
+
+	while (TRUE) {
+		g_assert_cmpuint (hits->len, <=, 100);
+		for (i = 0; i < hits->len; i++) {
+			check_search_hit (g_ptr_array_index (hits, i), n_hits + i);
+		}
+		n_hits += hits->len;
+		n_pages++;
+		g_ptr_array_unref (hits);
+
+		if (libmodest_dbus_client_search_cursor_is_done (cursor)) {
+			break;
+		}
+
+		g_assert (libmodest_dbus_client_search_next_page (cursor, &hits));
+	}
+
+	g_assert_cmpuint (n_hits, ==, 250);
+	g_assert_cmpuint (n_pages, ==, 3);
+	libmodest_dbus_client_search_cursor_close (cursor);
+
+	g_assert_cmpuint (modest_mock_get_call_count (MODEST_DBUS_METHOD_SEARCH), ==,
+			  searches + n_searches);
+	g_assert_cmpuint (modest_mock_get_call_count (MODEST_DBUS_METHOD_SEARCH_PAGED), ==,
+			  paged_searches + n_paged_searches);
+	g_assert_cmpuint (modest_mock_get_call_count (MODEST_DBUS_METHOD_SEARCH_NEXT_PAGE), ==,
+			  next_pages + n_next_pages);
+}
+
+static void
+test_search_paged (void)
+{
+	ModestSearchCursor *cursor = NULL;
+	GPtrArray *hits = NULL;
+
+	/* Paged by modest */
+	check_search_paged (FALSE, 0, 1, 2);
+
+	/* Closing before the last page lets modest forget the search */
+	g_assert (libmodest_dbus_client_search_paged (osso_ctx, "query", NULL, 0, 0, 0,
+						      MODEST_DBUS_SEARCH_SUBJECT, 100,
+						      &hits, &cursor));
+	g_assert (!libmodest_dbus_client_search_cursor_is_done (cursor));
+	g_ptr_array_unref (hits);
+	libmodest_dbus_client_search_cursor_close (cursor);
+	g_assert_cmpuint (modest_mock_get_call_count (MODEST_DBUS_METHOD_CLOSE_SEARCH_CURSOR), ==, 1);
+}
+
+static void
+test_search_paged_legacy (void)
+{
+	/* SearchPaged is unknown: one search, paged here */
+	check_search_paged (TRUE, 1, 1, 0);
+	reset_mock (0, 0, 0, 0);
+}
+
+/* Asks a mock modest of 200 hits, without or with the methods the
+ * client falls back from, for the top ones twice, and checks how many
+ * calls of each kind it got */
+static void
+check_search_top (gboolean legacy, guint n_searches, guint n_top_searches)
+{
+	GPtrArray *hits = NULL;
+	guint searches, top_searches;
+	guint i;
+
+	g_assert (modest_mock_configure (200, 0, 0, 0, legacy));
+	searches = modest_mock_get_call_count (MODEST_DBUS_METHOD_SEARCH);
+	top_searches = modest_mock_get_call_count (MODEST_DBUS_METHOD_SEARCH_TOP);
+
+	/* The newest ones first */
+	g_assert (libmodest_dbus_client_search_top (osso_ctx, "query", NULL, 0, 0, 0,
+						    MODEST_DBUS_SEARCH_SUBJECT,
+						    MODEST_DBUS_SEARCH_SORT_TIMESTAMP, TRUE, 50,
+						    &hits));
+	g_assert_cmpuint (hits->len, ==, 50);
+	for (i = 0; i < hits->len; i++) {
+		check_search_hit (g_ptr_array_index (hits, i), 199 - i);
+	}
+	g_ptr_array_unref (hits);
+
+	/* The smallest ones first, with fewer hits than asked */
+	g_assert (libmodest_dbus_client_search_top (osso_ctx, "query", NULL, 0, 0, 0,
+						    MODEST_DBUS_SEARCH_SUBJECT,
+						    MODEST_DBUS_SEARCH_SORT_SIZE, FALSE, 500,
+						    &hits));
+	g_assert_cmpuint (hits->len, ==, 200);
+	for (i = 0; i < hits->len; i++) {
+		check_search_hit (g_ptr_array_index (hits, i), i);
+	}
+	g_ptr_array_unref (hits);
+
+	g_assert_cmpuint (modest_mock_get_call_count (MODEST_DBUS_METHOD_SEARCH), ==,
+			  searches + n_searches);
+	g_assert_cmpuint (modest_mock_get_call_count (MODEST_DBUS_METHOD_SEARCH_TOP), ==,
+			  top_searches + n_top_searches);
+}
+
+static void
+test_search_top (void)
+{
+	/* Modest sorted them, the whole search never went over the bus */
+	check_search_top (FALSE, 0, 2);
+}
+
+static void
+test_search_top_legacy (void)
+{
+	/* SearchTop is unknown every time, so sorted here */
+	check_search_top (TRUE, 2, 2);
+	reset_mock (0, 0, 0, 0);
+}
+
+static void
+on_search_ready (GObject *source, GAsyncResult *result, gpointer user_data)
+{
+	GList *hits = NULL;
+	GError *error = NULL;
+
+	g_assert (libmodest_dbus_client_search_finish (result, &hits, &error));
+	g_assert_no_error (error);
+	check_search_hits (hits, 20);
+	modest_search_hit_list_free (hits);
+
+	g_main_loop_quit (user_data);
+}
+
+static void
+test_search_async (void)
+{
+	GMainLoop *loop = g_main_loop_new (NULL, FALSE);
+
+	reset_mock (20, 0, 0, 10);
+
+	libmodest_dbus_client_search_async (osso_ctx, "query", NULL, 0, 0, 0,
+					    MODEST_DBUS_SEARCH_SUBJECT, NULL,
+					    on_search_ready, loop);
+	g_main_loop_run (loop);
+	g_main_loop_unref (loop);
+}
+
+static void
+on_search_cancelled (GObject *source, GAsyncResult *result, gpointer user_data)
+{
+	GList *hits = NULL;
+	GError *error = NULL;
+
+	g_assert (!libmodest_dbus_client_search_finish (result, &hits, &error));
+	g_assert_error (error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+	g_assert (hits == NULL);
+	g_error_free (error);
+
+	g_main_loop_quit (user_data);
+}
+
+static void
+test_search_cancel (void)
+{
+	GMainLoop *loop = g_main_loop_new (NULL, FALSE);
+	GCancellable *cancellable = g_cancellable_new ();
+	guint n_cancels;
+	gint64 start;
+
+	reset_mock (20, 0, 0, 0);
+	n_cancels = modest_mock_get_call_count (MODEST_DBUS_METHOD_CANCEL_REQUEST);
+	reset_mock (20, 0, 0, 2000);
+
+	start = g_get_monotonic_time ();
+	libmodest_dbus_client_search_async (osso_ctx, "query", NULL, 0, 0, 0,
+					    MODEST_DBUS_SEARCH_SUBJECT, cancellable,
+					    on_search_cancelled, loop);
+	g_cancellable_cancel (cancellable);
+	g_main_loop_run (loop);
+
+	/* Without waiting for the reply */
+	g_assert_cmpint (g_get_monotonic_time () - start, <, 1000 * G_TIME_SPAN_MILLISECOND);
+
+	/* Modest was told to drop the search */
+	g_assert (libmodest_dbus_client_sync (osso_ctx));
+	reset_mock (0, 0, 0, 0);
+	g_assert_cmpuint (modest_mock_get_call_count (MODEST_DBUS_METHOD_CANCEL_REQUEST), ==,
+			  n_cancels + 1);
+
+	g_object_unref (cancellable);
+	g_main_loop_unref (loop);
+}
+
+typedef struct {
+	guint      n_hits;
+	guint      n_chunks;
+	gboolean   finished;
+	GError    *error;
+} StreamData;
+
+static void
+on_search_chunk (guint search_id, GList *hits, gboolean finished,
+		 const GError *error, gpointer user_data)
+{
+	StreamData *data = user_data;
+
+	g_assert (!data->finished);
+
+	data->n_hits += g_list_length (hits);
+	data->n_chunks++;
+	data->finished = finished;
+
+	if (error) {
+		g_assert (finished);
+		data->error = g_error_copy (error);
+	}
+}
+
+/* Runs the main loop until @data got @n_chunks chunks, or the last one */
+static void
+wait_for_chunks (StreamData *data, guint n_chunks)
+{
+	while (!data->finished && data->n_chunks < n_chunks) {
+		g_main_context_iteration (NULL, TRUE);
+	}
+}
+
+static void
+test_search_stream (void)
+{
+	StreamData data = { 0, 0, FALSE, NULL };
+
+	reset_mock (250, 0, 0, 0);
+
+	g_assert (libmodest_dbus_client_search_stream (osso_ctx, "query", NULL, 0, 0, 0,
+						       MODEST_DBUS_SEARCH_SUBJECT, 100,
+						       on_search_chunk, &data, NULL));
+	wait_for_chunks (&data, G_MAXUINT);
+
+	g_assert_no_error (data.error);
+	g_assert_cmpuint (data.n_hits, ==, 250);
+	g_assert_cmpuint (data.n_chunks, ==, 3);
+}
+
+static void
+test_search_stream_cancel (void)
+{
+	StreamData data = { 0, 0, FALSE, NULL };
+	guint search_id;
+	guint n_cancels, n_sent;
+
+	reset_mock (250, 0, 0, 0);
+	n_cancels = modest_mock_get_call_count (MODEST_DBUS_METHOD_CANCEL_SEARCH_STREAM);
+
+	/* A chunk every 100ms */
+	reset_mock (250, 0, 0, 100);
+	search_id = libmodest_dbus_client_search_stream (osso_ctx, "query", NULL, 0, 0, 0,
+							 MODEST_DBUS_SEARCH_SUBJECT, 50,
+							 on_search_chunk, &data, NULL);
+	g_assert (search_id != 0);
+	wait_for_chunks (&data, 1);
+	libmodest_dbus_client_search_stream_cancel (osso_ctx, search_id);
+
+	g_assert (libmodest_dbus_client_sync (osso_ctx));
+	reset_mock (0, 0, 0, 0);
+	g_assert_cmpuint (modest_mock_get_call_count (MODEST_DBUS_METHOD_CANCEL_SEARCH_STREAM),
+			  ==, n_cancels + 1);
+
+	/* Modest sends no more chunks, and none reached the chunk function */
+	n_sent = modest_mock_get_call_count (MODEST_DBUS_SIGNAL_SEARCH_HITS);
+	run_main_loop_for (300);
+	g_assert_cmpuint (modest_mock_get_call_count (MODEST_DBUS_SIGNAL_SEARCH_HITS), ==, n_sent);
+	g_assert_cmpuint (data.n_chunks, ==, 1);
+	g_assert (!data.finished);
+}
+
+static void
+test_search_stream_legacy (void)
+{
+	StreamData data = { 0, 0, FALSE, NULL };
+	guint n_searches;
+
+	reset_legacy_mock (250, 0, 0);
+	n_searches = modest_mock_get_call_count (MODEST_DBUS_METHOD_SEARCH);
+
+	/* All the hits at once, as modest could not stream them */
+	g_assert (libmodest_dbus_client_search_stream (osso_ctx, "query", NULL, 0, 0, 0,
+						       MODEST_DBUS_SEARCH_SUBJECT, 100,
+						       on_search_chunk, &data, NULL));
+	wait_for_chunks (&data, G_MAXUINT);
+
+	g_assert_no_error (data.error);
+	g_assert_cmpuint (data.n_hits, ==, 250);
+	g_assert_cmpuint (data.n_chunks, ==, 1);
+	g_assert_cmpuint (modest_mock_get_call_count (MODEST_DBUS_METHOD_SEARCH), ==,
+			  n_searches + 1);
+	reset_mock (0, 0, 0, 0);
+}
+
+static void
+test_search_stream_exit (void)
+{
+	StreamData data = { 0, 0, FALSE, NULL };
+
+	/* A chunk every 200ms */
+	reset_mock (250, 0, 0, 200);
+
+	g_assert (libmodest_dbus_client_search_stream (osso_ctx, "query", NULL, 0, 0, 0,
+						       MODEST_DBUS_SEARCH_SUBJECT, 100,
+						       on_search_chunk, &data, NULL));
+	wait_for_chunks (&data, 1);
+	g_assert (!data.finished);
+
+	/* Modest exits in the middle of the search */
+	g_assert (modest_mock_release_name (500));
+	wait_for_chunks (&data, G_MAXUINT);
+
+	g_assert_error (data.error, MODEST_DBUS_CLIENT_ERROR, MODEST_DBUS_CLIENT_ERROR_NOT_RUNNING);
+	g_assert_cmpuint (data.n_hits, <, 250);
+	g_error_free (data.error);
+
+	wait_for_running (TRUE);
+	reset_mock (0, 0, 0, 0);
+}
+
+/* Checks the accounts of a mock of 3 accounts, asked for 5 messages each */
+static void
+check_account_hits (GList *accounts)
+{
+	GList *iter;
+
+	g_assert_cmpuint (g_list_length (accounts), ==, 3);
+
+	for (iter = accounts; iter; iter = iter->next) {
+		ModestAccountHits *account = iter->data;
+
+		g_assert (g_str_has_prefix (account->account_id, "account"));
+		g_assert_cmpstr (account->store_protocol, ==, "imap");
+		g_assert_cmpint (account->unread_count, ==, 10);
+		g_assert_cmpuint (g_list_length (account->hits), ==, 5);
+	}
+}
+
+static void
+test_get_unread_messages (void)
+{
+	GList *accounts = NULL;
+
+	reset_mock (0, 3, 0, 0);
+
+	g_assert (libmodest_dbus_client_get_unread_messages (osso_ctx, 5, &accounts));
+	check_account_hits (accounts);
+	modest_account_hits_list_free (accounts);
+}
+
+static void
+on_unread_messages_ready (GObject *source, GAsyncResult *result, gpointer user_data)
+{
+	GList *accounts = NULL;
+	GError *error = NULL;
+
+	g_assert (libmodest_dbus_client_get_unread_messages_finish (result, &accounts, &error));
+	g_assert_no_error (error);
+	check_account_hits (accounts);
+	modest_account_hits_list_free (accounts);
+
+	g_main_loop_quit (user_data);
+}
+
+static void
+test_get_unread_messages_async (void)
+{
+	GMainLoop *loop = g_main_loop_new (NULL, FALSE);
+
+	reset_mock (0, 3, 0, 10);
+
+	libmodest_dbus_client_get_unread_messages_async (osso_ctx, 5, NULL,
+							 on_unread_messages_ready, loop);
+	g_main_loop_run (loop);
+	g_main_loop_unref (loop);
+	reset_mock (0, 0, 0, 0);
+}
+
+static void
+on_unread_messages_cancelled (GObject *source, GAsyncResult *result, gpointer user_data)
+{
+	GList *accounts = NULL;
+	GError *error = NULL;
+
+	g_assert (!libmodest_dbus_client_get_unread_messages_finish (result, &accounts, &error));
+	g_assert_error (error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+	g_assert (accounts == NULL);
+	g_error_free (error);
+
+	g_main_loop_quit (user_data);
+}
+
+static void
+test_get_unread_messages_cancel (void)
+{
+	GMainLoop *loop = g_main_loop_new (NULL, FALSE);
+	GCancellable *cancellable = g_cancellable_new ();
+	guint n_cancels;
+	gint64 start;
+
+	reset_mock (0, 3, 0, 0);
+	n_cancels = modest_mock_get_call_count (MODEST_DBUS_METHOD_CANCEL_REQUEST);
+	reset_mock (0, 3, 0, 2000);
+
+	start = g_get_monotonic_time ();
+	libmodest_dbus_client_get_unread_messages_async (osso_ctx, 5, cancellable,
+							 on_unread_messages_cancelled, loop);
+	g_cancellable_cancel (cancellable);
+	g_main_loop_run (loop);
+
+	/* Without waiting for the reply */
+	g_assert_cmpint (g_get_monotonic_time () - start, <, 1000 * G_TIME_SPAN_MILLISECOND);
+
+	/* Modest was told to drop the request */
+	g_assert (libmodest_dbus_client_sync (osso_ctx));
+	reset_mock (0, 0, 0, 0);
+	g_assert_cmpuint (modest_mock_get_call_count (MODEST_DBUS_METHOD_CANCEL_REQUEST), ==,
+			  n_cancels + 1);
+
+	g_object_unref (cancellable);
+	g_main_loop_unref (loop);
+}
+
+static void
+test_get_unread_messages_set (void)
+{
+	ModestAccountHitsSet *accounts = NULL;
+	guint i;
+
+	reset_mock (0, 3, 0, 0);
+
+	g_assert (libmodest_dbus_client_get_unread_messages_set (osso_ctx, 5, &accounts));
+	g_assert_cmpuint (accounts->n_accounts, ==, 3);
+
+	for (i = 0; i < accounts->n_accounts; i++) {
+		ModestAccountHits *account = &accounts->accounts[i];
+		ModestGetUnreadMessagesHit *hit;
+		gchar *account_id = g_strdup_printf ("account%u", i);
+
+		g_assert_cmpstr (account->account_id, ==, account_id);
+		g_assert_cmpstr (account->store_protocol, ==, "imap");
+		g_assert_cmpint (account->unread_count, ==, 10);
+		g_assert_cmpuint (g_list_length (account->hits), ==, 5);
+
+		hit = g_list_last (account->hits)->data;
+		g_assert_cmpint (hit->timestamp, ==, MODEST_MOCK_HIT_TIMESTAMP + 4);
+		g_free (account_id);
+	}
+
+	modest_account_hits_set_free (accounts);
+}
+
+static void
+on_unread_model_changed (ModestUnreadModel *model, gpointer user_data)
+{
+	g_main_loop_quit (user_data);
+}
+
+static void
+test_unread_model (void)
+{
+	GMainLoop *loop = g_main_loop_new (NULL, FALSE);
+	ModestUnreadModel *model;
+	const GList *account_hits;
+	guint calls;
+	gulong id;
+
+	reset_mock (0, 3, 0, 0);
+	calls = modest_mock_get_call_count (MODEST_DBUS_METHOD_GET_UNREAD_MESSAGES);
+
+	/* Filled from the main loop */
+	model = libmodest_dbus_client_unread_model_new (client, 5);
+	g_assert (model != NULL);
+	g_assert (!libmodest_dbus_client_unread_model_is_ready (model));
+	id = libmodest_dbus_client_unread_model_add_watch (model, on_unread_model_changed,
+							   loop, NULL);
+	g_main_loop_run (loop);
+
+	g_assert (libmodest_dbus_client_unread_model_is_ready (model));
+	account_hits = libmodest_dbus_client_unread_model_get_account_hits (model);
+	g_assert_cmpuint (g_list_length ((GList *) account_hits), ==, 3);
+	g_assert_cmpint (libmodest_dbus_client_unread_model_get_unread_count (model, "account0"),
+			 ==, 10);
+	g_assert_cmpint (libmodest_dbus_client_unread_model_get_unread_count (model, "account3"),
+			 ==, -1);
+
+	/* A burst of signals is fetched once */
+	reset_mock (0, 4, 0, 0);
+	g_assert (modest_mock_emit_folder_updated ("account0", "INBOX"));
+	g_assert (modest_mock_emit_folder_updated ("account1", "INBOX"));
+	g_main_loop_run (loop);
+
+	g_assert_cmpint (libmodest_dbus_client_unread_model_get_unread_count (model, "account3"),
+			 ==, 10);
+	g_assert_cmpuint (modest_mock_get_call_count (MODEST_DBUS_METHOD_GET_UNREAD_MESSAGES), ==,
+			  calls + 2);
+
+	libmodest_dbus_client_unread_model_remove_watch (model, id);
+	libmodest_dbus_client_unread_model_unref (model);
+	g_main_loop_unref (loop);
+}
+
+static void
+test_get_folders (void)
+{
+	GList *folders = NULL;
+
+	reset_mock (0, 0, 20, 0);
+
+	g_assert (libmodest_dbus_client_get_folders (osso_ctx, &folders));
+	g_assert_cmpuint (g_list_length (folders), ==, 20);
+	g_assert (g_str_has_prefix (((ModestFolderResult *) folders->data)->folder_uri,
+				    "local://folder"));
+	modest_folder_result_list_free (folders);
+}
+
+static void
+on_folder_updated_quit (ModestDbusClient *client, const gchar *account_id,
+			const gchar *folder_id, gpointer user_data)
+{
+	g_main_loop_quit (user_data);
+}
+
+static void
+test_folder_cache (void)
+{
+	GMainLoop *loop = g_main_loop_new (NULL, FALSE);
+	GList *folders = NULL;
+	guint calls;
+	gulong id;
+
+	reset_mock (0, 0, 20, 0);
+
+	/* The second call is answered from the cache */
+	libmodest_dbus_client_set_folder_cache (client, TRUE);
+	g_assert (libmodest_dbus_client_get_folders (osso_ctx, &folders));
+	modest_folder_result_list_free (folders);
+	calls = modest_mock_get_call_count (MODEST_DBUS_METHOD_GET_FOLDERS);
+
+	g_assert (libmodest_dbus_client_get_folders (osso_ctx, &folders));
+	g_assert_cmpuint (g_list_length (folders), ==, 20);
+	modest_folder_result_list_free (folders);
+	g_assert_cmpuint (modest_mock_get_call_count (MODEST_DBUS_METHOD_GET_FOLDERS), ==, calls);
+
+	/* Until folder_updated */
+	reset_mock (0, 0, 25, 0);
+	id = libmodest_dbus_client_subscribe_folder_updated (client, NULL, on_folder_updated_quit,
+							     loop, NULL);
+	g_assert (modest_mock_emit_folder_updated ("account0", "INBOX"));
+	g_main_loop_run (loop);
+	libmodest_dbus_client_unsubscribe (client, id);
+
+	g_assert (libmodest_dbus_client_get_folders (osso_ctx, &folders));
+	g_assert_cmpuint (g_list_length (folders), ==, 25);
+	modest_folder_result_list_free (folders);
+	g_assert_cmpuint (modest_mock_get_call_count (MODEST_DBUS_METHOD_GET_FOLDERS), ==,
+			  calls + 1);
+
+	libmodest_dbus_client_set_folder_cache (client, FALSE);
+	g_main_loop_unref (loop);
+}
+
+static void
+test_get_folders_array (void)
+{
+	GPtrArray *folders = NULL;
+	GList *list = NULL;
+	GList *iter;
+	guint i;
+
+	reset_mock (0, 0, 20, 0);
+
+	g_assert (libmodest_dbus_client_get_folders_array (osso_ctx, &folders));
+	g_assert_cmpuint (folders->len, ==, 20);
+
+	/* In the order of modest, like the list */
+	g_assert (libmodest_dbus_client_get_folders (osso_ctx, &list));
+	for (i = 0, iter = list; i < folders->len; i++, iter = iter->next) {
+		ModestFolderResult *folder = g_ptr_array_index (folders, i);
+		ModestFolderResult *item = iter->data;
+		gchar *uri = g_strdup_printf ("local://folder%u", i);
+
+		g_assert_cmpstr (folder->folder_uri, ==, uri);
+		g_assert_cmpstr (item->folder_uri, ==, uri);
+		g_free (uri);
+	}
+
+	modest_folder_result_list_free (list);
+	g_ptr_array_unref (folders);
+}
+
+static void
+on_folders_ready (GObject *source, GAsyncResult *result, gpointer user_data)
+{
+	GList *folders = NULL;
+	GList *iter;
+	GError *error = NULL;
+	guint i;
+
+	g_assert (libmodest_dbus_client_get_folders_finish (result, &folders, &error));
+	g_assert_no_error (error);
+	g_assert_cmpuint (g_list_length (folders), ==, 20);
+
+	/* In the order of modest, whether from modest or from the cache */
+	for (i = 0, iter = folders; iter; i++, iter = iter->next) {
+		ModestFolderResult *folder = iter->data;
+		gchar *uri = g_strdup_printf ("local://folder%u", i);
+
+		g_assert_cmpstr (folder->folder_uri, ==, uri);
+		g_free (uri);
+	}
+
+	modest_folder_result_list_free (folders);
+
+	g_main_loop_quit (user_data);
+}
+
+static void
+test_get_folders_async (void)
+{
+	GMainLoop *loop = g_main_loop_new (NULL, FALSE);
+	guint calls;
+
+	reset_mock (0, 0, 20, 10);
+	calls = modest_mock_get_call_count (MODEST_DBUS_METHOD_GET_FOLDERS);
+
+	libmodest_dbus_client_get_folders_async (osso_ctx, NULL, on_folders_ready, loop);
+	g_main_loop_run (loop);
+	g_assert_cmpuint (modest_mock_get_call_count (MODEST_DBUS_METHOD_GET_FOLDERS), ==,
+			  calls + 1);
+
+	/* The reply fills the cache, which answers the next call */
+	libmodest_dbus_client_set_folder_cache (client, TRUE);
+	libmodest_dbus_client_get_folders_async (osso_ctx, NULL, on_folders_ready, loop);
+	g_main_loop_run (loop);
+	g_assert_cmpuint (modest_mock_get_call_count (MODEST_DBUS_METHOD_GET_FOLDERS), ==,
+			  calls + 2);
+
+	libmodest_dbus_client_get_folders_async (osso_ctx, NULL, on_folders_ready, loop);
+	g_main_loop_run (loop);
+	g_assert_cmpuint (modest_mock_get_call_count (MODEST_DBUS_METHOD_GET_FOLDERS), ==,
+			  calls + 2);
+
+	libmodest_dbus_client_set_folder_cache (client, FALSE);
+	g_main_loop_unref (loop);
+	reset_mock (0, 0, 0, 0);
+}
+
+static void
+test_delete_messages (void)
+{
+	const gchar *uris[] = { "local://inbox/1", "local://" MODEST_MOCK_MISSING_MSG,
+				"local://inbox/2", NULL };
+	gboolean *deleted = NULL;
+
+	g_assert (libmodest_dbus_client_delete_messages (osso_ctx, uris, &deleted));
+	g_assert (deleted[0]);
+	g_assert (!deleted[1]);
+	g_assert (deleted[2]);
+	g_free (deleted);
+
+	g_assert (libmodest_dbus_client_delete_message (osso_ctx, "local://inbox/3"));
+}
+
+static void
+test_delete_messages_legacy (void)
+{
+	const gchar *uris[] = { "local://inbox/1", "local://inbox/2", "local://inbox/3", NULL };
+	gboolean *deleted = NULL;
+	guint calls;
+
+	reset_legacy_mock (0, 0, 0);
+	calls = modest_mock_get_call_count (MODEST_DBUS_METHOD_DELETE_MESSAGE);
+
+	/* One by one */
+	g_assert (libmodest_dbus_client_delete_messages (osso_ctx, uris, &deleted));
+	g_assert (deleted[0] && deleted[1] && deleted[2]);
+	g_free (deleted);
+
+	g_assert_cmpuint (modest_mock_get_call_count (MODEST_DBUS_METHOD_DELETE_MESSAGE), ==,
+			  calls + 3);
+	reset_mock (0, 0, 0, 0);
+}
+
+static void
+test_simple_calls (void)
+{
+	GSList *attachments = g_slist_prepend (NULL, "file:///tmp/attachment");
+
+	reset_mock (0, 0, 0, 0);
+
+	g_assert (libmodest_dbus_client_mail_to (osso_ctx, "mailto:foo@example.com"));
+	g_assert (libmodest_dbus_client_compose_mail (osso_ctx, "foo@example.com", NULL, NULL,
+						      "subject", "body", attachments));
+	g_assert (libmodest_dbus_client_open_message (osso_ctx, "local://inbox/1"));
+	g_assert (libmodest_dbus_client_open_account (osso_ctx, "account0"));
+	g_assert (libmodest_dbus_client_send_and_receive (osso_ctx));
+	g_assert (libmodest_dbus_client_send_and_receive_full (osso_ctx, "account0", TRUE));
+	g_assert (libmodest_dbus_client_update_folder_counts (osso_ctx, "account0"));
+	g_assert (libmodest_dbus_client_open_default_inbox (osso_ctx));
+	g_assert (libmodest_dbus_client_open_edit_accounts_dialog (osso_ctx));
+
+	g_slist_free (attachments);
+}
+
+static void
+test_no_reply (void)
+{
+	guint calls = modest_mock_get_call_count (MODEST_DBUS_METHOD_OPEN_MESSAGE);
+
+	g_assert (libmodest_dbus_client_open_message_no_reply (osso_ctx, "local://inbox/1"));
+	g_assert (libmodest_dbus_client_open_message_no_reply (osso_ctx, "local://inbox/2"));
+	g_assert (libmodest_dbus_client_sync (osso_ctx));
+
+	g_assert_cmpuint (modest_mock_get_call_count (MODEST_DBUS_METHOD_OPEN_MESSAGE), ==,
+			  calls + 2);
+}
+
+static void
+test_no_reply_restart (void)
+{
+	guint calls;
+
+	/* Learns the unique name of modest */
+	reset_mock (0, 0, 0, 0);
+	g_assert (libmodest_dbus_client_sync (osso_ctx));
+	calls = modest_mock_get_call_count (MODEST_DBUS_METHOD_OPEN_MESSAGE);
+
+	/* Modest restarts before the client sees it go */
+	g_assert (modest_mock_release_name (100));
+	g_assert (modest_mock_wait_for_name ());
+
+	g_assert (libmodest_dbus_client_open_message_no_reply (osso_ctx, "local://inbox/1"));
+	g_assert (libmodest_dbus_client_sync (osso_ctx));
+
+	g_assert_cmpuint (modest_mock_get_call_count (MODEST_DBUS_METHOD_OPEN_MESSAGE), ==,
+			  calls + 1);
+}
+
+static void
+test_coalesce (void)
+{
+	guint n_full, n_counts;
+
+	reset_mock (0, 0, 0, 0);
+	n_full = modest_mock_get_call_count (MODEST_DBUS_METHOD_SEND_RECEIVE_FULL);
+	n_counts = modest_mock_get_call_count (MODEST_DBUS_METHOD_UPDATE_FOLDER_COUNTS);
+
+	libmodest_dbus_client_set_coalesce_window (client, 100);
+	g_assert (libmodest_dbus_client_send_and_receive_full_coalesced (client, "account0", FALSE));
+	g_assert (libmodest_dbus_client_send_and_receive_full_coalesced (client, "account0", TRUE));
+	g_assert (libmodest_dbus_client_send_and_receive_full_coalesced (client, "account1", FALSE));
+	g_assert (libmodest_dbus_client_update_folder_counts_coalesced (client, "account0"));
+	g_assert (libmodest_dbus_client_update_folder_counts_coalesced (client, "account0"));
+
+	/* Held back for the window */
+	g_assert (libmodest_dbus_client_sync (osso_ctx));
+	g_assert_cmpuint (modest_mock_get_call_count (MODEST_DBUS_METHOD_SEND_RECEIVE_FULL), ==,
+			  n_full);
+
+	/* Then sent once per account */
+	run_main_loop_for (300);
+	g_assert (libmodest_dbus_client_sync (osso_ctx));
+	g_assert_cmpuint (modest_mock_get_call_count (MODEST_DBUS_METHOD_SEND_RECEIVE_FULL), ==,
+			  n_full + 2);
+	g_assert_cmpuint (modest_mock_get_call_count (MODEST_DBUS_METHOD_UPDATE_FOLDER_COUNTS), ==,
+			  n_counts + 1);
+
+	/* Flushing does not wait for the window */
+	g_assert (libmodest_dbus_client_update_folder_counts_coalesced (client, "account0"));
+	libmodest_dbus_client_flush (osso_ctx);
+	g_assert (libmodest_dbus_client_sync (osso_ctx));
+	g_assert_cmpuint (modest_mock_get_call_count (MODEST_DBUS_METHOD_UPDATE_FOLDER_COUNTS), ==,
+			  n_counts + 2);
+
+	/* Nor does closing the window, after which nothing is held back */
+	g_assert (libmodest_dbus_client_update_folder_counts_coalesced (client, "account0"));
+	libmodest_dbus_client_set_coalesce_window (client, 0);
+	g_assert (libmodest_dbus_client_update_folder_counts_coalesced (client, "account0"));
+	g_assert (libmodest_dbus_client_update_folder_counts_coalesced (client, "account0"));
+	g_assert (libmodest_dbus_client_sync (osso_ctx));
+	g_assert_cmpuint (modest_mock_get_call_count (MODEST_DBUS_METHOD_UPDATE_FOLDER_COUNTS), ==,
+			  n_counts + 5);
+}
+
+static void
+on_search_not_running (GObject *source, GAsyncResult *result, gpointer user_data)
+{
+	GList *hits = NULL;
+	GError *error = NULL;
+
+	g_assert (!libmodest_dbus_client_search_finish (result, &hits, &error));
+	g_assert_error (error, MODEST_DBUS_CLIENT_ERROR, MODEST_DBUS_CLIENT_ERROR_NOT_RUNNING);
+	g_error_free (error);
+
+	g_main_loop_quit (user_data);
+}
+
+static void
+test_only_if_running (void)
+{
+	GMainLoop *loop = g_main_loop_new (NULL, FALSE);
+	ModestDbusEvent *events;
+	guint n_events;
+	GList *hits = NULL;
+	guint n_searches;
+
+	reset_mock (10, 0, 0, 0);
+	n_searches = modest_mock_get_call_count (MODEST_DBUS_METHOD_SEARCH);
+	libmodest_dbus_client_set_only_if_running (client, TRUE);
+
+	g_assert (libmodest_dbus_client_is_running (client));
+	g_assert (libmodest_dbus_client_search (osso_ctx, "query", NULL, 0, 0, 0,
+						MODEST_DBUS_SEARCH_SUBJECT, &hits));
+	modest_search_hit_list_free (hits);
+
+	/* Gone: the calls fail without reaching the bus */
+	g_assert (modest_mock_release_name (500));
+	wait_for_running (FALSE);
+
+	g_assert (!libmodest_dbus_client_search (osso_ctx, "query", NULL, 0, 0, 0,
+						 MODEST_DBUS_SEARCH_SUBJECT, &hits));
+	libmodest_dbus_client_search_async (osso_ctx, "query", NULL, 0, 0, 0,
+					    MODEST_DBUS_SEARCH_SUBJECT, NULL,
+					    on_search_not_running, loop);
+	g_main_loop_run (loop);
+
+	events = libmodest_dbus_client_get_events (client, &n_events);
+	g_assert_cmpuint (n_events, >=, 2);
+	g_assert_cmpstr (events[n_events - 1].method, ==, MODEST_DBUS_METHOD_SEARCH);
+	g_assert_cmpint (events[n_events - 1].result, ==, MODEST_DBUS_EVENT_NOT_RUNNING);
+	g_assert_cmpint (events[n_events - 2].result, ==, MODEST_DBUS_EVENT_NOT_RUNNING);
+	g_free (events);
+
+	/* Back */
+	wait_for_running (TRUE);
+	g_assert (libmodest_dbus_client_search (osso_ctx, "query", NULL, 0, 0, 0,
+						MODEST_DBUS_SEARCH_SUBJECT, &hits));
+	modest_search_hit_list_free (hits);
+	g_assert_cmpuint (modest_mock_get_call_count (MODEST_DBUS_METHOD_SEARCH), ==,
+			  n_searches + 2);
+
+	libmodest_dbus_client_set_only_if_running (client, FALSE);
+	g_main_loop_unref (loop);
+}
+
+/* Copies the statistics of @method, or zeroes if it was never called */
+static void
+get_method_stats (const gchar *method, ModestDbusMethodStats *stats)
+{
+	ModestDbusMethodStats *all;
+	guint n_stats, i;
+
+	memset (stats, 0, sizeof (*stats));
+	all = libmodest_dbus_client_get_stats (client, &n_stats);
+
+	for (i = 0; i < n_stats; i++) {
+		if (g_strcmp0 (all[i].method, method) == 0) {
+			*stats = all[i];
+		}
+	}
+
+	g_free (all);
+}
+
+static guint64
+count_answered_calls (const ModestDbusMethodStats *stats)
+{
+	guint64 n = 0;
+	guint i;
+
+	for (i = 0; i < MODEST_DBUS_CLIENT_LATENCY_BUCKETS; i++) {
+		n += stats->latency_buckets[i];
+	}
+
+	return n;
+}
+
+static void
+test_stats (void)
+{
+	ModestDbusMethodStats before, after;
+	ModestSearchHitSet *hits = NULL;
+
+	reset_mock (40, 0, 0, 0);
+	get_method_stats (MODEST_DBUS_METHOD_SEARCH, &before);
+
+	g_assert (libmodest_dbus_client_search_set (osso_ctx, "query", NULL, 0, 0, 0,
+						    MODEST_DBUS_SEARCH_SUBJECT, &hits));
+	modest_search_hit_set_free (hits);
+
+	get_method_stats (MODEST_DBUS_METHOD_SEARCH, &after);
+	g_assert_cmpstr (after.method, ==, MODEST_DBUS_METHOD_SEARCH);
+	g_assert_cmpuint (after.calls, ==, before.calls + 1);
+	g_assert_cmpuint (after.failures, ==, before.failures);
+	g_assert_cmpuint (after.items_decoded, ==, before.items_decoded + 40);
+	g_assert_cmpuint (after.result_bytes, >, before.result_bytes);
+	g_assert_cmpuint (count_answered_calls (&after), ==, count_answered_calls (&before) + 1);
+	g_assert_cmpuint (libmodest_dbus_method_stats_get_percentile (&after, 100), >, 0);
+}
+
+static void
+test_events (void)
+{
+	ModestDbusEvent *events;
+	guint n_events;
+	GList *hits = NULL;
+	GString *dump;
+	gchar buf[4096];
+	gssize len;
+	int fds[2];
+
+	reset_mock (10, 0, 0, 0);
+
+	g_assert (libmodest_dbus_client_search (osso_ctx, "query", NULL, 0, 0, 0,
+						MODEST_DBUS_SEARCH_SUBJECT, &hits));
+	modest_search_hit_list_free (hits);
+
+	events = libmodest_dbus_client_get_events (client, &n_events);
+	g_assert_cmpuint (n_events, >, 0);
+	g_assert_cmpuint (n_events, <=, MODEST_DBUS_CLIENT_EVENT_LOG_SIZE);
+	g_assert_cmpstr (events[n_events - 1].method, ==, MODEST_DBUS_METHOD_SEARCH);
+	g_assert_cmpint (events[n_events - 1].result, ==, MODEST_DBUS_EVENT_OK);
+	g_assert_cmpuint (events[n_events - 1].serial, !=, 0);
+	g_assert_cmpint (events[n_events - 1].duration, >=, 0);
+	if (n_events > 1) {
+		g_assert_cmpint (events[n_events - 2].time, <=, events[n_events - 1].time);
+	}
+	g_free (events);
+
+	/* The dump names the calls */
+	g_assert (pipe (fds) == 0);
+	libmodest_dbus_client_dump_events (client, fds[1]);
+	close (fds[1]);
+
+	dump = g_string_new (NULL);
+	while ((len = read (fds[0], buf, sizeof (buf))) > 0) {
+		g_string_append_len (dump, buf, len);
+	}
+	close (fds[0]);
+
+	g_assert (strstr (dump->str, MODEST_DBUS_METHOD_SEARCH) != NULL);
+	g_string_free (dump, TRUE);
+}
+
+static void
+test_timeout (void)
+{
+	ModestDbusEvent *events;
+	guint n_events;
+	GList *hits = NULL;
+
+	reset_mock (10, 0, 0, 1000);
+	g_assert (libmodest_dbus_client_set_timeout (client, MODEST_DBUS_METHOD_SEARCH, 100));
+
+	g_assert (!libmodest_dbus_client_search (osso_ctx, "query", NULL, 0, 0, 0,
+						 MODEST_DBUS_SEARCH_SUBJECT, &hits));
+
+	events = libmodest_dbus_client_get_events (client, &n_events);
+	g_assert_cmpuint (n_events, >, 0);
+	g_assert_cmpstr (events[n_events - 1].method, ==, MODEST_DBUS_METHOD_SEARCH);
+	g_assert_cmpint (events[n_events - 1].result, ==, MODEST_DBUS_EVENT_TIMEOUT);
+	g_free (events);
+
+	libmodest_dbus_client_set_timeout (client, MODEST_DBUS_METHOD_SEARCH, -1);
+	reset_mock (0, 0, 0, 0);
+}
+
+static void
+on_folder_updated (ModestDbusClient *client, const gchar *account_id,
+		   const gchar *folder_id, gpointer user_data)
+{
+	g_assert_cmpstr (account_id, ==, "account1");
+	g_assert_cmpstr (folder_id, ==, "INBOX");
+
+	g_main_loop_quit (user_data);
+}
+
+static void
+test_folder_updated (void)
+{
+	GMainLoop *loop = g_main_loop_new (NULL, FALSE);
+	gulong id;
+
+	id = libmodest_dbus_client_subscribe_folder_updated (client, "account1",
+							     on_folder_updated, loop, NULL);
+	g_assert (id != 0);
+
+	/* Not for the account we subscribed to */
+	g_assert (modest_mock_emit_folder_updated ("account0", "INBOX"));
+	g_assert (modest_mock_emit_folder_updated ("account1", "INBOX"));
+	g_main_loop_run (loop);
+
+	libmodest_dbus_client_unsubscribe (client, id);
+	g_main_loop_unref (loop);
+}
+
+int
+main (int argc, char *argv[])
+{
+	int res;
+
+	g_test_init (&argc, &argv, NULL);
+
+	osso_ctx = osso_initialize ("modest_client_test", "1.0", FALSE, NULL);
+	g_assert (osso_ctx != NULL);
+	client = libmodest_dbus_client_new (osso_ctx);
+
+	g_test_add_func ("/client/search", test_search);
+	g_test_add_func ("/client/search-array", test_search_array);
+	g_test_add_func ("/client/search-set", test_search_set);
+	g_test_add_func ("/client/search-set-interned", test_search_set_interned);
+	g_test_add_func ("/client/search-view", test_search_view);
+	g_test_add_func ("/client/search-paged", test_search_paged);
+	g_test_add_func ("/client/search-top", test_search_top);
+	g_test_add_func ("/client/search-fields", test_search_fields);
+	g_test_add_func ("/client/search-async", test_search_async);
+	g_test_add_func ("/client/search-cancel", test_search_cancel);
+	g_test_add_func ("/client/search-stream", test_search_stream);
+	g_test_add_func ("/client/search-stream-cancel", test_search_stream_cancel);
+	g_test_add_func ("/client/search-stream-exit", test_search_stream_exit);
+	g_test_add_func ("/client/get-unread-messages", test_get_unread_messages);
+	g_test_add_func ("/client/get-unread-messages-set", test_get_unread_messages_set);
+	g_test_add_func ("/client/get-unread-messages-async", test_get_unread_messages_async);
+	g_test_add_func ("/client/get-unread-messages-cancel", test_get_unread_messages_cancel);
+	g_test_add_func ("/client/unread-model", test_unread_model);
+	g_test_add_func ("/client/get-folders", test_get_folders);
+	g_test_add_func ("/client/get-folders-array", test_get_folders_array);
+	g_test_add_func ("/client/get-folders-async", test_get_folders_async);
+	g_test_add_func ("/client/folder-cache", test_folder_cache);
+	g_test_add_func ("/client/delete-messages", test_delete_messages);
+	g_test_add_func ("/client/simple-calls", test_simple_calls);
+	g_test_add_func ("/client/no-reply", test_no_reply);
+	g_test_add_func ("/client/no-reply-restart", test_no_reply_restart);
+	g_test_add_func ("/client/coalesce", test_coalesce);
+	g_test_add_func ("/client/only-if-running", test_only_if_running);
+	g_test_add_func ("/client/stats", test_stats);
+	g_test_add_func ("/client/events", test_events);
+	g_test_add_func ("/client/timeout", test_timeout);
+	g_test_add_func ("/client/folder-updated", test_folder_updated);
+
+	/* Against a modest without the newer methods */
+	g_test_add_func ("/client/legacy/search-paged", test_search_paged_legacy);
+	g_test_add_func ("/client/legacy/search-top", test_search_top_legacy);
+	g_test_add_func ("/client/legacy/search-fields", test_search_fields_legacy);
+	g_test_add_func ("/client/legacy/search-stream", test_search_stream_legacy);
+	g_test_add_func ("/client/legacy/delete-messages", test_delete_messages_legacy);
+
+	res = g_test_run ();
+
+	libmodest_dbus_client_unref (client);
+	osso_deinitialize (osso_ctx);
+
+	return res;
+}
@@ -0,0 +1,310 @@
+/* Copyright (c) 2007, Nokia Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the name of the Nokia Corporation nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Microbenchmarks of the reply decoders, without a bus: large replies
+ * are built in memory, as the mock modest service would send them, and
+ * decoded and freed in a loop. Reports the time and the allocations per
+ * item, so that regressions of the decoders show up. */
+
+#include "libmodest-dbus-client.h"
+#include "libmodest-dbus-api.h"
+#include "libmodest-dbus-private.h"
+#include "modest-mock.h"
+
+#include <stdlib.h>
+
+/* Decode at least that many items per size, to smooth out the timings */
+#define BENCH_ITEMS_PER_SIZE 2000000
+#define BENCH_MIN_RUNS       3
+
+/* The accounts the unread messages are spread over */
+#define BENCH_ACCOUNTS 10
+
+static gsize n_allocs = 0;
+static gboolean counting = FALSE;
+
+#ifdef __GLIBC__
+
+/* Counts the allocations by wrapping the ones of the C library, which
+ * GLib uses with G_SLICE=always-malloc. */
+#define BENCH_COUNTS_ALLOCS 1
+
+extern void *__libc_malloc (size_t size);
+extern void *__libc_calloc (size_t n, size_t size);
+extern void *__libc_realloc (void *ptr, size_t size);
+
+void *
+malloc (size_t size)
+{
+	if (counting) {
+		n_allocs++;
+	}
+
+	return __libc_malloc (size);
+}
+
+void *
+calloc (size_t n, size_t size)
+{
+	if (counting) {
+		n_allocs++;
+	}
+
+	return __libc_calloc (n, size);
+}
+
+void *
+realloc (void *ptr, size_t size)
+{
+	if (counting && ptr == NULL) {
+		n_allocs++;
+	}
+
+	return __libc_realloc (ptr, size);
+}
+
+#endif
+
+static void
+append_search_hits (DBusMessage *msg, guint n_items)
+{
+	modest_mock_append_search_hits (msg, 0, n_items);
+}
+
+/* What most callers need to list the hits */
+#define BENCH_SEARCH_FIELDS (MODEST_DBUS_SEARCH_FIELD_MSGID | MODEST_DBUS_SEARCH_FIELD_TIMESTAMP)
+
+static void
+append_search_hit_columns (DBusMessage *msg, guint n_items)
+{
+	modest_mock_append_search_hit_columns (msg, 0, n_items, BENCH_SEARCH_FIELDS);
+}
+
+static void
+append_account_hits (DBusMessage *msg, guint n_items)
+{
+	modest_mock_append_account_hits (msg, BENCH_ACCOUNTS, n_items / BENCH_ACCOUNTS);
+}
+
+static void
+append_folders (DBusMessage *msg, guint n_items)
+{
+	modest_mock_append_folders (msg, n_items);
+}
+
+static gpointer
+decode_search_hits (DBusMessage *reply)
+{
+	return modest_dbus_message_get_search_hits (reply, NULL);
+}
+
+static gpointer
+decode_search_hit_set (DBusMessage *reply)
+{
+	return modest_dbus_message_get_search_hit_set (reply, MODEST_DBUS_INTERN_NONE);
+}
+
+static gpointer
+decode_search_hit_set_interned (DBusMessage *reply)
+{
+	return modest_dbus_message_get_search_hit_set (reply, MODEST_DBUS_INTERN_RESULT);
+}
+
+static gpointer
+decode_search_hit_columns (DBusMessage *reply)
+{
+	return modest_dbus_message_get_search_hit_columns (reply, BENCH_SEARCH_FIELDS,
+							   MODEST_DBUS_INTERN_NONE);
+}
+
+static gpointer
+decode_account_hits (DBusMessage *reply)
+{
+	return modest_dbus_message_get_account_hits_list (reply, NULL);
+}
+
+static gpointer
+decode_account_hits_set (DBusMessage *reply)
+{
+	return modest_dbus_message_get_account_hits_set (reply, MODEST_DBUS_INTERN_NONE);
+}
+
+static gpointer
+decode_account_hits_set_interned (DBusMessage *reply)
+{
+	return modest_dbus_message_get_account_hits_set (reply, MODEST_DBUS_INTERN_RESULT);
+}
+
+static gpointer
+decode_folders (DBusMessage *reply)
+{
+	return modest_dbus_message_get_folders (reply, NULL);
+}
+
+typedef gpointer (*BenchDecodeFunc) (DBusMessage *reply);
+
+static const struct {
+	const gchar    *name;
+	const gchar    *method;
+	void          (*append) (DBusMessage *msg, guint n_items);
+	BenchDecodeFunc decode;
+	GDestroyNotify  free_result;
+} decoders[] = {
+	{ "search_hits", MODEST_DBUS_METHOD_SEARCH, append_search_hits,
+	  decode_search_hits,
+	  (GDestroyNotify) modest_search_hit_list_free },
+	{ "search_array", MODEST_DBUS_METHOD_SEARCH, append_search_hits,
+	  (BenchDecodeFunc) modest_dbus_message_get_search_hit_array,
+	  (GDestroyNotify) g_ptr_array_unref },
+	{ "search_set", MODEST_DBUS_METHOD_SEARCH, append_search_hits,
+	  decode_search_hit_set,
+	  (GDestroyNotify) modest_search_hit_set_free },
+	{ "search_intern", MODEST_DBUS_METHOD_SEARCH, append_search_hits,
+	  decode_search_hit_set_interned,
+	  (GDestroyNotify) modest_search_hit_set_free },
+	{ "search_view", MODEST_DBUS_METHOD_SEARCH, append_search_hits,
+	  (BenchDecodeFunc) modest_dbus_message_get_search_hit_view,
+	  (GDestroyNotify) modest_search_hit_view_free },
+	{ "search_fields", MODEST_DBUS_METHOD_SEARCH_FIELDS, append_search_hit_columns,
+	  decode_search_hit_columns,
+	  (GDestroyNotify) modest_search_hit_set_free },
+	{ "account_hits", MODEST_DBUS_METHOD_GET_UNREAD_MESSAGES, append_account_hits,
+	  decode_account_hits,
+	  (GDestroyNotify) modest_account_hits_list_free },
+	{ "account_array", MODEST_DBUS_METHOD_GET_UNREAD_MESSAGES, append_account_hits,
+	  (BenchDecodeFunc) modest_dbus_message_get_account_hits_array,
+	  (GDestroyNotify) g_ptr_array_unref },
+	{ "account_set", MODEST_DBUS_METHOD_GET_UNREAD_MESSAGES, append_account_hits,
+	  decode_account_hits_set,
+	  (GDestroyNotify) modest_account_hits_set_free },
+	{ "account_intern", MODEST_DBUS_METHOD_GET_UNREAD_MESSAGES, append_account_hits,
+	  decode_account_hits_set_interned,
+	  (GDestroyNotify) modest_account_hits_set_free },
+	{ "folders", MODEST_DBUS_METHOD_GET_FOLDERS, append_folders,
+	  decode_folders,
+	  (GDestroyNotify) modest_folder_result_list_free },
+	{ "folder_array", MODEST_DBUS_METHOD_GET_FOLDERS, append_folders,
+	  (BenchDecodeFunc) modest_dbus_message_get_folder_array,
+	  (GDestroyNotify) g_ptr_array_unref },
+};
+
+/* Builds a reply of @n_items items, and passes it through the wire
+ * format, so that it is read like one received from modest. */
+static DBusMessage *
+bench_build_reply (guint index, guint n_items, int *size)
+{
+	DBusMessage *call, *reply, *received;
+	DBusError error;
+	char *data;
+
+	call = dbus_message_new_method_call (MODEST_DBUS_SERVICE, MODEST_DBUS_OBJECT,
+					     MODEST_DBUS_IFACE, decoders[index].method);
+	dbus_message_set_serial (call, 1);
+	reply = dbus_message_new_method_return (call);
+	dbus_message_set_serial (reply, 2);
+	decoders[index].append (reply, n_items);
+
+	if (!dbus_message_marshal (reply, &data, size)) {
+		g_error ("Could not marshal a reply of %u %s", n_items, decoders[index].name);
+	}
+
+	dbus_error_init (&error);
+	received = dbus_message_demarshal (data, *size, &error);
+	if (received == NULL) {
+		g_error ("Could not demarshal a reply of %u %s: %s", n_items,
+			 decoders[index].name, error.message);
+	}
+
+	dbus_free (data);
+	dbus_message_unref (reply);
+	dbus_message_unref (call);
+
+	return received;
+}
+
+static void
+bench_run (guint index, guint n_items)
+{
+	DBusMessage *reply;
+	gint64 decode_time = 0, free_time = 0, start;
+	guint n_runs, i;
+	int size;
+
+	reply = bench_build_reply (index, n_items, &size);
+	n_runs = MAX (BENCH_ITEMS_PER_SIZE / n_items, BENCH_MIN_RUNS);
+	n_allocs = 0;
+
+	for (i = 0; i < n_runs; i++) {
+		gpointer result;
+
+		counting = TRUE;
+		start = g_get_monotonic_time ();
+		result = decoders[index].decode (reply);
+		decode_time += g_get_monotonic_time () - start;
+		counting = FALSE;
+
+		start = g_get_monotonic_time ();
+		decoders[index].free_result (result);
+		free_time += g_get_monotonic_time () - start;
+	}
+
+	g_print ("%-14s %8u %10.1f %10.1f ", decoders[index].name, n_items,
+		 decode_time * 1000.0 / ((gdouble) n_runs * n_items),
+		 free_time * 1000.0 / ((gdouble) n_runs * n_items));
+#ifdef BENCH_COUNTS_ALLOCS
+	g_print ("%12.2f", n_allocs / ((gdouble) n_runs * n_items));
+#else
+	g_print ("%12s", "n/a");
+#endif
+	g_print (" %10.1f\n", size / (gdouble) n_items);
+
+	dbus_message_unref (reply);
+}
+
+int
+main (int argc, char *argv[])
+{
+	guint sizes[] = { 10, 1000, 100000 };
+	guint i, j;
+
+	/* Every allocation goes through malloc(), to be counted */
+	g_setenv ("G_SLICE", "always-malloc", TRUE);
+
+	/* All per item */
+	g_print ("%-14s %8s %10s %10s %12s %10s\n", "decoder", "items", "decode ns",
+		 "free ns", "allocs", "bytes");
+
+	for (i = 0; i < G_N_ELEMENTS (decoders); i++) {
+		for (j = 0; j < G_N_ELEMENTS (sizes); j++) {
+			bench_run (i, sizes[j]);
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,194 @@
+/* Copyright (c) 2007, Nokia Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the name of the Nokia Corporation nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Calls to the mock modest service, for the tests and benchmarks */
+
+#include "libmodest-dbus-api.h"
+#include "modest-mock.h"
+
+#include <dbus/dbus.h>
+
+/* Calls @method of the mock with the DBUS_TYPE_INVALID terminated
+ * arguments, returning the reply or %NULL */
+static DBusMessage *
+modest_mock_call (const gchar *method, int first_arg_type, ...)
+{
+	DBusConnection *connection;
+	DBusMessage *msg;
+	DBusMessage *reply;
+	DBusError error;
+	va_list args;
+
+	dbus_error_init (&error);
+	connection = dbus_bus_get (DBUS_BUS_SESSION, &error);
+
+	if (connection == NULL) {
+		g_warning ("%s: %s", __FUNCTION__, error.message);
+		dbus_error_free (&error);
+		return NULL;
+	}
+
+	msg = dbus_message_new_method_call (MODEST_DBUS_SERVICE, MODEST_DBUS_OBJECT,
+					    MODEST_MOCK_IFACE, method);
+
+	va_start (args, first_arg_type);
+	dbus_message_append_args_valist (msg, first_arg_type, args);
+	va_end (args);
+
+	reply = dbus_connection_send_with_reply_and_block (connection, msg, -1, &error);
+	dbus_message_unref (msg);
+	dbus_connection_unref (connection);
+
+	if (reply == NULL) {
+		g_warning ("%s: %s: %s", __FUNCTION__, method, error.message);
+		dbus_error_free (&error);
+	}
+
+	return reply;
+}
+
+gboolean
+modest_mock_configure (guint hits, guint accounts, guint folders, guint latency,
+		       gboolean legacy)
+{
+	DBusMessage *reply;
+	dbus_uint32_t hits_v = hits;
+	dbus_uint32_t accounts_v = accounts;
+	dbus_uint32_t folders_v = folders;
+	dbus_uint32_t latency_v = latency;
+	dbus_bool_t legacy_v = legacy;
+
+	reply = modest_mock_call (MODEST_MOCK_METHOD_CONFIGURE,
+				  DBUS_TYPE_UINT32, &hits_v,
+				  DBUS_TYPE_UINT32, &accounts_v,
+				  DBUS_TYPE_UINT32, &folders_v,
+				  DBUS_TYPE_UINT32, &latency_v,
+				  DBUS_TYPE_BOOLEAN, &legacy_v,
+				  DBUS_TYPE_INVALID);
+
+	if (reply == NULL) {
+		return FALSE;
+	}
+
+	dbus_message_unref (reply);
+
+	return TRUE;
+}
+
+guint
+modest_mock_get_call_count (const gchar *method)
+{
+	DBusMessage *reply;
+	dbus_uint32_t count = 0;
+
+	reply = modest_mock_call (MODEST_MOCK_METHOD_GET_CALL_COUNT,
+				  DBUS_TYPE_STRING, &method,
+				  DBUS_TYPE_INVALID);
+
+	if (reply == NULL) {
+		return 0;
+	}
+
+	dbus_message_get_args (reply, NULL, DBUS_TYPE_UINT32, &count, DBUS_TYPE_INVALID);
+	dbus_message_unref (reply);
+
+	return count;
+}
+
+gboolean
+modest_mock_emit_folder_updated (const gchar *account_id, const gchar *folder_id)
+{
+	DBusMessage *reply;
+
+	reply = modest_mock_call (MODEST_MOCK_METHOD_EMIT_FOLDER_UPDATED,
+				  DBUS_TYPE_STRING, &account_id,
+				  DBUS_TYPE_STRING, &folder_id,
+				  DBUS_TYPE_INVALID);
+
+	if (reply == NULL) {
+		return FALSE;
+	}
+
+	dbus_message_unref (reply);
+
+	return TRUE;
+}
+
+gboolean
+modest_mock_release_name (guint absence)
+{
+	DBusMessage *reply;
+	dbus_uint32_t absence_v = absence;
+
+	reply = modest_mock_call (MODEST_MOCK_METHOD_RELEASE_NAME,
+				  DBUS_TYPE_UINT32, &absence_v,
+				  DBUS_TYPE_INVALID);
+
+	if (reply == NULL) {
+		return FALSE;
+	}
+
+	dbus_message_unref (reply);
+
+	return TRUE;
+}
+
+gboolean
+modest_mock_wait_for_name (void)
+{
+	DBusConnection *connection;
+	DBusError error;
+	dbus_bool_t has_owner = FALSE;
+
+	dbus_error_init (&error);
+	connection = dbus_bus_get (DBUS_BUS_SESSION, &error);
+
+	while (connection != NULL && !has_owner) {
+		has_owner = dbus_bus_name_has_owner (connection, MODEST_DBUS_SERVICE, &error);
+
+		if (dbus_error_is_set (&error)) {
+			break;
+		}
+
+		if (!has_owner) {
+			g_usleep (10 * 1000);
+		}
+	}
+
+	if (dbus_error_is_set (&error)) {
+		g_warning ("%s: %s", __FUNCTION__, error.message);
+		dbus_error_free (&error);
+	}
+
+	if (connection) {
+		dbus_connection_unref (connection);
+	}
+
+	return has_owner;
+}
@@ -0,0 +1,237 @@
+/* Copyright (c) 2007, Nokia Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the name of the Nokia Corporation nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* The replies of the mock modest service, also used to build synthetic
+ * replies for the decoder benchmarks. They are encoded with the code
+ * generated from libmodest-dbus-types.def, like the client decodes them. */
+
+#include "modest-mock.h"
+#include "libmodest-dbus-marshal.h"
+
+/* The hits from @first to @last, excluded */
+static void
+mock_write_search_hit (DBusMessageIter *array, guint i)
+{
+	gchar msgid[64], subject[64], sender[64];
+	ModestSearchHit hit;
+
+	g_snprintf (msgid, sizeof (msgid), MODEST_MOCK_HIT_MSGID_FORMAT, i);
+	g_snprintf (subject, sizeof (subject), MODEST_MOCK_HIT_SUBJECT_FORMAT, i);
+	g_snprintf (sender, sizeof (sender), MODEST_MOCK_HIT_SENDER_FORMAT, i);
+
+	hit.msgid = msgid;
+	hit.subject = subject;
+	hit.folder = MODEST_MOCK_HIT_FOLDER;
+	hit.sender = sender;
+	hit.msize = MODEST_MOCK_HIT_SIZE + i;
+	hit.has_attachment = (i % 2) == 0;
+	hit.is_unread = (i % 3) == 0;
+	hit.timestamp = MODEST_MOCK_HIT_TIMESTAMP + i;
+
+	modest_dbus_write_search_hit (array, &hit);
+}
+
+void
+modest_mock_append_search_hits (DBusMessage *msg, guint first, guint last)
+{
+	DBusMessageIter iter, array;
+	guint i;
+
+	dbus_message_iter_init_append (msg, &iter);
+	dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY,
+					  modest_dbus_search_hit_signature, &array);
+
+	for (i = first; i < last; i++) {
+		mock_write_search_hit (&array, i);
+	}
+
+	dbus_message_iter_close_container (&iter, &array);
+}
+
+/* Appends the column of @field of the hits from @first to @last */
+static void
+mock_append_search_hit_column (DBusMessageIter *iter, ModestDBusSearchFields field,
+			       guint first, guint last)
+{
+	DBusMessageIter array;
+	char type[2] = { 0, 0 };
+	guint i;
+
+	switch (field) {
+	case MODEST_DBUS_SEARCH_FIELD_SIZE:
+		type[0] = DBUS_TYPE_UINT64;
+		break;
+	case MODEST_DBUS_SEARCH_FIELD_HAS_ATTACHMENT:
+	case MODEST_DBUS_SEARCH_FIELD_IS_UNREAD:
+		type[0] = DBUS_TYPE_BOOLEAN;
+		break;
+	case MODEST_DBUS_SEARCH_FIELD_TIMESTAMP:
+		type[0] = DBUS_TYPE_INT64;
+		break;
+	default:
+		type[0] = DBUS_TYPE_STRING;
+		break;
+	}
+
+	dbus_message_iter_open_container (iter, DBUS_TYPE_ARRAY, type, &array);
+
+	for (i = first; i < last; i++) {
+		gchar buf[64];
+		const gchar *str = buf;
+
+		switch (field) {
+		case MODEST_DBUS_SEARCH_FIELD_MSGID:
+			g_snprintf (buf, sizeof (buf), MODEST_MOCK_HIT_MSGID_FORMAT, i);
+			MODEST_DBUS_WRITE_STRING (&array, str);
+			break;
+		case MODEST_DBUS_SEARCH_FIELD_SUBJECT:
+			g_snprintf (buf, sizeof (buf), MODEST_MOCK_HIT_SUBJECT_FORMAT, i);
+			MODEST_DBUS_WRITE_STRING (&array, str);
+			break;
+		case MODEST_DBUS_SEARCH_FIELD_FOLDER:
+			MODEST_DBUS_WRITE_STRING (&array, MODEST_MOCK_HIT_FOLDER);
+			break;
+		case MODEST_DBUS_SEARCH_FIELD_SENDER:
+			g_snprintf (buf, sizeof (buf), MODEST_MOCK_HIT_SENDER_FORMAT, i);
+			MODEST_DBUS_WRITE_STRING (&array, str);
+			break;
+		case MODEST_DBUS_SEARCH_FIELD_SIZE:
+			MODEST_DBUS_WRITE_UINT64 (&array, MODEST_MOCK_HIT_SIZE + i);
+			break;
+		case MODEST_DBUS_SEARCH_FIELD_HAS_ATTACHMENT:
+			MODEST_DBUS_WRITE_BOOLEAN (&array, (i % 2) == 0);
+			break;
+		case MODEST_DBUS_SEARCH_FIELD_IS_UNREAD:
+			MODEST_DBUS_WRITE_BOOLEAN (&array, (i % 3) == 0);
+			break;
+		default:
+			MODEST_DBUS_WRITE_INT64 (&array, MODEST_MOCK_HIT_TIMESTAMP + i);
+			break;
+		}
+	}
+
+	dbus_message_iter_close_container (iter, &array);
+}
+
+void
+modest_mock_append_search_hit_columns (DBusMessage *msg, guint first, guint last,
+				       guint fields)
+{
+	DBusMessageIter iter;
+	guint field;
+
+	dbus_message_iter_init_append (msg, &iter);
+
+	for (field = 1; field & MODEST_DBUS_SEARCH_FIELD_ALL; field <<= 1) {
+		if (fields & field) {
+			mock_append_search_hit_column (&iter, field, first, last);
+		}
+	}
+}
+
+void
+modest_mock_append_search_hits_reversed (DBusMessage *msg, guint first, guint last)
+{
+	DBusMessageIter iter, array;
+	guint i;
+
+	dbus_message_iter_init_append (msg, &iter);
+	dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY,
+					  modest_dbus_search_hit_signature, &array);
+
+	for (i = last; i > first; i--) {
+		mock_write_search_hit (&array, i - 1);
+	}
+
+	dbus_message_iter_close_container (&iter, &array);
+}
+
+/* @n_accounts accounts of @msgs_per_account unread messages */
+void
+modest_mock_append_account_hits (DBusMessage *msg, guint n_accounts, guint msgs_per_account)
+{
+	DBusMessageIter iter, array;
+	ModestAccountHits account;
+	guint i, j;
+
+	dbus_message_iter_init_append (msg, &iter);
+	dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY,
+					  modest_dbus_account_hits_signature, &array);
+
+	account.store_protocol = "imap";
+	account.unread_count = 2 * msgs_per_account;
+
+	for (i = 0; i < n_accounts; i++) {
+		account.account_id = g_strdup_printf ("account%u", i);
+		account.account_name = g_strdup_printf ("Account %u", i);
+		account.hits = NULL;
+
+		for (j = msgs_per_account; j > 0; j--) {
+			ModestGetUnreadMessagesHit *hit = g_slice_new (ModestGetUnreadMessagesHit);
+
+			hit->timestamp = MODEST_MOCK_HIT_TIMESTAMP + j - 1;
+			hit->subject = g_strdup_printf (MODEST_MOCK_HIT_SUBJECT_FORMAT, j - 1);
+			account.hits = g_list_prepend (account.hits, hit);
+		}
+
+		modest_dbus_write_account_hits (&array, &account);
+
+		modest_dbus_free_unread_hit_list (account.hits);
+		g_free (account.account_id);
+		g_free (account.account_name);
+	}
+
+	dbus_message_iter_close_container (&iter, &array);
+}
+
+/* @n_folders folders */
+void
+modest_mock_append_folders (DBusMessage *msg, guint n_folders)
+{
+	DBusMessageIter iter, array;
+	gchar name[64], uri[64];
+	ModestFolderResult folder;
+	guint i;
+
+	folder.folder_name = name;
+	folder.folder_uri = uri;
+
+	dbus_message_iter_init_append (msg, &iter);
+	dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY,
+					  modest_dbus_folder_result_signature, &array);
+
+	for (i = 0; i < n_folders; i++) {
+		g_snprintf (name, sizeof (name), "Folder %u", i);
+		g_snprintf (uri, sizeof (uri), "local://folder%u", i);
+
+		modest_dbus_write_folder_result (&array, &folder);
+	}
+
+	dbus_message_iter_close_container (&iter, &array);
+}
@@ -0,0 +1,115 @@
+/* Copyright (c) 2007, Nokia Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the name of the Nokia Corporation nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __MODEST_MOCK_H__
+#define __MODEST_MOCK_H__
+
+#include <glib.h>
+#include <dbus/dbus.h>
+
+G_BEGIN_DECLS
+
+/* The mock modest service answers the methods of libmodest-dbus-api.h on
+ * the usual name, and these ones, on the same object, to be driven by
+ * the tests and benchmarks. */
+#define MODEST_MOCK_IFACE "com.nokia.modest.Mock"
+
+/* How many search hits, accounts and folders to return, how long to
+ * wait before replying, in milliseconds, and whether to behave like a
+ * modest that predates the methods the client falls back from, failing
+ * them with UnknownMethod. */
+#define MODEST_MOCK_METHOD_CONFIGURE "Configure"
+enum ModestMockConfigureArguments
+{
+	MODEST_MOCK_CONFIGURE_ARG_HITS,
+	MODEST_MOCK_CONFIGURE_ARG_ACCOUNTS,
+	MODEST_MOCK_CONFIGURE_ARG_FOLDERS,
+	MODEST_MOCK_CONFIGURE_ARG_LATENCY,
+	MODEST_MOCK_CONFIGURE_ARG_LEGACY,
+	MODEST_MOCK_CONFIGURE_ARGS_COUNT
+};
+
+/* Returns how many times a method of modest was called, or how many
+ * search_hits it sent. */
+#define MODEST_MOCK_METHOD_GET_CALL_COUNT "GetCallCount"
+
+/* Emits folder_updated with the given account and folder ids. */
+#define MODEST_MOCK_METHOD_EMIT_FOLDER_UPDATED "EmitFolderUpdated"
+
+/* Exits as modest would, dropping the streamed searches, and comes back
+ * with a new unique name after the given number of milliseconds. The
+ * mock cannot be called in the meantime. */
+#define MODEST_MOCK_METHOD_RELEASE_NAME "ReleaseName"
+
+/* Search hits, as modest sends them */
+#define MODEST_MOCK_HIT_MSGID_FORMAT   "local://inbox/%u"
+#define MODEST_MOCK_HIT_SUBJECT_FORMAT "Subject %u"
+#define MODEST_MOCK_HIT_SENDER_FORMAT  "sender%u@example.com"
+#define MODEST_MOCK_HIT_FOLDER         "INBOX"
+#define MODEST_MOCK_HIT_TIMESTAMP      1200000000
+#define MODEST_MOCK_HIT_SIZE           1000
+
+/* The hit i has the timestamp MODEST_MOCK_HIT_TIMESTAMP + i and the size
+ * MODEST_MOCK_HIT_SIZE + i, so both keys sort the hits the same way */
+
+/* Message URIs that DeleteMessages fails to delete contain this */
+#define MODEST_MOCK_MISSING_MSG "missing"
+
+/* The replies of the mock, in modest-mock-replies.c; each appends an
+ * array to @msg */
+void modest_mock_append_search_hits (DBusMessage *msg, guint first, guint last);
+
+/* The same hits, from @last - 1 down to @first */
+void modest_mock_append_search_hits_reversed (DBusMessage *msg, guint first, guint last);
+
+/* The same hits as columns, one for each ModestDBusSearchFields in @fields */
+void modest_mock_append_search_hit_columns (DBusMessage *msg, guint first, guint last,
+					    guint fields);
+
+void modest_mock_append_account_hits (DBusMessage *msg, guint n_accounts,
+				      guint msgs_per_account);
+
+void modest_mock_append_folders (DBusMessage *msg, guint n_folders);
+
+/* Helpers for the programs using the mock, in modest-mock-client.c */
+gboolean modest_mock_configure (guint hits, guint accounts, guint folders, guint latency,
+				gboolean legacy);
+
+guint modest_mock_get_call_count (const gchar *method);
+
+gboolean modest_mock_emit_folder_updated (const gchar *account_id, const gchar *folder_id);
+
+gboolean modest_mock_release_name (guint absence);
+
+/* Waits until the mock is back, without dispatching anything */
+gboolean modest_mock_wait_for_name (void);
+
+G_END_DECLS
+
+#endif /* __MODEST_MOCK_H__ */
@@ -0,0 +1,34 @@
+#!/bin/sh
+# Runs a program against the mock modest service, on a private session bus.
+#
+# usage: run-with-mock.sh MOCK PROGRAM [ARGS...]
+
+srcdir=${srcdir:-`dirname $0`}
+mock=$1
+shift
+
+tmpdir=`mktemp -d` || exit 1
+trap 'kill $mock_pid $daemon_pid 2>/dev/null; rm -rf "$tmpdir"' 0
+
+dbus-daemon --config-file="$srcdir/session.conf" --fork \
+	--print-address=3 --print-pid=4 3>"$tmpdir/address" 4>"$tmpdir/pid" || exit 1
+DBUS_SESSION_BUS_ADDRESS=`cat "$tmpdir/address"`
+daemon_pid=`cat "$tmpdir/pid"`
+export DBUS_SESSION_BUS_ADDRESS
+
+"$mock" &
+mock_pid=$!
+
+# Wait for the mock to own the name of modest
+tries=0
+until dbus-send --session --print-reply --dest=org.freedesktop.DBus /org/freedesktop/DBus \
+	org.freedesktop.DBus.NameHasOwner string:com.nokia.modest 2>/dev/null | grep -q true; do
+	tries=`expr $tries + 1`
+	if [ $tries -ge 100 ]; then
+		echo "$0: the mock modest service did not start" >&2
+		exit 1
+	fi
+	sleep 0.1
+done
+
+"$@"